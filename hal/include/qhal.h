@@ -36,6 +36,7 @@
 #include "qhal_serial_virtual.h"
 
 /* Shared headers.*/
+#include "qhal_nvm_model.h"
 
 /* Layered drivers.*/
 #include "qhal_flash.h"
@@ -51,6 +52,7 @@
 #include "qhal_nvm_mirror.h"
 #include "qhal_nvm_fee.h"
 #include "qhal_nvm_ioblock.h"
+#include "qhal_nvm_cache.h"
 #include "qhal_led.h"
 #include "qhal_gd_ili9341.h"
 #include "qhal_ms5541.h"
@@ -98,6 +98,7 @@ extern "C" {
     bool flashWriteUnprotect(FLASHDriver* flashp, uint32_t startaddr,
             uint32_t n);
     bool flashMassWriteUnprotect(FLASHDriver* flashp);
+    bool flashPoll(FLASHDriver* flashp);
 #ifdef __cplusplus
 }
 #endif
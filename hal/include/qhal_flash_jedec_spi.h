@@ -201,6 +201,11 @@ extern "C" {
     bool fjsMassWriteProtect(FlashJedecSPIDriver* fjsp);
     bool fjsWriteUnprotect(FlashJedecSPIDriver* fjsp, uint32_t startaddr, uint32_t n);
     bool fjsMassWriteUnprotect(FlashJedecSPIDriver* fjsp);
+    bool fjsPoll(FlashJedecSPIDriver* fjsp);
+    bool fjsReadV(FlashJedecSPIDriver* fjsp, uint32_t startaddr,
+            const NVMIOVector* iov, uint32_t iovcnt);
+    bool fjsWriteV(FlashJedecSPIDriver* fjsp, uint32_t startaddr,
+            const NVMIOConstVector* iov, uint32_t iovcnt);
 #ifdef __cplusplus
 }
 #endif
@@ -26,6 +26,11 @@
  *          abstract C++ classes (even if written in C). This system
  *          has then advantage to make the access to nvm devices
  *          independent from the implementation logic.
+ *          Write and erase operations may still be in progress when the
+ *          call returns, the device then stays in @p NVM_WRITING or
+ *          @p NVM_ERASING state until @p nvmSync() waits for them. Devices
+ *          supporting @p nvmPoll() can be checked for completion without
+ *          waiting, so the caller can prepare the next write meanwhile.
  * @{
  */
 
@@ -56,6 +61,24 @@ typedef struct
     uint8_t       write_alignment;    /**< @brief Alignment for writes.       */
 } NVMDeviceInfo;
 
+/**
+ * @brief   Non volatile memory scatter / gather vector element.
+ */
+typedef struct
+{
+    uint8_t*      buffer;             /**< @brief Pointer to the data.        */
+    uint32_t      n;                  /**< @brief Number of bytes.            */
+} NVMIOVector;
+
+/**
+ * @brief   Non volatile memory gather vector element of data being written.
+ */
+typedef struct
+{
+    const uint8_t* buffer;            /**< @brief Pointer to the data.        */
+    uint32_t      n;                  /**< @brief Number of bytes.            */
+} NVMIOConstVector;
+
 /**
  * @brief   @p BaseNVMDevice specific methods.
  */
@@ -90,7 +113,16 @@ typedef struct
     bool (*writeunprotect)(void *instance, uint32_t startaddr,                \
             uint32_t n);                                                      \
     /* Write unprotect whole device. */                                       \
-    bool (*mass_writeunprotect)(void *instance);
+    bool (*mass_writeunprotect)(void *instance);                              \
+    /* End of functions implemented by all drivers. */                        \
+    /* Completes finished operations without waiting, may be NULL.*/          \
+    bool (*poll)(void *instance);                                             \
+    /* Reads a range into several buffers, may be NULL.*/                     \
+    bool (*readv)(void *instance, uint32_t startaddr,                         \
+            const NVMIOVector *iov, uint32_t iovcnt);                         \
+    /* Writes a range from several buffers, may be NULL.*/                    \
+    bool (*writev)(void *instance, uint32_t startaddr,                        \
+            const NVMIOConstVector *iov, uint32_t iovcnt);
 
 /**
  * @brief   @p BaseNVMDevice specific data.
@@ -319,8 +351,82 @@ typedef struct
 #define nvmMassWriteUnprotect(ip)                                             \
         ((ip)->vmt->mass_writeunprotect)(ip)
 
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ * @details The device leaves the @p NVM_WRITING or @p NVM_ERASING state if
+ *          all operations have been finished, see @p nvmIsTransferring().
+ *          Devices not supporting polling wait as @p nvmSync() does.
+ *
+ * @param[in] ip        pointer to a @p BaseNVMDevice or derived class
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  operation succeeded.
+ * @retval HAL_FAILED   operation failed.
+ *
+ * @api
+ */
+#define nvmPoll(ip)                                                           \
+        (((ip)->vmt->poll != NULL) ? (ip)->vmt->poll(ip) : (ip)->vmt->sync(ip))
+
+/**
+ * @brief   Reads a contiguous range into several buffers.
+ * @details Devices not supporting vectors read each buffer on its own.
+ *
+ * @param[in] ip        pointer to a @p BaseNVMDevice or derived class
+ * @param[in] startaddr first address to read
+ * @param[in] iov       array of buffers filled in order
+ * @param[in] iovcnt    number of elements of @p iov
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  operation succeeded.
+ * @retval HAL_FAILED   operation failed.
+ *
+ * @api
+ */
+#define nvmReadV(ip, startaddr, iov, iovcnt)                                  \
+        (((ip)->vmt->readv != NULL) ?                                         \
+         (ip)->vmt->readv(ip, startaddr, iov, iovcnt) :                       \
+         nvmiovRead((BaseNVMDevice*)(ip), startaddr, iov, iovcnt))
+
+/**
+ * @brief   Writes a contiguous range from several buffers.
+ * @details Devices not supporting vectors write each buffer on its own.
+ *
+ * @param[in] ip        pointer to a @p BaseNVMDevice or derived class
+ * @param[in] startaddr first address to write
+ * @param[in] iov       array of buffers written in order
+ * @param[in] iovcnt    number of elements of @p iov
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  operation succeeded.
+ * @retval HAL_FAILED   operation failed.
+ *
+ * @api
+ */
+#define nvmWriteV(ip, startaddr, iov, iovcnt)                                 \
+        (((ip)->vmt->writev != NULL) ?                                        \
+         (ip)->vmt->writev(ip, startaddr, iov, iovcnt) :                      \
+         nvmiovWrite((BaseNVMDevice*)(ip), startaddr, iov, iovcnt))
+
 /** @} */
 
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    uint32_t nvmiovSize(const NVMIOVector* iov, uint32_t iovcnt);
+    uint32_t nvmiovConstSize(const NVMIOConstVector* iov, uint32_t iovcnt);
+    bool nvmiovRead(BaseNVMDevice* nvmp, uint32_t startaddr,
+            const NVMIOVector* iov, uint32_t iovcnt);
+    bool nvmiovWrite(BaseNVMDevice* nvmp, uint32_t startaddr,
+            const NVMIOConstVector* iov, uint32_t iovcnt);
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _QIO_NVM_H_ */
 
 /** @} */
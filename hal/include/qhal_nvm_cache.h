@@ -0,0 +1,238 @@
+/*
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    qnvm_cache.h
+ * @brief   NVM write-back cache driver header.
+ *
+ * @addtogroup NVM_CACHE
+ * @{
+ */
+
+#ifndef _QNVM_CACHE_H_
+#define _QNVM_CACHE_H_
+
+#if HAL_USE_NVM_CACHE || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Address of an unused cache line.
+ */
+#define NVM_CACHE_LINE_UNUSED               0xffffffffUL
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @name    NVM_CACHE configuration options
+ * @{
+ */
+/**
+ * @brief   Enables the @p nvmcacheAcquireBus() and @p nvmcacheReleaseBus() APIs.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_CACHE_USE_MUTUAL_EXCLUSION) || defined(__DOXYGEN__)
+#define NVM_CACHE_USE_MUTUAL_EXCLUSION      TRUE
+#endif
+/** @} */
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Cache line.
+ */
+typedef struct
+{
+    /**
+    * @brief Address of the cached line or @p NVM_CACHE_LINE_UNUSED.
+    */
+    uint32_t addr;
+    /**
+    * @brief Access stamp for least recently used replacement.
+    */
+    uint32_t stamp;
+    /**
+    * @brief Range of bytes within the line written but not flushed yet.
+    */
+    uint32_t dirty_first;
+    uint32_t dirty_end;
+    /**
+    * @brief Bytes outside of the dirty range have been read.
+    */
+    bool filled;
+} NVMCacheLine;
+
+/**
+ * @brief   NVM cache info.
+ */
+typedef struct
+{
+    /**
+    * @brief Number of line sized read accesses served by and missing the
+    *        cache.
+    */
+    uint32_t read_hits;
+    uint32_t read_misses;
+    /**
+    * @brief Number of line sized write accesses merged into a cached line
+    *        and missing the cache.
+    */
+    uint32_t write_hits;
+    uint32_t write_misses;
+    /**
+    * @brief Number of dirty ranges written to the underlying device.
+    */
+    uint32_t flushes;
+    /**
+    * @brief Number of lines replaced.
+    */
+    uint32_t evictions;
+} NVMCacheInfo;
+
+/**
+ * @brief   NVM cache driver configuration structure.
+ */
+typedef struct
+{
+    /**
+    * @brief NVM driver associated to this cache.
+    */
+    BaseNVMDevice* nvmp;
+    /**
+    * @brief Size of a cache line in bytes.
+    * @note  The sector size of the underlying device must be a multiple of
+    *        it, a page or a sector sized line are the natural choices.
+    */
+    uint32_t line_size;
+    /**
+    * @brief Number of cache lines.
+    */
+    uint32_t line_num;
+    /**
+    * @brief Line data buffer of @p line_num * @p line_size bytes.
+    */
+    uint8_t* buffer;
+    /**
+    * @brief Line descriptors, @p line_num entries.
+    */
+    NVMCacheLine* lines;
+} NVMCacheConfig;
+
+/**
+ * @brief   @p NVMCacheDriver specific methods.
+ */
+#define _nvm_cache_driver_methods                                             \
+    _base_nvm_device_methods
+
+/**
+ * @extends BaseNVMDeviceVMT
+ *
+ * @brief   @p NVMCacheDriver virtual methods table.
+ */
+struct NVMCacheDriverVMT
+{
+    _nvm_cache_driver_methods
+};
+
+/**
+ * @extends BaseNVMDevice
+ *
+ * @brief   Structure representing a NVM cache driver.
+ */
+typedef struct
+{
+    /**
+    * @brief Virtual Methods Table.
+    */
+    const struct NVMCacheDriverVMT* vmt;
+    _base_nvm_device_data
+    /**
+    * @brief Current configuration data.
+    */
+    const NVMCacheConfig* config;
+    /**
+    * @brief Device info of underlying nvm device.
+    */
+    NVMDeviceInfo llnvmdi;
+    /**
+    * @brief Access counter stamping lines.
+    */
+    uint32_t stamp;
+    /**
+    * @brief Cache info.
+    */
+    NVMCacheInfo info;
+#if NVM_CACHE_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
+    /**
+     * @brief mutex_t protecting the device.
+     */
+    mutex_t mutex;
+#endif /* NVM_CACHE_USE_MUTUAL_EXCLUSION */
+} NVMCacheDriver;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    void nvmcacheInit(void);
+    void nvmcacheObjectInit(NVMCacheDriver* nvmcachep);
+    void nvmcacheStart(NVMCacheDriver* nvmcachep,
+            const NVMCacheConfig* config);
+    void nvmcacheStop(NVMCacheDriver* nvmcachep);
+    bool nvmcacheRead(NVMCacheDriver* nvmcachep, uint32_t startaddr,
+            uint32_t n, uint8_t* buffer);
+    bool nvmcacheWrite(NVMCacheDriver* nvmcachep, uint32_t startaddr,
+            uint32_t n, const uint8_t* buffer);
+    bool nvmcacheErase(NVMCacheDriver* nvmcachep, uint32_t startaddr,
+            uint32_t n);
+    bool nvmcacheMassErase(NVMCacheDriver* nvmcachep);
+    bool nvmcacheSync(NVMCacheDriver* nvmcachep);
+    bool nvmcachePoll(NVMCacheDriver* nvmcachep);
+    bool nvmcacheGetInfo(NVMCacheDriver* nvmcachep, NVMDeviceInfo* nvmdip);
+    void nvmcacheAcquireBus(NVMCacheDriver* nvmcachep);
+    void nvmcacheReleaseBus(NVMCacheDriver* nvmcachep);
+    bool nvmcacheWriteProtect(NVMCacheDriver* nvmcachep,
+            uint32_t startaddr, uint32_t n);
+    bool nvmcacheMassWriteProtect(NVMCacheDriver* nvmcachep);
+    bool nvmcacheWriteUnprotect(NVMCacheDriver* nvmcachep,
+            uint32_t startaddr, uint32_t n);
+    bool nvmcacheMassWriteUnprotect(NVMCacheDriver* nvmcachep);
+    void nvmcacheGetCacheInfo(NVMCacheDriver* nvmcachep,
+            NVMCacheInfo* infop);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_NVM_CACHE */
+
+#endif /* _QNVM_CACHE_H_ */
+
+/** @} */
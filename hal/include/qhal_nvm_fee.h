@@ -60,6 +60,112 @@
 #define NVM_FEE_WRITE_UNIT_SIZE         2
 #endif
 
+/**
+ * @brief   Enables the RAM index mapping virtual slot addresses to slots.
+ * @note    The index buffer itself is supplied through @p NVMFeeConfig.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_FEE_USE_INDEX) || defined(__DOXYGEN__)
+#define NVM_FEE_USE_INDEX               FALSE
+#endif
+
+/**
+ * @brief   Sets the size of a single RAM index entry in bytes.
+ * @note    Entries of 2 bytes limit an arena, or the whole ring of sectors,
+ *          to 65535 slots.
+ */
+#if !defined(NVM_FEE_INDEX_ENTRY_SIZE) || defined(__DOXYGEN__)
+#define NVM_FEE_INDEX_ENTRY_SIZE        2
+#endif
+
+/**
+ * @brief   Enables the RAM shadow image of the virtual address room.
+ * @note    The shadow buffer itself is supplied through @p NVMFeeConfig.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_FEE_USE_SHADOW) || defined(__DOXYGEN__)
+#define NVM_FEE_USE_SHADOW              FALSE
+#endif
+
+/**
+ * @brief   Sets the size of the garbage collection seen-bitmap in bytes.
+ * @details Garbage collection copies addresses not covered by the RAM index
+ *          in passes of 8 * @p NVM_FEE_GC_BITMAP_SIZE addresses, each pass
+ *          being a single backward scan of the source arena. Only a RAM
+ *          index covering the whole virtual address room makes garbage
+ *          collection a single linear pass.
+ * @note    The bitmap is allocated on the stack of the writing thread.
+ */
+#if !defined(NVM_FEE_GC_BITMAP_SIZE) || defined(__DOXYGEN__)
+#define NVM_FEE_GC_BITMAP_SIZE          128
+#endif
+
+/**
+ * @brief   Sets the maximum number of slot payloads held by an extent record.
+ * @details Writes of consecutive slot payloads are stored as a single extent
+ *          record with the extent format. Payloads following the first one
+ *          are packed into the remaining slots of the record, omitting
+ *          their state marks.
+ */
+#if !defined(NVM_FEE_EXTENT_ENTRIES) || defined(__DOXYGEN__)
+#define NVM_FEE_EXTENT_ENTRIES          32
+#endif
+
+/**
+ * @brief   Enables the key/value record API.
+ * @details Values keyed by a 16 bit ID are stored as records of their own
+ *          in the log, a RAM hash table maps keys to their newest record.
+ *          Updating a value takes a single record, it does not use the
+ *          virtual address room.
+ * @note    The hash table itself is supplied through @p NVMFeeConfig.
+ *          Key/value records require the extent format.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_FEE_USE_KV) || defined(__DOXYGEN__)
+#define NVM_FEE_USE_KV                  FALSE
+#endif
+
+/**
+ * @brief   Sets the maximum length of a key/value record value in bytes.
+ * @note    Room for every key holding a value of this length is taken from
+ *          the virtual address room.
+ */
+#if !defined(NVM_FEE_KV_VALUE_SIZE) || defined(__DOXYGEN__)
+#define NVM_FEE_KV_VALUE_SIZE           32
+#endif
+
+/**
+ * @brief   Enables the background garbage collection thread.
+ * @note    All users have to access the driver through @p nvmfeeAcquireBus()
+ *          and @p nvmfeeReleaseBus().
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_FEE_USE_GC_THREAD) || defined(__DOXYGEN__)
+#define NVM_FEE_USE_GC_THREAD           FALSE
+#endif
+
+/**
+ * @brief   Background garbage collection thread stack size.
+ */
+#if !defined(NVM_FEE_GC_THREAD_STACK_SIZE) || defined(__DOXYGEN__)
+#define NVM_FEE_GC_THREAD_STACK_SIZE    (384 + NVM_FEE_GC_BITMAP_SIZE)
+#endif
+
+/**
+ * @brief   Background garbage collection thread priority.
+ */
+#if !defined(NVM_FEE_GC_THREAD_PRIO) || defined(__DOXYGEN__)
+#define NVM_FEE_GC_THREAD_PRIO          LOWPRIO
+#endif
+
+/**
+ * @brief   Sets the number of slots examined per background step.
+ * @details The driver is locked for a single step only.
+ */
+#if !defined(NVM_FEE_GC_STEP_SLOTS) || defined(__DOXYGEN__)
+#define NVM_FEE_GC_STEP_SLOTS           8
+#endif
+
 /** @} */
 
 /*===========================================================================*/
@@ -70,10 +176,131 @@
 #error "payload size + 4 must be a multiple of write unit size."
 #endif
 
+#if NVM_FEE_INDEX_ENTRY_SIZE != 2 && NVM_FEE_INDEX_ENTRY_SIZE != 4
+#error "index entry size must be 2 or 4."
+#endif
+
+#if NVM_FEE_EXTENT_ENTRIES < 2 || NVM_FEE_EXTENT_ENTRIES > 63
+#error "extent entries must be within 2 and 63."
+#endif
+
+#if NVM_FEE_GC_BITMAP_SIZE < 8
+#error "garbage collection bitmap must be at least 8 bytes."
+#endif
+
+#if NVM_FEE_KV_VALUE_SIZE > 255 || \
+        NVM_FEE_KV_VALUE_SIZE > 64 * NVM_FEE_SLOT_PAYLOAD_SIZE
+#error "key/value record values must not exceed 255 bytes or 64 payloads."
+#endif
+
+#if NVM_FEE_USE_GC_THREAD && !NVM_FEE_USE_MUTUAL_EXCLUSION
+#error "NVM_FEE_USE_GC_THREAD requires NVM_FEE_USE_MUTUAL_EXCLUSION."
+#endif
+
+#if NVM_FEE_USE_GC_THREAD && !NVM_FEE_USE_INDEX
+#error "NVM_FEE_USE_GC_THREAD requires NVM_FEE_USE_INDEX."
+#endif
+
+#if NVM_FEE_USE_GC_THREAD && !defined(_CHIBIOS_RT_)
+#error "NVM_FEE_USE_GC_THREAD requires ChibiOS/RT."
+#endif
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   Layout of the underlying nvm device.
+ */
+typedef enum
+{
+    NVM_FEE_LAYOUT_ARENAS = 0,      /**< Two arenas of half the device.     */
+    NVM_FEE_LAYOUT_RING = 1,        /**< Ring of sectors, one kept erased.  */
+} nvmfeelayout_t;
+
+/**
+ * @brief   On-media format of slots written.
+ */
+typedef enum
+{
+    NVM_FEE_FORMAT_MARKS = 0,       /**< Dirty mark, data and valid mark.   */
+    NVM_FEE_FORMAT_CRC = 1,         /**< Data and CRC in a single write.    */
+    NVM_FEE_FORMAT_EXTENTS = 2,     /**< CRC format plus extent records.    */
+} nvmfeeformat_t;
+
+#if NVM_FEE_USE_INDEX || defined(__DOXYGEN__)
+/**
+ * @brief   Type of a RAM index entry.
+ */
+#if NVM_FEE_INDEX_ENTRY_SIZE == 2
+typedef uint16_t nvmfeeindex_t;
+#else
+typedef uint32_t nvmfeeindex_t;
+#endif
+#endif /* NVM_FEE_USE_INDEX */
+
+#if NVM_FEE_USE_KV || defined(__DOXYGEN__)
+/**
+ * @brief   Type of a key/value record key.
+ */
+typedef uint16_t nvmfeekey_t;
+
+/**
+ * @brief   Type of a key/value hash table entry.
+ * @note    Keys are limited to 16 bits by the record header, values to
+ *          @p NVM_FEE_KV_VALUE_SIZE bytes.
+ */
+typedef struct
+{
+    /**
+     * @brief Key of the entry.
+     */
+    nvmfeekey_t key;
+    /**
+     * @brief Length of the value in bytes.
+     */
+    uint16_t length;
+    /**
+     * @brief Slot of the newest record, all ones if the entry is free.
+     */
+    uint32_t slot;
+} nvmfeekv_t;
+#endif /* NVM_FEE_USE_KV */
+
+#if NVM_FEE_USE_GC_THREAD || defined(__DOXYGEN__)
+/**
+ * @brief   NVM fee garbage collection info.
+ */
+typedef struct
+{
+    /**
+     * @brief Used part of the log in percent.
+     */
+    uint32_t usage;
+    /**
+     * @brief Number of finished background passes.
+     */
+    uint32_t passes;
+    /**
+     * @brief Number of background steps.
+     */
+    uint32_t steps;
+    /**
+     * @brief Duration of the last and of the longest background step.
+     */
+    sysinterval_t step_last;
+    sysinterval_t step_max;
+    /**
+     * @brief Number of collections writers had to wait for.
+     */
+    uint32_t foreground;
+    /**
+     * @brief Duration of the longest collection a writer had to wait for.
+     */
+    sysinterval_t foreground_max;
+} NVMFeeGCInfo;
+#endif /* NVM_FEE_USE_GC_THREAD */
+
 /**
  * @brief   NVM fee driver configuration structure.
  */
@@ -87,6 +314,73 @@ typedef struct
      * @brief number of sectors to assign to metadata header
      */
     uint32_t sector_header_num;
+    /**
+     * @brief Layout of the underlying nvm device.
+     * @note  The ring layout requires at least three sectors and a RAM
+     *        index covering the whole virtual address room. Memory
+     *        formatted with another layout is reformatted.
+     */
+    nvmfeelayout_t layout;
+    /**
+     * @brief Format of newly written slots.
+     * @note  Arenas or sectors using another format are still read and
+     *        get converted by garbage collection.
+     * @note  The ring layout keeps using the extent format once written as
+     *        converting extents back to single slots may need more room
+     *        than the reserve sector.
+     */
+    nvmfeeformat_t format;
+#if NVM_FEE_USE_INDEX || defined(__DOXYGEN__)
+    /**
+     * @brief Optional RAM index buffer or NULL.
+     * @note  One entry is required per virtual slot address. Addresses
+     *        beyond @p index_num entries are looked up by scanning the arena
+     *        and take garbage collection passes of their own, see
+     *        @p NVM_FEE_GC_BITMAP_SIZE.
+     */
+    nvmfeeindex_t* index;
+    /**
+     * @brief Number of entries in the RAM index buffer.
+     */
+    uint32_t index_num;
+#endif /* NVM_FEE_USE_INDEX */
+#if NVM_FEE_USE_SHADOW || defined(__DOXYGEN__)
+    /**
+     * @brief Optional RAM shadow image buffer or NULL.
+     * @note  The buffer must hold the whole virtual address room, reads are
+     *        then served from RAM.
+     */
+    uint8_t* shadow;
+    /**
+     * @brief Size of the RAM shadow image buffer in bytes.
+     */
+    uint32_t shadow_size;
+#endif /* NVM_FEE_USE_SHADOW */
+#if NVM_FEE_USE_KV || defined(__DOXYGEN__)
+    /**
+     * @brief Optional key/value hash table buffer or NULL.
+     * @note  Up to three quarters of the entries hold keys.
+     */
+    nvmfeekv_t* kv;
+    /**
+     * @brief Number of entries in the key/value hash table buffer.
+     */
+    uint32_t kv_num;
+#endif /* NVM_FEE_USE_KV */
+#if NVM_FEE_USE_GC_THREAD || defined(__DOXYGEN__)
+    /**
+     * @brief Usage of the log in percent starting background garbage
+     *        collection or 0 to disable it.
+     * @note  Background garbage collection requires the ring layout, an
+     *        arena is only collected as a whole by the writer.
+     */
+    uint8_t gc_high_watermark;
+    /**
+     * @brief Usage of the log in percent stopping background garbage
+     *        collection.
+     */
+    uint8_t gc_low_watermark;
+#endif /* NVM_FEE_USE_GC_THREAD */
 } NVMFeeConfig;
 
 /**
@@ -133,12 +427,85 @@ typedef struct
      * @brief Used slots in arena.
      */
     uint32_t arena_slots[2];
+    /**
+     * @brief Slot format of each arena, arena layout only.
+     */
+    nvmfeeformat_t arena_format[2];
+    /**
+     * @brief Slot format in use.
+     */
+    nvmfeeformat_t format;
     /**
     * @brief Cached values.
     */
     uint32_t arena_num_sectors;
     uint32_t arena_num_slots;
     uint32_t fee_size;
+    /**
+     * @brief Ring layout: oldest sector, number of sectors in use, used
+     *        slots in the newest sector and its sequence number.
+     */
+    uint32_t ring_tail;
+    uint32_t ring_sectors;
+    uint32_t ring_head_slots;
+    uint32_t ring_sequence;
+    /**
+     * @brief Ring layout: number of sectors in use with a slot format
+     *        other than configured, last sector looked up and its format.
+     */
+    uint32_t ring_foreign;
+    uint32_t ring_format_sector;
+    nvmfeeformat_t ring_format;
+#if NVM_FEE_USE_INDEX || defined(__DOXYGEN__)
+    /**
+     * @brief Number of RAM index entries in use.
+     */
+    uint32_t index_num;
+#endif /* NVM_FEE_USE_INDEX */
+#if NVM_FEE_USE_SHADOW || defined(__DOXYGEN__)
+    /**
+     * @brief RAM shadow image in use or NULL.
+     */
+    uint8_t* shadow;
+#endif /* NVM_FEE_USE_SHADOW */
+#if NVM_FEE_USE_KV || defined(__DOXYGEN__)
+    /**
+     * @brief Number of key/value hash table entries in use and number of
+     *        keys stored.
+     */
+    uint32_t kv_num;
+    uint32_t kv_count;
+#endif /* NVM_FEE_USE_KV */
+#if NVM_FEE_USE_GC_THREAD || defined(__DOXYGEN__)
+    /**
+     * @brief Garbage collection info.
+     */
+    NVMFeeGCInfo gc_info;
+    /**
+     * @brief Used slots at the end of the last background pass.
+     */
+    uint32_t gc_mark;
+    /**
+     * @brief Next slot of the oldest sector to examine, ring layout only.
+     */
+    uint32_t gc_cursor;
+    /**
+     * @brief Background pass requested.
+     */
+    bool gc_pending;
+    /**
+     * @brief Pointer to the thread.
+     */
+    thread_reference_t gc_thread;
+    /**
+     * @brief Pointer to the thread when it is sleeping or @p NULL.
+     */
+    thread_reference_t gc_wait;
+    /**
+     * @brief Working area for the garbage collection thread.
+     */
+    THD_WORKING_AREA(gc_wa, NVM_FEE_GC_THREAD_STACK_SIZE);
+#endif /* NVM_FEE_USE_GC_THREAD */
 #if NVM_FEE_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
     /**
      * @brief mutex_t protecting the device.
@@ -151,6 +518,55 @@ typedef struct
 /* Driver macros.                                                            */
 /*===========================================================================*/
 
+/**
+ * @name    Macro Functions (NVMFeeDriver)
+ * @{
+ */
+
+#if NVM_FEE_USE_INDEX || defined(__DOXYGEN__)
+/**
+ * @brief   Returns the number of RAM index entries required to cover the
+ *          whole virtual address room.
+ * @pre     The driver must have been started.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ *
+ * @return                  Number of entries.
+ *
+ * @api
+ */
+#define nvmfeeGetIndexEntriesRequired(nvmfeep)                                \
+    ((nvmfeep)->fee_size / NVM_FEE_SLOT_PAYLOAD_SIZE)
+
+/**
+ * @brief   Returns the RAM actually used by the index in bytes.
+ * @pre     The driver must have been started.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ *
+ * @return                  Size in bytes.
+ *
+ * @api
+ */
+#define nvmfeeGetIndexSize(nvmfeep)                                           \
+    ((nvmfeep)->index_num * sizeof(nvmfeeindex_t))
+#endif /* NVM_FEE_USE_INDEX */
+
+#if NVM_FEE_USE_KV || defined(__DOXYGEN__)
+/**
+ * @brief   Returns the number of keys the key/value hash table can hold.
+ * @pre     The driver must have been started.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ *
+ * @return                  Number of keys.
+ *
+ * @api
+ */
+#define nvmfeeGetKvKeysMax(nvmfeep)                                           \
+    ((nvmfeep)->kv_num * 3 / 4)
+#endif /* NVM_FEE_USE_KV */
+
 /** @} */
 
 /*===========================================================================*/
@@ -173,6 +589,7 @@ extern "C" {
             uint32_t n);
     bool nvmfeeMassErase(NVMFeeDriver* nvmfeep);
     bool nvmfeeSync(NVMFeeDriver* nvmfeep);
+    bool nvmfeePoll(NVMFeeDriver* nvmfeep);
     bool nvmfeeGetInfo(NVMFeeDriver* nvmfeep,
             NVMDeviceInfo* nvmdip);
     void nvmfeeAcquireBus(NVMFeeDriver* nvmfeep);
@@ -183,6 +600,18 @@ extern "C" {
     bool nvmfeeWriteUnprotect(NVMFeeDriver* nvmfeep,
             uint32_t startaddr, uint32_t n);
     bool nvmfeeMassWriteUnprotect(NVMFeeDriver* nvmfeep);
+#if NVM_FEE_USE_GC_THREAD || defined(__DOXYGEN__)
+    bool nvmfeeGetGCInfo(NVMFeeDriver* nvmfeep, NVMFeeGCInfo* infop);
+#endif /* NVM_FEE_USE_GC_THREAD */
+#if NVM_FEE_USE_KV || defined(__DOXYGEN__)
+    bool nvmfeeKvGet(NVMFeeDriver* nvmfeep, nvmfeekey_t key,
+            uint8_t* buffer, uint32_t size, uint32_t* lengthp);
+    bool nvmfeeKvPut(NVMFeeDriver* nvmfeep, nvmfeekey_t key,
+            const uint8_t* buffer, uint32_t length);
+    bool nvmfeeKvDelete(NVMFeeDriver* nvmfeep, nvmfeekey_t key);
+    bool nvmfeeKvNext(NVMFeeDriver* nvmfeep, uint32_t* cursorp,
+            nvmfeekey_t* keyp, uint32_t* lengthp);
+#endif /* NVM_FEE_USE_KV */
 #ifdef __cplusplus
 }
 #endif
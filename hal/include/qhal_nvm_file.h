@@ -50,12 +50,50 @@
 #if !defined(NVM_FILE_USE_MUTUAL_EXCLUSION) || defined(__DOXYGEN__)
 #define NVM_FILE_USE_MUTUAL_EXCLUSION       TRUE
 #endif
+
+/**
+ * @brief   Sets the size of the blocks written to erase or grow the file.
+ * @note    The block is allocated statically and shared by all instances.
+ */
+#if !defined(NVM_FILE_ERASE_BLOCK_SIZE) || defined(__DOXYGEN__)
+#define NVM_FILE_ERASE_BLOCK_SIZE           512
+#endif
+
+/**
+ * @brief   Enables the POSIX @p mmap() backend.
+ * @details Files started with @p NVMFileConfig::use_mmap set are mapped
+ *          into memory, reads, writes and erases become memory copies.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_FILE_USE_MMAP) || defined(__DOXYGEN__)
+#define NVM_FILE_USE_MMAP                   FALSE
+#endif
+
+/**
+ * @brief   Enables the flash timing and wear model.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_FILE_USE_MODEL) || defined(__DOXYGEN__)
+#define NVM_FILE_USE_MODEL                  FALSE
+#endif
+
+/**
+ * @brief   Enables the @p nvmfileSnapshot() and @p nvmfileRestore() APIs.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_FILE_USE_SNAPSHOT) || defined(__DOXYGEN__)
+#define NVM_FILE_USE_SNAPSHOT               FALSE
+#endif
 /** @} */
 
 /*===========================================================================*/
 /* Derived constants and error checks.                                       */
 /*===========================================================================*/
 
+#if NVM_FILE_USE_MMAP && HAS_FATFS
+#error "NVM_FILE_USE_MMAP is not supported with FatFS."
+#endif
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
@@ -77,6 +115,28 @@ typedef struct
      * @brief Total number of sectors.
      */
     uint32_t sector_num;
+#if NVM_FILE_USE_MMAP || defined(__DOXYGEN__)
+    /**
+     * @brief Map the file into memory instead of using stdio.
+     */
+    bool use_mmap;
+#endif /* NVM_FILE_USE_MMAP */
+#if NVM_FILE_USE_MODEL || defined(__DOXYGEN__)
+    /**
+     * @brief Optional timing and wear model or NULL.
+     */
+    const NVMModelConfig* model;
+#endif /* NVM_FILE_USE_MODEL */
+#if NVM_FILE_USE_SNAPSHOT || defined(__DOXYGEN__)
+    /**
+     * @brief Optional snapshot buffer of the file size or NULL.
+     */
+    uint8_t* snapshot;
+    /**
+     * @brief Dirty sector bitmap, one bit per sector.
+     */
+    uint32_t* snapshot_dirty;
+#endif /* NVM_FILE_USE_SNAPSHOT */
 } NVMFileConfig;
 
 /**
@@ -119,6 +179,24 @@ typedef struct
 #else /* HAS_FATFS */
     FILE* file;
 #endif /* HAS_FATFS */
+#if NVM_FILE_USE_MMAP || defined(__DOXYGEN__)
+    /**
+     * @brief Mapped file or @p NULL if stdio is being used.
+     */
+    uint8_t* map;
+#endif /* NVM_FILE_USE_MMAP */
+#if NVM_FILE_USE_MODEL || defined(__DOXYGEN__)
+    /**
+     * @brief Timing and wear model.
+     */
+    NVMModel model;
+#endif /* NVM_FILE_USE_MODEL */
+#if NVM_FILE_USE_SNAPSHOT || defined(__DOXYGEN__)
+    /**
+     * @brief Snapshot buffer holds a snapshot.
+     */
+    bool snapshot_valid;
+#endif /* NVM_FILE_USE_SNAPSHOT */
 #if NVM_FILE_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
     /**
      * @brief mutex_t protecting the device.
@@ -131,6 +209,25 @@ typedef struct
 /* Driver macros.                                                            */
 /*===========================================================================*/
 
+/**
+ * @name    Macro Functions (NVMFileDriver)
+ * @{
+ */
+
+#if NVM_FILE_USE_SNAPSHOT || defined(__DOXYGEN__)
+/**
+ * @brief   Returns the number of 32 bit words of the dirty sector bitmap.
+ *
+ * @param[in] sector_num    number of sectors of the device
+ *
+ * @return                  Number of words.
+ *
+ * @api
+ */
+#define NVM_FILE_SNAPSHOT_DIRTY_WORDS(sector_num)                             \
+    (((sector_num) + 31) / 32)
+#endif /* NVM_FILE_USE_SNAPSHOT */
+
 /** @} */
 
 /*===========================================================================*/
@@ -161,6 +258,14 @@ extern "C" {
     bool nvmfileWriteUnprotect(NVMFileDriver* nvmfilep,
             uint32_t startaddr, uint32_t n);
     bool nvmfileMassWriteUnprotect(NVMFileDriver* nvmfilep);
+    bool nvmfilePoll(NVMFileDriver* nvmfilep);
+#if NVM_FILE_USE_MODEL || defined(__DOXYGEN__)
+    bool nvmfileGetModelInfo(NVMFileDriver* nvmfilep, NVMModelInfo* infop);
+#endif /* NVM_FILE_USE_MODEL */
+#if NVM_FILE_USE_SNAPSHOT || defined(__DOXYGEN__)
+    bool nvmfileSnapshot(NVMFileDriver* nvmfilep);
+    bool nvmfileRestore(NVMFileDriver* nvmfilep);
+#endif /* NVM_FILE_USE_SNAPSHOT */
 #ifdef __cplusplus
 }
 #endif
@@ -45,6 +45,23 @@
 #if !defined(NVM_MEMORY_USE_MUTUAL_EXCLUSION) || defined(__DOXYGEN__)
 #define NVM_MEMORY_USE_MUTUAL_EXCLUSION       TRUE
 #endif
+
+/**
+ * @brief   Enables the flash timing and wear model.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_MEMORY_USE_MODEL) || defined(__DOXYGEN__)
+#define NVM_MEMORY_USE_MODEL                  FALSE
+#endif
+
+/**
+ * @brief   Enables the @p nvmmemorySnapshot() and @p nvmmemoryRestore()
+ *          APIs.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_MEMORY_USE_SNAPSHOT) || defined(__DOXYGEN__)
+#define NVM_MEMORY_USE_SNAPSHOT               FALSE
+#endif
 /** @} */
 
 /*===========================================================================*/
@@ -72,6 +89,22 @@ typedef struct
      * @brief Total number of sectors.
      */
     uint32_t sector_num;
+#if NVM_MEMORY_USE_MODEL || defined(__DOXYGEN__)
+    /**
+     * @brief Optional timing and wear model or NULL.
+     */
+    const NVMModelConfig* model;
+#endif /* NVM_MEMORY_USE_MODEL */
+#if NVM_MEMORY_USE_SNAPSHOT || defined(__DOXYGEN__)
+    /**
+     * @brief Optional snapshot buffer of the device size or NULL.
+     */
+    uint8_t* snapshot;
+    /**
+     * @brief Dirty sector bitmap, one bit per sector.
+     */
+    uint32_t* snapshot_dirty;
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
 } NVMMemoryConfig;
 
 /**
@@ -106,6 +139,18 @@ typedef struct
     * @brief Current configuration data.
     */
     const NVMMemoryConfig* config;
+#if NVM_MEMORY_USE_MODEL || defined(__DOXYGEN__)
+    /**
+     * @brief Timing and wear model.
+     */
+    NVMModel model;
+#endif /* NVM_MEMORY_USE_MODEL */
+#if NVM_MEMORY_USE_SNAPSHOT || defined(__DOXYGEN__)
+    /**
+     * @brief Snapshot buffer holds a snapshot.
+     */
+    bool snapshot_valid;
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
 #if NVM_MEMORY_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
     /**
      * @brief mutex_t protecting the device.
@@ -118,6 +163,25 @@ typedef struct
 /* Driver macros.                                                            */
 /*===========================================================================*/
 
+/**
+ * @name    Macro Functions (NVMMemoryDriver)
+ * @{
+ */
+
+#if NVM_MEMORY_USE_SNAPSHOT || defined(__DOXYGEN__)
+/**
+ * @brief   Returns the number of 32 bit words of the dirty sector bitmap.
+ *
+ * @param[in] sector_num    number of sectors of the device
+ *
+ * @return                  Number of words.
+ *
+ * @api
+ */
+#define NVM_MEMORY_SNAPSHOT_DIRTY_WORDS(sector_num)                           \
+    (((sector_num) + 31) / 32)
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
+
 /** @} */
 
 /*===========================================================================*/
@@ -150,6 +214,15 @@ extern "C" {
     bool nvmmemoryWriteUnprotect(NVMMemoryDriver* nvmmemoryp,
             uint32_t startaddr, uint32_t n);
     bool nvmmemoryMassWriteUnprotect(NVMMemoryDriver* nvmmemoryp);
+    bool nvmmemoryPoll(NVMMemoryDriver* nvmmemoryp);
+#if NVM_MEMORY_USE_MODEL || defined(__DOXYGEN__)
+    bool nvmmemoryGetModelInfo(NVMMemoryDriver* nvmmemoryp,
+            NVMModelInfo* infop);
+#endif /* NVM_MEMORY_USE_MODEL */
+#if NVM_MEMORY_USE_SNAPSHOT || defined(__DOXYGEN__)
+    bool nvmmemorySnapshot(NVMMemoryDriver* nvmmemoryp);
+    bool nvmmemoryRestore(NVMMemoryDriver* nvmmemoryp);
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
 #ifdef __cplusplus
 }
 #endif
@@ -44,16 +44,77 @@
 #if !defined(NVM_MIRROR_USE_MUTUAL_EXCLUSION) || defined(__DOXYGEN__)
 #define NVM_MIRROR_USE_MUTUAL_EXCLUSION     TRUE
 #endif
+
+/**
+ * @brief   Enables the @p nvmmirrorBegin() and @p nvmmirrorCommit() APIs.
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_MIRROR_USE_TRANSACTIONS) || defined(__DOXYGEN__)
+#define NVM_MIRROR_USE_TRANSACTIONS         FALSE
+#endif
+
+/**
+ * @brief   Enables write-behind mirroring.
+ * @details Writes and erases return as soon as mirror a is durable, a
+ *          driver thread replays them on mirror b.
+ * @note    All users have to access the driver through
+ *          @p nvmmirrorAcquireBus() and @p nvmmirrorReleaseBus().
+ * @note    Disabling this option saves both code and data space.
+ */
+#if !defined(NVM_MIRROR_USE_WRITE_BEHIND) || defined(__DOXYGEN__)
+#define NVM_MIRROR_USE_WRITE_BEHIND         FALSE
+#endif
+
+/**
+ * @brief   Write-behind thread stack size.
+ */
+#if !defined(NVM_MIRROR_WB_THREAD_STACK_SIZE) || defined(__DOXYGEN__)
+#define NVM_MIRROR_WB_THREAD_STACK_SIZE     384
+#endif
+
+/**
+ * @brief   Write-behind thread priority.
+ */
+#if !defined(NVM_MIRROR_WB_THREAD_PRIO) || defined(__DOXYGEN__)
+#define NVM_MIRROR_WB_THREAD_PRIO           LOWPRIO
+#endif
 /** @} */
 
 /*===========================================================================*/
 /* Derived constants and error checks.                                       */
 /*===========================================================================*/
 
+#if NVM_MIRROR_USE_WRITE_BEHIND && !NVM_MIRROR_USE_MUTUAL_EXCLUSION
+#error "NVM_MIRROR_USE_WRITE_BEHIND requires NVM_MIRROR_USE_MUTUAL_EXCLUSION."
+#endif
+
+#if NVM_MIRROR_USE_WRITE_BEHIND && !defined(_CHIBIOS_RT_)
+#error "NVM_MIRROR_USE_WRITE_BEHIND requires ChibiOS/RT."
+#endif
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   Operation log entry.
+ */
+typedef struct
+{
+    /**
+    * @brief Start address of the operation within the mirror.
+    */
+    uint32_t startaddr;
+    /**
+    * @brief Number of bytes written or erased.
+    */
+    uint32_t n;
+    /**
+    * @brief Operation is an erase.
+    */
+    bool erase;
+} NVMMirrorLogEntry;
+
 /**
  * @brief   NVM mirror driver configuration structure.
  */
@@ -65,8 +126,32 @@ typedef struct
     BaseNVMDevice* nvmp;
     /*
      * @brief number of sectors to assign to metadata header
+     * @note  Header sectors are used in turn, spreading their wear.
      */
     uint32_t sector_header_num;
+    /**
+    * @brief Buffer used to copy between mirrors, may be NULL.
+    * @note  A page or a sector sized buffer lets copies run as large reads
+    *        and page sized programs.
+    */
+    uint8_t* copy_buffer;
+    /**
+    * @brief Size of the copy buffer, a multiple of 8 bytes.
+    */
+    uint32_t copy_buffer_size;
+#if NVM_MIRROR_USE_TRANSACTIONS || defined(__DOXYGEN__)
+    /**
+    * @brief Transaction log, may be NULL.
+    * @note  Operations of a transaction are being replayed on mirror b on
+    *        commit. Transactions exceeding the log copy all sectors touched
+    *        instead.
+    */
+    NVMMirrorLogEntry* log;
+    /**
+    * @brief Number of entries of the transaction log.
+    */
+    uint32_t log_num;
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
 } NVMMirrorConfig;
 
 /**
@@ -126,6 +211,32 @@ typedef struct
     */
     uint32_t mirror_state_addr;
     /**
+    * @brief Address of the first unused header entry.
+    */
+    uint32_t mirror_free_addr;
+    /**
+    * @brief Header sector holding the current entries.
+    * @note  @p sector_header_num if none does, the next entry then starts
+    *        with the first header sector.
+    */
+    uint32_t header_sector;
+    /**
+    * @brief Sequence number of the current header sector.
+    */
+    uint32_t header_seq;
+    /**
+    * @brief Header sector following the current one has been erased.
+    */
+    bool header_next_erased;
+    /**
+    * @brief First mirror sector touched by the operation in progress.
+    */
+    uint32_t dirty_first;
+    /**
+    * @brief Last mirror sector touched by the operation in progress.
+    */
+    uint32_t dirty_last;
+    /**
     * @brief Mirror size cached for performance.
     */
     uint32_t mirror_size;
@@ -137,6 +248,54 @@ typedef struct
     * @brief Origin address of mirror b cached for performance.
     */
     uint32_t mirror_b_org;
+#if NVM_MIRROR_USE_TRANSACTIONS || defined(__DOXYGEN__)
+    /**
+    * @brief Transaction in progress.
+    */
+    bool txn;
+    /**
+    * @brief Transaction exceeded the log.
+    */
+    bool txn_overflow;
+    /**
+    * @brief Number of used transaction log entries.
+    */
+    uint32_t txn_ops;
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+#if NVM_MIRROR_USE_WRITE_BEHIND || defined(__DOXYGEN__)
+    /**
+    * @brief Single operation pending on mirror b.
+    */
+    NVMMirrorLogEntry wb_op;
+    /**
+    * @brief Operations pending on mirror b, @p NULL to copy the dirty range.
+    */
+    const NVMMirrorLogEntry* wb_ops;
+    /**
+    * @brief Number of operations pending on mirror b.
+    */
+    uint32_t wb_ops_num;
+    /**
+    * @brief Mirror b is pending.
+    */
+    bool wb_pending;
+    /**
+    * @brief Thread run requested.
+    */
+    bool wb_kick;
+    /**
+    * @brief Pointer to the thread.
+    */
+    thread_reference_t wb_thread;
+    /**
+    * @brief Pointer to the thread when it is sleeping or @p NULL.
+    */
+    thread_reference_t wb_wait;
+    /**
+    * @brief Working area for the write-behind thread.
+    */
+    THD_WORKING_AREA(wb_wa, NVM_MIRROR_WB_THREAD_STACK_SIZE);
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
 #if NVM_MIRROR_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
     /**
      * @brief mutex_t protecting the device.
@@ -171,6 +330,7 @@ extern "C" {
             uint32_t n);
     bool nvmmirrorMassErase(NVMMirrorDriver* nvmmirrorp);
     bool nvmmirrorSync(NVMMirrorDriver* nvmmirrorp);
+    bool nvmmirrorPoll(NVMMirrorDriver* nvmmirrorp);
     bool nvmmirrorGetInfo(NVMMirrorDriver* nvmmirrorp,
             NVMDeviceInfo* nvmdip);
     void nvmmirrorAcquireBus(NVMMirrorDriver* nvmmirrorp);
@@ -181,6 +341,14 @@ extern "C" {
     bool nvmmirrorWriteUnprotect(NVMMirrorDriver* nvmmirrorp,
             uint32_t startaddr, uint32_t n);
     bool nvmmirrorMassWriteUnprotect(NVMMirrorDriver* nvmmirrorp);
+    bool nvmmirrorReadV(NVMMirrorDriver* nvmmirrorp, uint32_t startaddr,
+            const NVMIOVector* iov, uint32_t iovcnt);
+    bool nvmmirrorWriteV(NVMMirrorDriver* nvmmirrorp, uint32_t startaddr,
+            const NVMIOConstVector* iov, uint32_t iovcnt);
+#if NVM_MIRROR_USE_TRANSACTIONS || defined(__DOXYGEN__)
+    void nvmmirrorBegin(NVMMirrorDriver* nvmmirrorp);
+    bool nvmmirrorCommit(NVMMirrorDriver* nvmmirrorp);
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
 #ifdef __cplusplus
 }
 #endif
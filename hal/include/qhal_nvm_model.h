@@ -0,0 +1,174 @@
+/*
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    qnvm_model.h
+ * @brief   NVM flash timing and wear model header.
+ *
+ * @addtogroup NVM_MODEL
+ * @details Timing and wear model shared by the emulating nvm drivers.
+ *          Programs and erases keep the device busy for the time the
+ *          configured part would take, @p nvmSync() waits for it either in
+ *          virtual time or by sleeping. Programmed bytes, pages and erases
+ *          are counted per device and erases per sector.
+ * @{
+ */
+
+#ifndef _QNVM_MODEL_H_
+#define _QNVM_MODEL_H_
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Way busy time is being spent.
+ */
+typedef enum
+{
+    NVM_MODEL_VIRTUAL = 0,          /**< Only accounted, no time passes.    */
+    NVM_MODEL_BUSY = 1,             /**< Waiting thread sleeps.             */
+} nvmmodelmode_t;
+
+/**
+ * @brief   NVM model configuration structure.
+ */
+typedef struct
+{
+    /**
+     * @brief Way busy time is being spent.
+     */
+    nvmmodelmode_t mode;
+    /**
+     * @brief Program time per byte in nanoseconds.
+     */
+    uint32_t program_time_ns;
+    /**
+     * @brief Program page size in bytes, 0 if writes are not paged.
+     * @note  Writes are split into page programs at page boundaries.
+     */
+    uint32_t page_size;
+    /**
+     * @brief Time per page program in nanoseconds on top of the time per
+     *        byte.
+     */
+    uint32_t page_time_ns;
+    /**
+     * @brief Erase time per sector in nanoseconds.
+     */
+    uint32_t erase_time_ns;
+    /**
+     * @brief Optional erase counter per sector or NULL.
+     * @note  Counters are not cleared on start, they may be kept across
+     *        restarts of the driver.
+     */
+    uint32_t* erase_counters;
+} NVMModelConfig;
+
+/**
+ * @brief   NVM model info.
+ */
+typedef struct
+{
+    /**
+     * @brief Busy time spent in nanoseconds.
+     */
+    uint64_t time_ns;
+    /**
+     * @brief Number of bytes read.
+     */
+    uint64_t bytes_read;
+    /**
+     * @brief Number of bytes programmed.
+     */
+    uint64_t bytes_programmed;
+    /**
+     * @brief Number of page programs.
+     */
+    uint32_t pages_programmed;
+    /**
+     * @brief Number of sector erases.
+     */
+    uint32_t sectors_erased;
+    /**
+     * @brief Highest erase counter of a single sector.
+     */
+    uint32_t erase_max;
+} NVMModelInfo;
+
+/**
+ * @brief   Structure representing a NVM model.
+ */
+typedef struct
+{
+    /**
+    * @brief Current configuration data.
+    */
+    const NVMModelConfig* config;
+    /**
+    * @brief Sector size and number of the device.
+    */
+    uint32_t sector_size;
+    uint32_t sector_num;
+    /**
+    * @brief Busy time not waited for yet in nanoseconds.
+    */
+    uint64_t pending_ns;
+    /**
+    * @brief System time pending busy time is being accounted from.
+    */
+    systime_t busy_since;
+    /**
+    * @brief Model info.
+    */
+    NVMModelInfo info;
+} NVMModel;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    void nvmmodelStart(NVMModel* modelp, const NVMModelConfig* config,
+            uint32_t sector_size, uint32_t sector_num);
+    void nvmmodelRead(NVMModel* modelp, uint32_t n);
+    void nvmmodelProgram(NVMModel* modelp, uint32_t startaddr, uint32_t n);
+    void nvmmodelErase(NVMModel* modelp, uint32_t startaddr, uint32_t n);
+    void nvmmodelSync(NVMModel* modelp);
+    bool nvmmodelPoll(NVMModel* modelp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QNVM_MODEL_H_ */
+
+/** @} */
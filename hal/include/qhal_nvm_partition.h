@@ -160,6 +160,11 @@ extern "C" {
     bool nvmpartWriteUnprotect(NVMPartitionDriver* nvmpartp,
             uint32_t startaddr, uint32_t n);
     bool nvmpartMassWriteUnprotect(NVMPartitionDriver* nvmpartp);
+    bool nvmpartPoll(NVMPartitionDriver* nvmpartp);
+    bool nvmpartReadV(NVMPartitionDriver* nvmpartp, uint32_t startaddr,
+            const NVMIOVector* iov, uint32_t iovcnt);
+    bool nvmpartWriteV(NVMPartitionDriver* nvmpartp, uint32_t startaddr,
+            const NVMIOConstVector* iov, uint32_t iovcnt);
 #ifdef __cplusplus
 }
 #endif
@@ -232,6 +232,7 @@ extern "C" {
     void flash_lld_erase_sector(FLASHDriver* flashp, uint32_t startaddr);
     void flash_lld_erase_mass(FLASHDriver* flashp);
     void flash_lld_sync(FLASHDriver* flashp);
+    bool flash_lld_is_busy(FLASHDriver* flashp);
     void flash_lld_get_info(FLASHDriver* flashp, NVMDeviceInfo* nvmdip);
     void flash_lld_writeprotect_sector(FLASHDriver* flashp,
             uint32_t startaddr);
@@ -558,6 +558,22 @@ void flash_lld_sync(FLASHDriver* flashp)
     }
 }
 
+/**
+ * @brief   Checks if the FLASH peripheral is busy.
+ *
+ * @param[in] flashp    pointer to the @p FLASHDriver object
+ *
+ * @return              The peripheral state.
+ * @retval false        the peripheral is idle.
+ * @retval true         an operation is in progress.
+ *
+ * @notapi
+ */
+bool flash_lld_is_busy(FLASHDriver* flashp)
+{
+    return (flashp->flash->SR & FLASH_SR_BSY) != 0;
+}
+
 /**
  * @brief   Returns chip information.
  *
@@ -77,6 +77,9 @@ void qhalInit(void)
 #if HAL_USE_NVM_IOBLOCK || defined(__DOXYGEN__)
     nvmioblockInit();
 #endif
+#if HAL_USE_NVM_CACHE || defined(__DOXYGEN__)
+    nvmcacheInit();
+#endif
 #if HAL_USE_FLASH || defined(__DOXYGEN__)
     flashInit();
 #endif
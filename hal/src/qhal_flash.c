@@ -60,6 +60,7 @@ static const struct FLASHDriverVMT flash_vmt =
     .mass_writeprotect = (bool (*)(void*))flashMassWriteProtect,
     .writeunprotect = (bool (*)(void*, uint32_t, uint32_t))flashWriteUnprotect,
     .mass_writeunprotect = (bool (*)(void*))flashMassWriteUnprotect,
+    .poll = (bool (*)(void*))flashPoll,
 };
 
 /*===========================================================================*/
@@ -520,6 +521,38 @@ bool flashMassWriteUnprotect(FLASHDriver* flashp)
     return HAL_SUCCESS;
 }
 
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ *
+ * @param[in] flashp    pointer to the @p FLASHDriver object
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  the operation succeeded.
+ * @retval HAL_FAILED   the operation failed.
+ *
+ * @api
+ */
+bool flashPoll(FLASHDriver* flashp)
+{
+    chDbgCheck(flashp != NULL);
+    /* Verify device status. */
+    chDbgAssert(flashp->state >= NVM_READY, "invalid state");
+
+    if (flashp->state == NVM_READY)
+        return HAL_SUCCESS;
+
+    chSysLock();
+    bool busy = flash_lld_is_busy(flashp);
+    chSysUnlock();
+
+    if (busy)
+        return HAL_SUCCESS;
+
+    flashp->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
 #endif /* HAL_USE_FLASH */
 
 /** @} */
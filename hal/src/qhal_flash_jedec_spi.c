@@ -83,6 +83,9 @@ static const struct FlashJedecSPIDriverVMT flash_jedec_spi_vmt =
     .mass_writeprotect = (bool (*)(void*))fjsMassWriteProtect,
     .writeunprotect = (bool (*)(void*, uint32_t, uint32_t))fjsWriteUnprotect,
     .mass_writeunprotect = (bool (*)(void*))fjsMassWriteUnprotect,
+    .poll = (bool (*)(void*))fjsPoll,
+    .readv = (bool (*)(void*, uint32_t, const NVMIOVector*, uint32_t))fjsReadV,
+    .writev = (bool (*)(void*, uint32_t, const NVMIOConstVector*, uint32_t))fjsWriteV,
 };
 
 /*===========================================================================*/
@@ -208,7 +211,8 @@ static void flash_jedec_spi_sr_write(FlashJedecSPIDriver* fjsp, uint8_t sr)
 }
 
 static void flash_jedec_spi_page_program(FlashJedecSPIDriver* fjsp,
-        uint32_t startaddr, uint32_t n, const uint8_t* buffer)
+        uint32_t startaddr, uint32_t n, const NVMIOConstVector** iovp,
+        uint32_t* offsetp)
 {
     osalDbgCheck(fjsp != NULL);
 
@@ -249,8 +253,26 @@ static void flash_jedec_spi_page_program(FlashJedecSPIDriver* fjsp,
             spiSend(fjsp->config->spip, sizeof(erased), &erased);
     }
 
-    /* data buffer */
-    spiSend(fjsp->config->spip, n, buffer);
+    /* data buffers */
+    while (n > 0)
+    {
+        const NVMIOConstVector* iov = *iovp;
+        uint32_t n_chunk = iov->n - *offsetp;
+        if (n_chunk > n)
+            n_chunk = n;
+
+        if (n_chunk > 0)
+            spiSend(fjsp->config->spip, n_chunk, iov->buffer + *offsetp);
+
+        n -= n_chunk;
+        *offsetp += n_chunk;
+        if (*offsetp == iov->n)
+        {
+            /* Continue with the next buffer. */
+            *iovp = iov + 1;
+            *offsetp = 0;
+        }
+    }
 
     /* post_pad */
     {
@@ -500,54 +522,10 @@ bool fjsRead(FlashJedecSPIDriver* fjsp, uint32_t startaddr, uint32_t n,
         uint8_t* buffer)
 {
     osalDbgCheck(fjsp != NULL);
-    /* Verify device status. */
-    osalDbgAssert(fjsp->state >= NVM_READY, "invalid state");
-    /* Verify range is within chip size. */
-    osalDbgAssert((startaddr + n <= fjsp->config->sector_size * fjsp->config->sector_num),
-            "invalid parameters");
 
-    if (fjsSync(fjsp) != HAL_SUCCESS)
-        return HAL_FAILED;
+    const NVMIOVector iov = { buffer, n };
 
-    /* Read operation in progress. */
-    fjsp->state = NVM_READING;
-
-    flash_jedec_spi_reconfigure(fjsp);
-
-    spiSelect(fjsp->config->spip);
-
-    const uint8_t out[] =
-    {
-        fjsp->config->cmd_read,
-        (startaddr >> 24) & 0xff,
-        (startaddr >> 16) & 0xff,
-        (startaddr >> 8) & 0xff,
-        (startaddr >> 0) & 0xff,
-    };
-
-    /* command byte */
-    spiSend(fjsp->config->spip, 1, &out[0]);
-
-    /* address bytes */
-    spiSend(fjsp->config->spip, fjsp->config->addrbytes_num,
-            &out[NELEMS(out) - fjsp->config->addrbytes_num]);
-
-    if (fjsp->config->cmd_read == FLASH_JEDEC_FAST_READ)
-    {
-        /* Dummy byte required for timing. */
-        static const uint8_t dummy = 0x00;
-        spiSend(fjsp->config->spip, sizeof(dummy), &dummy);
-    }
-
-    /* Receive data. */
-    spiReceive(fjsp->config->spip, n, buffer);
-
-    spiUnselect(fjsp->config->spip);
-
-    /* Read operation finished. */
-    fjsp->state = NVM_READY;
-
-    return HAL_SUCCESS;
+    return fjsReadV(fjsp, startaddr, &iov, 1);
 }
 
 /**
@@ -568,33 +546,10 @@ bool fjsWrite(FlashJedecSPIDriver* fjsp, uint32_t startaddr, uint32_t n,
         const uint8_t* buffer)
 {
     osalDbgCheck(fjsp != NULL);
-    /* Verify device status. */
-    osalDbgAssert(fjsp->state >= NVM_READY, "invalid state");
-    /* Verify range is within chip size. */
-    osalDbgAssert((startaddr + n <= fjsp->config->sector_size * fjsp->config->sector_num),
-            "invalid parameters");
-
-    /* Write operation in progress. */
-    fjsp->state = NVM_WRITING;
-
-    flash_jedec_spi_reconfigure(fjsp);
-
-    uint32_t written = 0;
-
-    while (written < n)
-    {
-        uint32_t n_chunk =
-                fjsp->config->page_size - ((startaddr + written) % fjsp->config->page_size);
-        if (n_chunk > n - written)
-            n_chunk = n - written;
 
-        flash_jedec_spi_page_program(fjsp, startaddr + written,
-                n_chunk, buffer + written);
+    const NVMIOConstVector iov = { buffer, n };
 
-        written += n_chunk;
-    }
-
-    return HAL_SUCCESS;
+    return fjsWriteV(fjsp, startaddr, &iov, 1);
 }
 
 /**
@@ -989,6 +944,162 @@ bool fjsMassWriteUnprotect(FlashJedecSPIDriver* fjsp)
     return HAL_SUCCESS;
 }
 
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ *
+ * @param[in] fjsp      pointer to the @p FlashJedecSPIDriver object
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  the operation succeeded.
+ * @retval HAL_FAILED   the operation failed.
+ *
+ * @api
+ */
+bool fjsPoll(FlashJedecSPIDriver* fjsp)
+{
+    osalDbgCheck(fjsp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(fjsp->state >= NVM_READY, "invalid state");
+
+    if (fjsp->state == NVM_READY)
+        return HAL_SUCCESS;
+
+    flash_jedec_spi_reconfigure(fjsp);
+
+    /* Check write in progress bit once. */
+    if ((flash_jedec_spi_sr_read(fjsp) & 0x01) != 0x00)
+        return HAL_SUCCESS;
+
+    /* No more operation in progress. */
+    fjsp->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Reads a contiguous range into several buffers.
+ *
+ * @param[in] fjsp      pointer to the @p FlashJedecSPIDriver object
+ * @param[in] startaddr address to start reading from
+ * @param[in] iov       array of buffers filled in order
+ * @param[in] iovcnt    number of elements of @p iov
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  the operation succeeded.
+ * @retval HAL_FAILED   the operation failed.
+ *
+ * @api
+ */
+bool fjsReadV(FlashJedecSPIDriver* fjsp, uint32_t startaddr,
+        const NVMIOVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck(fjsp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(fjsp->state >= NVM_READY, "invalid state");
+    /* Verify range is within chip size. */
+    osalDbgAssert((startaddr + nvmiovSize(iov, iovcnt) <= fjsp->config->sector_size * fjsp->config->sector_num),
+            "invalid parameters");
+
+    if (fjsSync(fjsp) != HAL_SUCCESS)
+        return HAL_FAILED;
+
+    /* Read operation in progress. */
+    fjsp->state = NVM_READING;
+
+    flash_jedec_spi_reconfigure(fjsp);
+
+    spiSelect(fjsp->config->spip);
+
+    const uint8_t out[] =
+    {
+        fjsp->config->cmd_read,
+        (startaddr >> 24) & 0xff,
+        (startaddr >> 16) & 0xff,
+        (startaddr >> 8) & 0xff,
+        (startaddr >> 0) & 0xff,
+    };
+
+    /* command byte */
+    spiSend(fjsp->config->spip, 1, &out[0]);
+
+    /* address bytes */
+    spiSend(fjsp->config->spip, fjsp->config->addrbytes_num,
+            &out[NELEMS(out) - fjsp->config->addrbytes_num]);
+
+    if (fjsp->config->cmd_read == FLASH_JEDEC_FAST_READ)
+    {
+        /* Dummy byte required for timing. */
+        static const uint8_t dummy = 0x00;
+        spiSend(fjsp->config->spip, sizeof(dummy), &dummy);
+    }
+
+    /* Receive data. */
+    for (uint32_t i = 0; i < iovcnt; ++i)
+    {
+        if (iov[i].n > 0)
+            spiReceive(fjsp->config->spip, iov[i].n, iov[i].buffer);
+    }
+
+    spiUnselect(fjsp->config->spip);
+
+    /* Read operation finished. */
+    fjsp->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Writes a contiguous range from several buffers.
+ *
+ * @param[in] fjsp      pointer to the @p FlashJedecSPIDriver object
+ * @param[in] startaddr address to start writing to
+ * @param[in] iov       array of buffers written in order
+ * @param[in] iovcnt    number of elements of @p iov
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  the operation succeeded.
+ * @retval HAL_FAILED   the operation failed.
+ *
+ * @api
+ */
+bool fjsWriteV(FlashJedecSPIDriver* fjsp, uint32_t startaddr,
+        const NVMIOConstVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck(fjsp != NULL);
+
+    const uint32_t n = nvmiovConstSize(iov, iovcnt);
+
+    /* Verify device status. */
+    osalDbgAssert(fjsp->state >= NVM_READY, "invalid state");
+    /* Verify range is within chip size. */
+    osalDbgAssert((startaddr + n <= fjsp->config->sector_size * fjsp->config->sector_num),
+            "invalid parameters");
+
+    /* Write operation in progress. */
+    fjsp->state = NVM_WRITING;
+
+    flash_jedec_spi_reconfigure(fjsp);
+
+    uint32_t written = 0;
+    uint32_t offset = 0;
+
+    while (written < n)
+    {
+        uint32_t n_chunk =
+                fjsp->config->page_size - ((startaddr + written) % fjsp->config->page_size);
+        if (n_chunk > n - written)
+            n_chunk = n - written;
+
+        /* Page programs gather data across buffers. */
+        flash_jedec_spi_page_program(fjsp, startaddr + written,
+                n_chunk, &iov, &offset);
+
+        written += n_chunk;
+    }
+
+    return HAL_SUCCESS;
+}
+
 #endif /* HAL_USE_FLASH_JEDEC_SPI */
 
 /** @} */
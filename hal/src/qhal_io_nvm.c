@@ -0,0 +1,157 @@
+/*
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    qio_nvm.c
+ * @brief   I/O non volatile memory devices shared code.
+ *
+ * @addtogroup IO_NVM
+ * @{
+ */
+
+#include "qhal.h"
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns the total number of bytes of a vector.
+ *
+ * @param[in] iov       array of buffers
+ * @param[in] iovcnt    number of elements of @p iov
+ *
+ * @return              The number of bytes.
+ *
+ * @api
+ */
+uint32_t nvmiovSize(const NVMIOVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck((iov != NULL) || (iovcnt == 0));
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < iovcnt; ++i)
+        n += iov[i].n;
+
+    return n;
+}
+
+/**
+ * @brief   Returns the total number of bytes of a vector being written.
+ *
+ * @param[in] iov       array of buffers
+ * @param[in] iovcnt    number of elements of @p iov
+ *
+ * @return              The number of bytes.
+ *
+ * @api
+ */
+uint32_t nvmiovConstSize(const NVMIOConstVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck((iov != NULL) || (iovcnt == 0));
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < iovcnt; ++i)
+        n += iov[i].n;
+
+    return n;
+}
+
+/**
+ * @brief   Reads a contiguous range into several buffers one by one.
+ * @note    Fallback of @p nvmReadV() for devices not supporting vectors.
+ *
+ * @param[in] nvmp      pointer to a @p BaseNVMDevice or derived class
+ * @param[in] startaddr first address to read
+ * @param[in] iov       array of buffers filled in order
+ * @param[in] iovcnt    number of elements of @p iov
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  operation succeeded.
+ * @retval HAL_FAILED   operation failed.
+ *
+ * @notapi
+ */
+bool nvmiovRead(BaseNVMDevice* nvmp, uint32_t startaddr,
+        const NVMIOVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck((nvmp != NULL) && ((iov != NULL) || (iovcnt == 0)));
+
+    for (uint32_t i = 0; i < iovcnt; ++i)
+    {
+        if (iov[i].n == 0)
+            continue;
+
+        bool result = nvmRead(nvmp, startaddr, iov[i].n, iov[i].buffer);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        startaddr += iov[i].n;
+    }
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Writes a contiguous range from several buffers one by one.
+ * @note    Fallback of @p nvmWriteV() for devices not supporting vectors.
+ *
+ * @param[in] nvmp      pointer to a @p BaseNVMDevice or derived class
+ * @param[in] startaddr first address to write
+ * @param[in] iov       array of buffers written in order
+ * @param[in] iovcnt    number of elements of @p iov
+ *
+ * @return              The operation status.
+ * @retval HAL_SUCCESS  operation succeeded.
+ * @retval HAL_FAILED   operation failed.
+ *
+ * @notapi
+ */
+bool nvmiovWrite(BaseNVMDevice* nvmp, uint32_t startaddr,
+        const NVMIOConstVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck((nvmp != NULL) && ((iov != NULL) || (iovcnt == 0)));
+
+    for (uint32_t i = 0; i < iovcnt; ++i)
+    {
+        if (iov[i].n == 0)
+            continue;
+
+        bool result = nvmWrite(nvmp, startaddr, iov[i].n, iov[i].buffer);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        startaddr += iov[i].n;
+    }
+
+    return HAL_SUCCESS;
+}
+
+/** @} */
@@ -0,0 +1,922 @@
+/*
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    qnvm_cache.c
+ * @brief   NVM write-back cache driver code.
+ *
+ * @addtogroup NVM_CACHE
+ * @{
+ */
+
+#include "qhal.h"
+
+#if HAL_USE_NVM_CACHE || defined(__DOXYGEN__)
+
+#include <string.h>
+
+/*
+ * @brief   Functional description
+ *          The underlying device is divided into lines of equal size, a
+ *          line never crosses a sector boundary. A configurable number of
+ *          lines is being cached, the least recently used line is being
+ *          replaced on a miss.
+ *          Read:
+ *              Cached lines are served from the cache. Missing lines are
+ *              being loaded, unless they are read as a whole. Runs of
+ *              whole lines missing are read from the device at once.
+ *          Write:
+ *              Writes are being merged into the cached line, a line
+ *              missing is being allocated without reading it. Written
+ *              bytes are ANDed with the bytes known, as flash programs
+ *              them. Only a single line keeps a dirty range, a write to
+ *              another line or not adjacent to the range flushes it
+ *              first, so a write overlapping dirty bytes reaches the
+ *              device after them. Adjacent writes are merged into a
+ *              single program and lose their relative order, drivers
+ *              layered on top have to sync between writes whose order
+ *              matters on power loss. Whole lines missing are written
+ *              through.
+ *          Erase:
+ *              Lines within the erased sectors are being dropped. Dirty
+ *              ranges within the erased range are discarded, lines only
+ *              partially within are flushed first.
+ *          Sync:
+ *              The dirty range is flushed, then the underlying device is
+ *              synced.
+ */
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Virtual methods table.
+ */
+static const struct NVMCacheDriverVMT nvm_cache_vmt =
+{
+    (size_t)0,
+    .read = (bool (*)(void*, uint32_t, uint32_t, uint8_t*))nvmcacheRead,
+    .write = (bool (*)(void*, uint32_t, uint32_t, const uint8_t*))nvmcacheWrite,
+    .erase = (bool (*)(void*, uint32_t, uint32_t))nvmcacheErase,
+    .mass_erase = (bool (*)(void*))nvmcacheMassErase,
+    .sync = (bool (*)(void*))nvmcacheSync,
+    .get_info = (bool (*)(void*, NVMDeviceInfo*))nvmcacheGetInfo,
+    /* End of mandatory functions. */
+    .acquire = (void (*)(void*))nvmcacheAcquireBus,
+    .release = (void (*)(void*))nvmcacheReleaseBus,
+    .writeprotect = (bool (*)(void*, uint32_t, uint32_t))nvmcacheWriteProtect,
+    .mass_writeprotect = (bool (*)(void*))nvmcacheMassWriteProtect,
+    .writeunprotect = (bool (*)(void*, uint32_t, uint32_t))nvmcacheWriteUnprotect,
+    .mass_writeunprotect = (bool (*)(void*))nvmcacheMassWriteUnprotect,
+    .poll = (bool (*)(void*))nvmcachePoll,
+};
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static uint8_t* nvm_cache_line_data(NVMCacheDriver* nvmcachep,
+        NVMCacheLine* line)
+{
+    osalDbgCheck((nvmcachep != NULL) && (line != NULL));
+
+    return nvmcachep->config->buffer +
+            (line - nvmcachep->config->lines) * nvmcachep->config->line_size;
+}
+
+static NVMCacheLine* nvm_cache_lookup(NVMCacheDriver* nvmcachep,
+        uint32_t addr)
+{
+    osalDbgCheck(nvmcachep != NULL);
+
+    for (uint32_t i = 0; i < nvmcachep->config->line_num; ++i)
+    {
+        NVMCacheLine* line = &nvmcachep->config->lines[i];
+        if (line->addr == addr)
+        {
+            line->stamp = ++nvmcachep->stamp;
+            return line;
+        }
+    }
+
+    return NULL;
+}
+
+static bool nvm_cache_flush_line(NVMCacheDriver* nvmcachep,
+        NVMCacheLine* line)
+{
+    osalDbgCheck((nvmcachep != NULL) && (line != NULL));
+
+    if (line->dirty_end == line->dirty_first)
+        return HAL_SUCCESS;
+
+    bool result = nvmWrite(nvmcachep->config->nvmp,
+            line->addr + line->dirty_first,
+            line->dirty_end - line->dirty_first,
+            nvm_cache_line_data(nvmcachep, line) + line->dirty_first);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    line->dirty_first = 0;
+    line->dirty_end = 0;
+    nvmcachep->info.flushes++;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_cache_fill_line(NVMCacheDriver* nvmcachep,
+        NVMCacheLine* line)
+{
+    osalDbgCheck((nvmcachep != NULL) && (line != NULL));
+
+    if (line->filled)
+        return HAL_SUCCESS;
+
+    uint8_t* data = nvm_cache_line_data(nvmcachep, line);
+
+    /* Read around the dirty range. */
+    if (line->dirty_end == line->dirty_first)
+    {
+        bool result = nvmRead(nvmcachep->config->nvmp, line->addr,
+                nvmcachep->config->line_size, data);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+    else
+    {
+        bool result = nvmRead(nvmcachep->config->nvmp, line->addr,
+                line->dirty_first, data);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        result = nvmRead(nvmcachep->config->nvmp,
+                line->addr + line->dirty_end,
+                nvmcachep->config->line_size - line->dirty_end,
+                data + line->dirty_end);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        /* Dirty bytes are programmed over the ones on the device. */
+        for (uint32_t offset = line->dirty_first;
+                offset < line->dirty_end;)
+        {
+            uint8_t temp[16];
+            const uint32_t chunk = (line->dirty_end - offset < sizeof(temp)) ?
+                    line->dirty_end - offset : sizeof(temp);
+
+            result = nvmRead(nvmcachep->config->nvmp, line->addr + offset,
+                    chunk, temp);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            for (uint32_t i = 0; i < chunk; ++i)
+                data[offset + i] &= temp[i];
+            offset += chunk;
+        }
+    }
+
+    line->filled = true;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_cache_alloc_line(NVMCacheDriver* nvmcachep, uint32_t addr,
+        NVMCacheLine** linep)
+{
+    osalDbgCheck((nvmcachep != NULL) && (linep != NULL));
+
+    /* Take an unused line or the least recently used one. */
+    NVMCacheLine* victim = &nvmcachep->config->lines[0];
+    for (uint32_t i = 0; i < nvmcachep->config->line_num; ++i)
+    {
+        NVMCacheLine* line = &nvmcachep->config->lines[i];
+        if (line->addr == NVM_CACHE_LINE_UNUSED)
+        {
+            victim = line;
+            break;
+        }
+        if ((uint32_t)(nvmcachep->stamp - line->stamp) >
+                (uint32_t)(nvmcachep->stamp - victim->stamp))
+            victim = line;
+    }
+
+    if (victim->addr != NVM_CACHE_LINE_UNUSED)
+    {
+        bool result = nvm_cache_flush_line(nvmcachep, victim);
+        if (result != HAL_SUCCESS)
+            return result;
+        nvmcachep->info.evictions++;
+    }
+
+    victim->addr = addr;
+    victim->stamp = ++nvmcachep->stamp;
+    victim->dirty_first = 0;
+    victim->dirty_end = 0;
+    victim->filled = false;
+
+    *linep = victim;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_cache_flush_other(NVMCacheDriver* nvmcachep,
+        NVMCacheLine* keep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+
+    /* At most a single line is dirty. */
+    for (uint32_t i = 0; i < nvmcachep->config->line_num; ++i)
+    {
+        NVMCacheLine* line = &nvmcachep->config->lines[i];
+        if (line == keep)
+            continue;
+
+        bool result = nvm_cache_flush_line(nvmcachep, line);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_cache_flush_all(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+
+    return nvm_cache_flush_other(nvmcachep, NULL);
+}
+
+static bool nvm_cache_drop(NVMCacheDriver* nvmcachep, uint32_t startaddr,
+        uint32_t n)
+{
+    osalDbgCheck(nvmcachep != NULL);
+
+    const uint32_t line_size = nvmcachep->config->line_size;
+    const uint32_t sector_size = nvmcachep->llnvmdi.sector_size;
+    const uint32_t end = startaddr + n;
+    const uint32_t sector_first = startaddr - startaddr % sector_size;
+    const uint32_t sector_end = end + (sector_size - end % sector_size) %
+            sector_size;
+
+    /* Lines never cross sectors, drop all within the erased sectors. */
+    for (uint32_t i = 0; i < nvmcachep->config->line_num; ++i)
+    {
+        NVMCacheLine* line = &nvmcachep->config->lines[i];
+        if (line->addr == NVM_CACHE_LINE_UNUSED ||
+                line->addr < sector_first || line->addr >= sector_end)
+            continue;
+
+        /* Keep data outside of the range. */
+        if (line->addr < startaddr || line->addr + line_size > end)
+        {
+            bool result = nvm_cache_flush_line(nvmcachep, line);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+
+        line->addr = NVM_CACHE_LINE_UNUSED;
+        line->dirty_first = 0;
+        line->dirty_end = 0;
+    }
+
+    return HAL_SUCCESS;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   NVM cache driver initialization.
+ * @note    This function is implicitly invoked by @p halInit(), there is
+ *          no need to explicitly initialize the driver.
+ *
+ * @init
+ */
+void nvmcacheInit(void)
+{
+}
+
+/**
+ * @brief   Initializes an instance.
+ *
+ * @param[out] nvmcachep    pointer to the @p NVMCacheDriver object
+ *
+ * @init
+ */
+void nvmcacheObjectInit(NVMCacheDriver* nvmcachep)
+{
+    nvmcachep->vmt = &nvm_cache_vmt;
+    nvmcachep->state = NVM_STOP;
+    nvmcachep->config = NULL;
+#if NVM_CACHE_USE_MUTUAL_EXCLUSION
+    osalMutexObjectInit(&nvmcachep->mutex);
+#endif /* NVM_CACHE_USE_MUTUAL_EXCLUSION */
+}
+
+/**
+ * @brief   Configures and activates the NVM cache.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ * @param[in] config        pointer to the @p NVMCacheConfig object.
+ *
+ * @api
+ */
+void nvmcacheStart(NVMCacheDriver* nvmcachep, const NVMCacheConfig* config)
+{
+    osalDbgCheck((nvmcachep != NULL) && (config != NULL));
+    /* Verify device status. */
+    osalDbgAssert((nvmcachep->state == NVM_STOP) || (nvmcachep->state == NVM_READY),
+            "invalid state");
+    osalDbgCheck((config->line_num > 0) && (config->line_size > 0) &&
+            (config->buffer != NULL) && (config->lines != NULL));
+
+    nvmcachep->config = config;
+
+    /* Calculate and cache often reused values. */
+    nvmGetInfo(nvmcachep->config->nvmp, &nvmcachep->llnvmdi);
+    /* Verify lines do not cross sectors. */
+    osalDbgAssert(nvmcachep->llnvmdi.sector_size % config->line_size == 0,
+            "invalid line size");
+
+    for (uint32_t i = 0; i < config->line_num; ++i)
+    {
+        config->lines[i].addr = NVM_CACHE_LINE_UNUSED;
+        config->lines[i].dirty_first = 0;
+        config->lines[i].dirty_end = 0;
+    }
+    nvmcachep->stamp = 0;
+    memset(&nvmcachep->info, 0, sizeof(nvmcachep->info));
+
+    nvmcachep->state = NVM_READY;
+}
+
+/**
+ * @brief   Disables the NVM cache.
+ * @pre     Dirty lines have to be flushed by @p nvmcacheSync() before.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ *
+ * @api
+ */
+void nvmcacheStop(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert((nvmcachep->state == NVM_STOP) || (nvmcachep->state == NVM_READY),
+            "invalid state");
+
+    nvmcachep->state = NVM_STOP;
+}
+
+/**
+ * @brief   Reads data crossing sector boundaries if required.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ * @param[in] startaddr     address to start reading from
+ * @param[in] n             number of bytes to read
+ * @param[in] buffer        pointer to data buffer
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheRead(NVMCacheDriver* nvmcachep, uint32_t startaddr,
+        uint32_t n, uint8_t* buffer)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+    /* Verify range is within device size. */
+    osalDbgAssert((startaddr + n <= nvmcachep->llnvmdi.sector_size *
+            nvmcachep->llnvmdi.sector_num), "invalid parameters");
+
+    const uint32_t line_size = nvmcachep->config->line_size;
+
+    /* Note: Pending writes keep the state, reads do not change it. */
+
+    /* Run of whole lines missing, being read at once. */
+    uint32_t direct_addr = startaddr;
+    uint32_t direct_n = 0;
+
+    while (n > 0)
+    {
+        const uint32_t offset = startaddr % line_size;
+        const uint32_t chunk = (n < line_size - offset) ?
+                n : line_size - offset;
+
+        NVMCacheLine* line = nvm_cache_lookup(nvmcachep, startaddr - offset);
+        if (line == NULL && chunk == line_size)
+        {
+            nvmcachep->info.read_misses++;
+            if (direct_n == 0)
+                direct_addr = startaddr;
+            direct_n += chunk;
+        }
+        else
+        {
+            if (direct_n > 0)
+            {
+                bool result = nvmRead(nvmcachep->config->nvmp, direct_addr,
+                        direct_n, buffer - direct_n);
+                if (result != HAL_SUCCESS)
+                    return result;
+                direct_n = 0;
+            }
+
+            if (line == NULL)
+            {
+                nvmcachep->info.read_misses++;
+                bool result = nvm_cache_alloc_line(nvmcachep,
+                        startaddr - offset, &line);
+                if (result != HAL_SUCCESS)
+                    return result;
+            }
+            else
+            {
+                nvmcachep->info.read_hits++;
+            }
+
+            /* Dirty bytes are only known once combined with the device
+             * content, read the rest of the line. */
+            bool result = nvm_cache_fill_line(nvmcachep, line);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            memcpy(buffer, nvm_cache_line_data(nvmcachep, line) + offset,
+                    chunk);
+        }
+
+        startaddr += chunk;
+        buffer += chunk;
+        n -= chunk;
+    }
+
+    if (direct_n > 0)
+        return nvmRead(nvmcachep->config->nvmp, direct_addr, direct_n,
+                buffer - direct_n);
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Writes data crossing sector boundaries if required.
+ * @note    Adjacent writes may reach the device as a single program. Call
+ *          @p nvmcacheSync() between writes whose order has to survive a
+ *          power loss.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ * @param[in] startaddr     address to start writing to
+ * @param[in] n             number of bytes to write
+ * @param[in] buffer        pointer to data buffer
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheWrite(NVMCacheDriver* nvmcachep, uint32_t startaddr,
+        uint32_t n, const uint8_t* buffer)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+    /* Verify range is within device size. */
+    osalDbgAssert((startaddr + n <= nvmcachep->llnvmdi.sector_size *
+            nvmcachep->llnvmdi.sector_num), "invalid parameters");
+
+    const uint32_t line_size = nvmcachep->config->line_size;
+
+    /* Write operation in progress. */
+    nvmcachep->state = NVM_WRITING;
+
+    while (n > 0)
+    {
+        const uint32_t offset = startaddr % line_size;
+        const uint32_t chunk = (n < line_size - offset) ?
+                n : line_size - offset;
+
+        NVMCacheLine* line = nvm_cache_lookup(nvmcachep, startaddr - offset);
+        if (line == NULL && chunk == line_size)
+        {
+            /* Whole lines are a page aligned program already. Earlier
+             * writes go first. */
+            nvmcachep->info.write_misses++;
+            bool result = nvm_cache_flush_all(nvmcachep);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            result = nvmWrite(nvmcachep->config->nvmp, startaddr,
+                    chunk, buffer);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+        else
+        {
+            if (line == NULL)
+            {
+                nvmcachep->info.write_misses++;
+                bool result = nvm_cache_alloc_line(nvmcachep,
+                        startaddr - offset, &line);
+                if (result != HAL_SUCCESS)
+                    return result;
+            }
+            else
+            {
+                nvmcachep->info.write_hits++;
+            }
+
+            /* Earlier writes to other lines go first. */
+            bool result = nvm_cache_flush_other(nvmcachep, line);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            /* A single dirty range, only adjacent writes are merged. A
+             * write overlapping dirty bytes goes after them. */
+            if (line->dirty_end != line->dirty_first &&
+                    offset != line->dirty_end &&
+                    offset + chunk != line->dirty_first)
+            {
+                result = nvm_cache_flush_line(nvmcachep, line);
+                if (result != HAL_SUCCESS)
+                    return result;
+            }
+
+            /* Programming only clears bits of the bytes known. Bytes of
+             * a line not filled are ANDed when it is. */
+            uint8_t* data = nvm_cache_line_data(nvmcachep, line);
+            for (uint32_t i = 0; i < chunk; ++i)
+            {
+                if (line->filled)
+                    data[offset + i] &= buffer[i];
+                else
+                    data[offset + i] = buffer[i];
+            }
+
+            if (line->dirty_end == line->dirty_first)
+            {
+                line->dirty_first = offset;
+                line->dirty_end = offset + chunk;
+            }
+            else
+            {
+                if (offset < line->dirty_first)
+                    line->dirty_first = offset;
+                if (offset + chunk > line->dirty_end)
+                    line->dirty_end = offset + chunk;
+            }
+        }
+
+        startaddr += chunk;
+        buffer += chunk;
+        n -= chunk;
+    }
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Erases one or more sectors.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ * @param[in] startaddr     address within to be erased sector
+ * @param[in] n             number of bytes to erase
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheErase(NVMCacheDriver* nvmcachep, uint32_t startaddr,
+        uint32_t n)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+    /* Verify range is within device size. */
+    osalDbgAssert((startaddr + n <= nvmcachep->llnvmdi.sector_size *
+            nvmcachep->llnvmdi.sector_num), "invalid parameters");
+
+    /* Erase operation in progress. */
+    nvmcachep->state = NVM_ERASING;
+
+    bool result = nvm_cache_drop(nvmcachep, startaddr, n);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    return nvmErase(nvmcachep->config->nvmp, startaddr, n);
+}
+
+/**
+ * @brief   Erases all sectors.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheMassErase(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    /* Erase operation in progress. */
+    nvmcachep->state = NVM_ERASING;
+
+    bool result = nvm_cache_drop(nvmcachep, 0,
+            nvmcachep->llnvmdi.sector_size * nvmcachep->llnvmdi.sector_num);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    return nvmMassErase(nvmcachep->config->nvmp);
+}
+
+/**
+ * @brief   Flushes dirty lines and waits for idle condition.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheSync(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    if (nvmcachep->state == NVM_READY)
+        return HAL_SUCCESS;
+
+    bool result = nvm_cache_flush_all(nvmcachep);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    result = nvmSync(nvmcachep->config->nvmp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* No more operation in progress. */
+    nvmcachep->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ * @note    A dirty range is not flushed, the cache stays busy until
+ *          @p nvmcacheSync() is called.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcachePoll(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    if (nvmcachep->state == NVM_READY)
+        return HAL_SUCCESS;
+
+    bool result = nvmPoll(nvmcachep->config->nvmp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Dirty data has not reached the device yet. */
+    for (uint32_t i = 0; i < nvmcachep->config->line_num; ++i)
+    {
+        const NVMCacheLine* line = &nvmcachep->config->lines[i];
+        if (line->dirty_end != line->dirty_first)
+            return HAL_SUCCESS;
+    }
+
+    if (nvmIsTransferring(nvmcachep->config->nvmp))
+        return HAL_SUCCESS;
+
+    /* No more operation in progress. */
+    nvmcachep->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Returns media info.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ * @param[out] nvmdip       pointer to a @p NVMDeviceInfo structure
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheGetInfo(NVMCacheDriver* nvmcachep, NVMDeviceInfo* nvmdip)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    memcpy(nvmdip, &nvmcachep->llnvmdi, sizeof(*nvmdip));
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Gains exclusive access to the nvm cache device.
+ * @details This function tries to gain ownership to the nvm cache device,
+ *          if the device is already being used then the invoking thread
+ *          is queued.
+ * @pre     In order to use this function the option
+ *          @p NVM_CACHE_USE_MUTUAL_EXCLUSION must be enabled.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ *
+ * @api
+ */
+void nvmcacheAcquireBus(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+
+#if NVM_CACHE_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
+    osalMutexLock(&nvmcachep->mutex);
+
+    /* Lock the underlying device as well. */
+    nvmAcquire(nvmcachep->config->nvmp);
+#endif /* NVM_CACHE_USE_MUTUAL_EXCLUSION */
+}
+
+/**
+ * @brief   Releases exclusive access to the nvm cache device.
+ * @pre     In order to use this function the option
+ *          @p NVM_CACHE_USE_MUTUAL_EXCLUSION must be enabled.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ *
+ * @api
+ */
+void nvmcacheReleaseBus(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+
+#if NVM_CACHE_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
+    osalMutexUnlock(&nvmcachep->mutex);
+
+    /* Release the underlying device as well. */
+    nvmRelease(nvmcachep->config->nvmp);
+#endif /* NVM_CACHE_USE_MUTUAL_EXCLUSION */
+}
+
+/**
+ * @brief   Write protects one or more sectors.
+ * @note    Dirty lines are being flushed before.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ * @param[in] startaddr     address within to be protected sector
+ * @param[in] n             number of bytes to protect
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheWriteProtect(NVMCacheDriver* nvmcachep,
+        uint32_t startaddr, uint32_t n)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    bool result = nvm_cache_flush_all(nvmcachep);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    return nvmWriteProtect(nvmcachep->config->nvmp, startaddr, n);
+}
+
+/**
+ * @brief   Write protects the whole device.
+ * @note    Dirty lines are being flushed before.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheMassWriteProtect(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    bool result = nvm_cache_flush_all(nvmcachep);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    return nvmMassWriteProtect(nvmcachep->config->nvmp);
+}
+
+/**
+ * @brief   Write unprotects one or more sectors.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ * @param[in] startaddr     address within to be unprotected sector
+ * @param[in] n             number of bytes to unprotect
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheWriteUnprotect(NVMCacheDriver* nvmcachep,
+        uint32_t startaddr, uint32_t n)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    return nvmWriteUnprotect(nvmcachep->config->nvmp, startaddr, n);
+}
+
+/**
+ * @brief   Write unprotects the whole device.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmcacheMassWriteUnprotect(NVMCacheDriver* nvmcachep)
+{
+    osalDbgCheck(nvmcachep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    return nvmMassWriteUnprotect(nvmcachep->config->nvmp);
+}
+
+/**
+ * @brief   Returns cache info.
+ *
+ * @param[in] nvmcachep     pointer to the @p NVMCacheDriver object
+ * @param[out] infop        pointer to a @p NVMCacheInfo structure
+ *
+ * @api
+ */
+void nvmcacheGetCacheInfo(NVMCacheDriver* nvmcachep, NVMCacheInfo* infop)
+{
+    osalDbgCheck((nvmcachep != NULL) && (infop != NULL));
+    /* Verify device status. */
+    osalDbgAssert(nvmcachep->state >= NVM_READY, "invalid state");
+
+    *infop = nvmcachep->info;
+}
+
+#endif /* HAL_USE_NVM_CACHE */
+
+/** @} */
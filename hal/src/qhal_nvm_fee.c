@@ -37,6 +37,22 @@
  *          necessary. The number of writes is minimized by comparing to be
  *          written data with current content prior to executing writes to the
  *          underlying device.
+ *          An optional RAM index maps every virtual slot address to the newest
+ *          slot holding it so lookups do not need to scan the arena.
+ *          An optional RAM shadow image mirrors the whole virtual address
+ *          room, reads are then served from RAM and garbage collection does
+ *          not need to read the source arena.
+ *          An optional background thread collects garbage of the ring
+ *          layout between a high and a low watermark so writers rarely have
+ *          to wait for it.
+ *          With the CRC formats a slot is committed by a single write, its
+ *          check value replacing the state marks. The extent format further
+ *          stores runs of consecutive slot payloads as a single record.
+ *          Mounting finds the end of the log by binary search, the log is
+ *          only read as a whole to rebuild the RAM index or shadow image.
+ *          Erasing a range takes a single tombstone record.
+ *          Optional key/value records store values by a 16 bit key next to
+ *          the virtual address room, a RAM hash table maps keys to records.
  *
  *          The memory partitioning is:
  *          - arena a
@@ -46,6 +62,12 @@
  *            - arena header
  *            - slots
  *
+ *          With the ring layout every sector is an arena of its own. Slots
+ *          are appended to the newest sector of a ring of sectors, one sector
+ *          is always kept erased. Garbage collection copies the live slots of
+ *          the oldest sector to the newest one and erases the oldest sector.
+ *          Up to all but two sectors worth of slots are usable.
+ *
  * @todo    - add write protection pass-through to lower level driver
  *
  */
@@ -59,6 +81,78 @@ static const uint32_t nvm_fee_magic =
         (((NVM_FEE_WRITE_UNIT_SIZE - 2) & 0xff) << 8) +
         ((NVM_FEE_SLOT_PAYLOAD_SIZE & 0xff) << 0);
 
+static const uint32_t nvm_fee_ring_magic =
+        0x3b9e52a7UL +
+        (((NVM_FEE_WRITE_UNIT_SIZE - 2) & 0xff) << 8) +
+        ((NVM_FEE_SLOT_PAYLOAD_SIZE & 0xff) << 0);
+
+static const uint32_t nvm_fee_crc_magic =
+        0xc52d7e19UL +
+        (((NVM_FEE_WRITE_UNIT_SIZE - 2) & 0xff) << 8) +
+        ((NVM_FEE_SLOT_PAYLOAD_SIZE & 0xff) << 0);
+
+static const uint32_t nvm_fee_ring_crc_magic =
+        0x6a48b0e3UL +
+        (((NVM_FEE_WRITE_UNIT_SIZE - 2) & 0xff) << 8) +
+        ((NVM_FEE_SLOT_PAYLOAD_SIZE & 0xff) << 0);
+
+static const uint32_t nvm_fee_extent_magic =
+        0x1f6c93d5UL +
+        (((NVM_FEE_WRITE_UNIT_SIZE - 2) & 0xff) << 8) +
+        ((NVM_FEE_SLOT_PAYLOAD_SIZE & 0xff) << 0);
+
+static const uint32_t nvm_fee_ring_extent_magic =
+        0xd4a2e06bUL +
+        (((NVM_FEE_WRITE_UNIT_SIZE - 2) & 0xff) << 8) +
+        ((NVM_FEE_SLOT_PAYLOAD_SIZE & 0xff) << 0);
+
+/**
+ * @brief   Address word of extent records.
+ * @details The first slot of an extent holds the number of payloads and the
+ *          address of the first one, the following slots their position
+ *          within the extent and a bit per payload ending in the slot. A
+ *          cleared bit marks a hole left by garbage collection.
+ */
+#define NVM_FEE_ADDRESS_EXTENT      0x80000000UL
+#define NVM_FEE_ADDRESS_CONT        0x40000000UL
+#define NVM_FEE_ADDRESS_ENTRIES_POS 24
+#define NVM_FEE_ADDRESS_MASK        0x00ffffffUL
+#define NVM_FEE_ADDRESS_POS_MASK    0x0000003fUL
+#define NVM_FEE_ADDRESS_HOLES_POS   6
+#define NVM_FEE_ADDRESS_HOLES_MASK  0x3fffffc0UL
+
+/**
+ * @brief   Address words of special records, holding both flags and a kind
+ *          in place of the number of payloads.
+ * @details A tombstone marks the slot payloads starting at its address as
+ *          erased, its payload holds their number. A key/value record holds
+ *          its key and the length of its value instead of an address, a
+ *          deletion just the key.
+ */
+#define NVM_FEE_ADDRESS_SPECIAL     (NVM_FEE_ADDRESS_EXTENT | \
+                                     NVM_FEE_ADDRESS_CONT)
+#define NVM_FEE_ADDRESS_KIND_MASK   0xff000000UL
+#define NVM_FEE_ADDRESS_CHECKPOINT  (NVM_FEE_ADDRESS_SPECIAL | 0x00000000UL)
+#define NVM_FEE_ADDRESS_TOMBSTONE   (NVM_FEE_ADDRESS_SPECIAL | 0x01000000UL)
+#define NVM_FEE_ADDRESS_KV          (NVM_FEE_ADDRESS_SPECIAL | 0x02000000UL)
+#define NVM_FEE_ADDRESS_KV_DELETE   (NVM_FEE_ADDRESS_SPECIAL | 0x03000000UL)
+#define NVM_FEE_ADDRESS_KEY_POS     8
+#define NVM_FEE_ADDRESS_LENGTH_MASK 0x000000ffUL
+
+/**
+ * @brief   Value of a RAM index entry not referring to any slot.
+ */
+#if NVM_FEE_USE_INDEX
+#define NVM_FEE_INDEX_NONE          ((nvmfeeindex_t)-1)
+#else
+#define NVM_FEE_INDEX_NONE          0xffffffffUL
+#endif /* NVM_FEE_USE_INDEX */
+
+/**
+ * @brief   Value of a key/value hash table entry not referring to any slot.
+ */
+#define NVM_FEE_KV_NONE             0xffffffffUL
+
 /*===========================================================================*/
 /* Driver exported variables.                                                */
 /*===========================================================================*/
@@ -86,6 +180,7 @@ static const struct NVMFeeDriverVMT nvm_fee_vmt =
     .mass_writeprotect = (bool (*)(void*))nvmfeeMassWriteProtect,
     .writeunprotect = (bool (*)(void*, uint32_t, uint32_t))nvmfeeWriteUnprotect,
     .mass_writeunprotect = (bool (*)(void*))nvmfeeMassWriteUnprotect,
+    .poll = (bool (*)(void*))nvmfeePoll,
 };
 
 /**
@@ -134,6 +229,15 @@ typedef uint64_t write_unit_t;
 #error "Unsupported state mark size."
 #endif
 
+/**
+ * @brief   Sequence number of a sector within the ring.
+ */
+#if NVM_FEE_WRITE_UNIT_SIZE == 8
+typedef uint64_t sequence_t;
+#else
+typedef uint32_t sequence_t;
+#endif
+
 /**
  * @brief   Header structure at the beginning of each arena.
  */
@@ -145,16 +249,22 @@ struct __attribute__((__packed__)) arena_header
     uint32_t magic2;
 #endif
     write_unit_t state_mark[2];
+    /* Ring layout only. */
+    sequence_t sequence;
     /* Pad to 32 bytes. */
-#if NVM_FEE_WRITE_UNIT_SIZE == 8
-    uint8_t unused[32 - sizeof(uint32_t) - sizeof(uint32_t) - 2 * sizeof(write_unit_t)];
-#else
-    uint8_t unused[32 - sizeof(uint32_t) - 2 * sizeof(write_unit_t)];
+#if NVM_FEE_WRITE_UNIT_SIZE != 8
+    uint8_t unused[32 - sizeof(uint32_t) - 2 * sizeof(write_unit_t) -
+            sizeof(sequence_t)];
 #endif
 };
 
+STATIC_ASSERT(sizeof(struct arena_header) == 32);
+
 /**
  * @brief   Structure defining a single slot.
+ * @note    With the CRC format the state marks hold the check value of
+ *          address and payload instead. Slots read are converted to state
+ *          marks.
  */
 struct __attribute__((__packed__)) slot
 {
@@ -163,9 +273,193 @@ struct __attribute__((__packed__)) slot
     uint8_t payload[NVM_FEE_SLOT_PAYLOAD_SIZE];
 };
 
+/**
+ * @brief   CRC-32 nibble lookup table.
+ */
+static const uint32_t nvm_fee_crc_table[16] =
+{
+    0x00000000UL, 0x1db71064UL, 0x3b6e20c8UL, 0x26d930acUL,
+    0x76dc4190UL, 0x6b6b51f4UL, 0x4db26158UL, 0x5005713cUL,
+    0xedb88320UL, 0xf00f9344UL, 0xd6d6a3e8UL, 0xcb61b38cUL,
+    0x9b64c2b0UL, 0x86d3d2d4UL, 0xa00ae278UL, 0xbdbdf21cUL,
+};
+
+/**
+ * @brief   Payload bytes held by a following slot of an extent, all but its
+ *          address word.
+ */
+#define NVM_FEE_EXTENT_CONT_SIZE    (sizeof(struct slot) - sizeof(uint32_t))
+
+/* Each following slot has hole bits for up to 24 payloads ending in it. */
+STATIC_ASSERT(NVM_FEE_EXTENT_CONT_SIZE <= 24 * NVM_FEE_SLOT_PAYLOAD_SIZE);
+
+/**
+ * @brief   Structure describing a record of the log, either a single slot,
+ *          an extent of several slots, a tombstone or a key/value record.
+ */
+struct record
+{
+    enum slot_state state;
+    uint32_t address;
+    uint32_t entries;
+    uint64_t present;
+    bool erased;
+    bool kv;
+    uint32_t key;
+    uint32_t length;
+    uint32_t slots;
+    struct slot slot;
+};
+
+/**
+ * @brief   Structure holding a record being written.
+ * @details Payloads are added one by one. The first slot is written last as
+ *          its check value covers the whole record.
+ */
+struct record_writer
+{
+    uint32_t arena;
+    uint32_t slot;
+    uint32_t* usedp;
+    uint32_t slots;
+    uint32_t address;
+    uint32_t entries;
+    uint64_t present;
+    bool extents;
+    uint32_t crc;
+    uint32_t fill;
+    struct slot header;
+    struct slot cont;
+};
+
 /*===========================================================================*/
 /* Driver local functions.                                                   */
 /*===========================================================================*/
+static int memtst(const void* block, int c, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        if (((uint8_t*)block)[i] != c)
+            return 1;
+    return 0;
+}
+
+static uint32_t nvm_fee_crc32(uint32_t crc, const void* data, size_t size)
+{
+    crc = ~crc;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc ^= ((const uint8_t*)data)[i];
+        crc = (crc >> 4) ^ nvm_fee_crc_table[crc & 0x0f];
+        crc = (crc >> 4) ^ nvm_fee_crc_table[crc & 0x0f];
+    }
+
+    return ~crc;
+}
+
+static void nvm_fee_check_set(uint8_t* check, uint32_t crc)
+{
+    /* Little endian, truncated to the room of the state marks. */
+    memset(check, 0, sizeof(((struct slot*)0)->state_mark));
+    for (size_t i = 0;
+            i < sizeof(crc) && i < sizeof(((struct slot*)0)->state_mark);
+            ++i)
+        check[i] = (uint8_t)(crc >> (8 * i));
+}
+
+static void nvm_fee_slot_check(const struct slot* slotp,
+        uint8_t check[sizeof(slotp->state_mark)])
+{
+    nvm_fee_check_set(check, nvm_fee_crc32(0, &slotp->address,
+            sizeof(*slotp) - offsetof(struct slot, address)));
+}
+
+static uint32_t nvm_fee_extent_slots(uint32_t entries)
+{
+    /* First payload is held by the first slot. */
+    return 1 + ((entries - 1) * NVM_FEE_SLOT_PAYLOAD_SIZE +
+            NVM_FEE_EXTENT_CONT_SIZE - 1) / NVM_FEE_EXTENT_CONT_SIZE;
+}
+
+static uint32_t nvm_fee_extent_hole_slot(uint32_t entry)
+{
+    /* Slot holding the last byte of a payload. */
+    return 1 + (entry * NVM_FEE_SLOT_PAYLOAD_SIZE - 1) /
+            NVM_FEE_EXTENT_CONT_SIZE;
+}
+
+static uint32_t nvm_fee_extent_hole_bit(uint32_t entry)
+{
+    return 1UL << (NVM_FEE_ADDRESS_HOLES_POS + entry % 24);
+}
+
+static uint32_t nvm_fee_extent_piece(uint32_t offset, uint32_t* posp)
+{
+    /* Payload bytes of a following slot surround its address word. */
+    if (offset < offsetof(struct slot, address))
+    {
+        *posp = offset;
+        return offsetof(struct slot, address) - offset;
+    }
+
+    *posp = offset + sizeof(uint32_t);
+    return NVM_FEE_EXTENT_CONT_SIZE - offset;
+}
+
+/*
+ * @brief   The log is made up of units written one after another: the
+ *          active arena or, with the ring layout, the sectors in use starting
+ *          with the oldest one.
+ */
+static uint32_t nvm_fee_log_units(NVMFeeDriver* nvmfeep)
+{
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+        return nvmfeep->ring_sectors;
+
+    return 1;
+}
+
+static uint32_t nvm_fee_log_arena(NVMFeeDriver* nvmfeep, uint32_t unit)
+{
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+        return (nvmfeep->ring_tail + unit) % nvmfeep->llnvmdi.sector_num;
+
+    return nvmfeep->arena_active;
+}
+
+static uint32_t nvm_fee_log_used(NVMFeeDriver* nvmfeep, uint32_t unit)
+{
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+    {
+        if (unit + 1 == nvmfeep->ring_sectors)
+            return nvmfeep->ring_head_slots;
+
+        return nvmfeep->arena_num_slots;
+    }
+
+    return nvmfeep->arena_slots[nvmfeep->arena_active];
+}
+
+#if NVM_FEE_USE_GC_THREAD
+static uint32_t nvm_fee_log_usage(NVMFeeDriver* nvmfeep)
+{
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+        return (nvmfeep->ring_sectors - 1) * nvmfeep->arena_num_slots +
+                nvmfeep->ring_head_slots;
+
+    return nvmfeep->arena_slots[nvmfeep->arena_active];
+}
+
+static uint32_t nvm_fee_log_capacity(NVMFeeDriver* nvmfeep)
+{
+    /* Ring layout: all sectors but the one kept in reserve. */
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+        return (nvmfeep->llnvmdi.sector_num - 1) * nvmfeep->arena_num_slots;
+
+    return nvmfeep->arena_num_slots;
+}
+#endif /* NVM_FEE_USE_GC_THREAD */
+
 static enum slot_state nvm_fee_mark_2_slot_state(const write_unit_t markp[])
 {
     if (markp[0] == (write_unit_t)0xffffffffffffffffULL &&
@@ -181,20 +475,61 @@ static enum slot_state nvm_fee_mark_2_slot_state(const write_unit_t markp[])
     return SLOT_STATE_UNKNOWN;
 }
 
-static bool nvm_fee_slot_read(NVMFeeDriver* nvmfeep, uint32_t arena,
-        uint32_t slot, struct slot* slotp)
-{
-    osalDbgCheck(nvmfeep != NULL);
+static nvmfeeformat_t nvm_fee_arena_format(NVMFeeDriver* nvmfeep,
+        uint32_t arena);
 
-    const uint32_t addr = arena *
+static uint32_t nvm_fee_slot_offset(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t slot)
+{
+    return arena *
             nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size +
             sizeof(struct arena_header) + slot * sizeof(struct slot);
+}
 
-    bool result = nvmRead(nvmfeep->config->nvmp, addr,
+static bool nvm_fee_slot_read_raw(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t slot, struct slot* slotp)
+{
+    osalDbgCheck(nvmfeep != NULL);
+
+    return nvmRead(nvmfeep->config->nvmp,
+            nvm_fee_slot_offset(nvmfeep, arena, slot),
             sizeof(*slotp), (uint8_t*)slotp);
+}
+
+static void nvm_fee_slot_normalize(NVMFeeDriver* nvmfeep, uint32_t arena,
+        struct slot* slotp)
+{
+    osalDbgCheck(nvmfeep != NULL);
+
+    /* Convert check value to state marks, erased slots are left as is. */
+    if (nvm_fee_arena_format(nvmfeep, arena) != NVM_FEE_FORMAT_MARKS &&
+            memtst(slotp, 0xff, sizeof(*slotp)) != 0)
+    {
+        uint8_t check[sizeof(slotp->state_mark)];
+        nvm_fee_slot_check(slotp, check);
+
+        /* Torn or corrupted slots read as dirty. */
+        const bool valid = memcmp(check, slotp->state_mark,
+                sizeof(check)) == 0;
+
+        slotp->state_mark[0] = (write_unit_t)0x0000000000000000ULL;
+        slotp->state_mark[1] = valid ?
+                (write_unit_t)0x0000000000000000ULL :
+                (write_unit_t)0xffffffffffffffffULL;
+    }
+}
+
+static bool nvm_fee_slot_read(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t slot, struct slot* slotp)
+{
+    osalDbgCheck(nvmfeep != NULL);
+
+    bool result = nvm_fee_slot_read_raw(nvmfeep, arena, slot, slotp);
     if (result != HAL_SUCCESS)
         return result;
 
+    nvm_fee_slot_normalize(nvmfeep, arena, slotp);
+
     return HAL_SUCCESS;
 }
 
@@ -237,6 +572,16 @@ static bool nvm_fee_slot_write(NVMFeeDriver* nvmfeep, uint32_t arena,
 
     bool result;
 
+    /* Write address, payload and check value at once. */
+    if (nvm_fee_arena_format(nvmfeep, arena) != NVM_FEE_FORMAT_MARKS)
+    {
+        struct slot temp_slot = *slotp;
+        nvm_fee_slot_check(slotp, (uint8_t*)temp_slot.state_mark);
+
+        return nvmWrite(nvmfeep->config->nvmp, addr,
+                sizeof(temp_slot), (uint8_t*)&temp_slot);
+    }
+
     /* Set slot to dirty.*/
     result = nvm_fee_slot_state_update(nvmfeep, arena,
             slot, SLOT_STATE_DIRTY);
@@ -259,692 +604,2654 @@ static bool nvm_fee_slot_write(NVMFeeDriver* nvmfeep, uint32_t arena,
     return HAL_SUCCESS;
 }
 
-static bool nvm_fee_slot_lookup(NVMFeeDriver* nvmfeep, uint32_t arena,
-        uint32_t address, uint32_t* slotp, bool* foundp)
+static void nvm_fee_index_clear(NVMFeeDriver* nvmfeep)
 {
     osalDbgCheck((nvmfeep != NULL));
 
-    *foundp = false;
-
-    /* Walk through active slots. */
-    for (uint32_t slot = 0;
-            slot < nvmfeep->arena_slots[nvmfeep->arena_active];
-            ++slot)
-    {
-        struct slot temp_slot;
-        bool result;
+#if NVM_FEE_USE_INDEX
+    for (uint32_t entry = 0; entry < nvmfeep->index_num; ++entry)
+        nvmfeep->config->index[entry] = NVM_FEE_INDEX_NONE;
+#else
+    (void)nvmfeep;
+#endif /* NVM_FEE_USE_INDEX */
+}
 
-        /* Read slot. */
-        result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
-        if (result != HAL_SUCCESS)
-            return result;
+static void nvm_fee_index_update(NVMFeeDriver* nvmfeep, uint32_t address,
+        uint32_t arena, uint32_t slot)
+{
+    osalDbgCheck((nvmfeep != NULL));
 
-        /* Skip if slot is not in valid state. */
-        if (nvm_fee_mark_2_slot_state(temp_slot.state_mark) != SLOT_STATE_VALID)
-            continue;
+#if NVM_FEE_USE_INDEX
+    const uint32_t entry = address / NVM_FEE_SLOT_PAYLOAD_SIZE;
 
-        /* Check if slot's address matches. */
-        if (temp_slot.address == address)
-        {
-            *foundp = true;
-            *slotp = slot;
-        }
-    }
+    /* The ring layout numbers slots across all sectors. */
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+        slot += arena * nvmfeep->arena_num_slots;
 
-    return HAL_SUCCESS;
+    if (entry < nvmfeep->index_num)
+        nvmfeep->config->index[entry] = (nvmfeeindex_t)slot;
+#else
+    (void)nvmfeep;
+    (void)address;
+    (void)arena;
+    (void)slot;
+#endif /* NVM_FEE_USE_INDEX */
 }
 
-static enum slot_state nvm_fee_mark_2_arena_state(const write_unit_t markp[])
+static void nvm_fee_index_update_range(NVMFeeDriver* nvmfeep,
+        uint32_t address, uint32_t entries, uint64_t present, uint32_t arena,
+        uint32_t slot)
 {
-    return (enum arena_state)nvm_fee_mark_2_slot_state(markp);
+    for (uint32_t i = 0; i < entries; ++i)
+        if (present & (1ULL << i))
+            nvm_fee_index_update(nvmfeep, address + i * NVM_FEE_SLOT_PAYLOAD_SIZE,
+                arena, slot);
 }
 
-static enum arena_state nvm_fee_arena_state_get(NVMFeeDriver* nvmfeep,
-        uint32_t arena)
+static void nvm_fee_index_drop_range(NVMFeeDriver* nvmfeep,
+        uint32_t address, uint32_t entries)
 {
     osalDbgCheck((nvmfeep != NULL));
 
-    const uint32_t addr = arena *
-            nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size;
+#if NVM_FEE_USE_INDEX
+    /* Addresses without a slot read as erased. */
+    for (uint32_t entry = address / NVM_FEE_SLOT_PAYLOAD_SIZE;
+            entry < nvmfeep->index_num && entries > 0;
+            ++entry, --entries)
+        nvmfeep->config->index[entry] = NVM_FEE_INDEX_NONE;
+#else
+    (void)nvmfeep;
+    (void)address;
+    (void)entries;
+#endif /* NVM_FEE_USE_INDEX */
+}
 
-    struct arena_header header;
+static bool nvm_fee_record_has(const struct record* recordp, uint32_t i)
+{
+    /* Only extents have holes, they hold less than 64 payloads. */
+    return i >= 64 || (recordp->present & (1ULL << i)) != 0;
+}
 
-    bool result = nvmRead(nvmfeep->config->nvmp, addr,
-            sizeof(header), (uint8_t*)&header);
-    if (result != HAL_SUCCESS)
-        return ARENA_STATE_UNKNOWN;
+static uint32_t nvm_fee_record_clip(const struct record* recordp,
+        uint32_t first_entry, uint32_t entries, uint32_t* endp)
+{
+    /* Payloads of the record within the given entries, a tombstone may
+     * cover many more. */
+    const uint32_t first = recordp->address / NVM_FEE_SLOT_PAYLOAD_SIZE;
 
-    if (header.magic != nvm_fee_magic)
-        return ARENA_STATE_UNKNOWN;
+    uint32_t end = first_entry + entries > first ?
+            first_entry + entries - first : 0;
+    if (end > recordp->entries)
+        end = recordp->entries;
+    *endp = end;
 
-    return nvm_fee_mark_2_arena_state(header.state_mark);
+    return first_entry > first ? first_entry - first : 0;
 }
 
-static bool nvm_fee_arena_state_update(NVMFeeDriver* nvmfeep, uint32_t arena,
-        enum arena_state state)
+static bool nvm_fee_record_verify(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t slot, const struct slot* slotp, uint32_t slots,
+        uint32_t entries, uint64_t* presentp, bool* validp)
 {
     osalDbgCheck((nvmfeep != NULL));
-    osalDbgCheck(state == ARENA_STATE_ACTIVE || state == ARENA_STATE_FROZEN);
 
-    const uint32_t addr = arena *
-            nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size;
+    uint32_t crc = 0;
+    uint32_t entry = 1;
 
-    static const write_unit_t zero_mark;
+    *validp = false;
 
-    bool result = false;
-    if (state == ARENA_STATE_ACTIVE)
-        result = nvmWrite(nvmfeep->config->nvmp,
-                    addr + offsetof(struct arena_header, state_mark[0]),
-                    sizeof(zero_mark), (uint8_t*)&zero_mark);
-    else if (state == ARENA_STATE_FROZEN)
-        result = nvmWrite(nvmfeep->config->nvmp,
-                    addr + offsetof(struct arena_header, state_mark[1]),
-                    sizeof(zero_mark), (uint8_t*)&zero_mark);
+    /* The check value covers the following slots and the first one. */
+    for (uint32_t k = 1; k < slots; ++k)
+    {
+        struct slot temp_slot;
+        bool result = nvm_fee_slot_read_raw(nvmfeep, arena, slot + k,
+                &temp_slot);
+        if (result != HAL_SUCCESS)
+            return result;
 
-    if (result != HAL_SUCCESS)
-        return result;
+        if ((temp_slot.address & ~NVM_FEE_ADDRESS_HOLES_MASK) !=
+                (NVM_FEE_ADDRESS_CONT | k))
+            return HAL_SUCCESS;
+
+        for (; entry < entries &&
+                nvm_fee_extent_hole_slot(entry) == k; ++entry)
+            if ((temp_slot.address & nvm_fee_extent_hole_bit(entry)) == 0)
+                *presentp &= ~(1ULL << entry);
+
+        crc = nvm_fee_crc32(crc, &temp_slot, sizeof(temp_slot));
+    }
+
+    uint8_t check[sizeof(slotp->state_mark)];
+    nvm_fee_check_set(check, nvm_fee_crc32(crc, &slotp->address,
+            sizeof(*slotp) - offsetof(struct slot, address)));
+    *validp = memcmp(check, slotp->state_mark, sizeof(check)) == 0;
 
     return HAL_SUCCESS;
 }
 
-static bool nvm_fee_arena_load(NVMFeeDriver* nvmfeep, uint32_t arena)
+static bool nvm_fee_record_cont_read(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t slot, uint32_t offset, uint32_t n, uint8_t* buffer)
 {
     osalDbgCheck((nvmfeep != NULL));
 
-    nvmfeep->arena_slots[arena] = 0;
-
-    bool result;
-
-    /* Walk through active slots. */
-    for (uint32_t slot = 0;
-            slot < nvmfeep->arena_num_slots;
-            ++slot)
+    /* Bytes following the first payload are packed into the following
+     * slots. */
+    for (uint32_t done = 0; done < n;)
     {
-        struct slot temp_slot;
-
-        /* Read slot. */
-        result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
+        const uint32_t k = 1 + (offset + done) / NVM_FEE_EXTENT_CONT_SIZE;
+        uint32_t pos;
+        uint32_t n_piece = nvm_fee_extent_piece(
+                (offset + done) % NVM_FEE_EXTENT_CONT_SIZE, &pos);
+        if (n_piece > n - done)
+            n_piece = n - done;
+
+        bool result = nvmRead(nvmfeep->config->nvmp,
+                nvm_fee_slot_offset(nvmfeep, arena, slot + k) + pos,
+                n_piece, buffer + done);
         if (result != HAL_SUCCESS)
             return result;
 
-        if (nvm_fee_mark_2_slot_state(temp_slot.state_mark) !=
-                SLOT_STATE_UNUSED)
-        {
-            nvmfeep->arena_slots[arena] = slot + 1;
-        }
+        done += n_piece;
     }
 
     return HAL_SUCCESS;
 }
 
-static bool nvm_fee_arena_erase(NVMFeeDriver* nvmfeep, uint32_t arena)
+#if NVM_FEE_USE_KV
+static uint32_t nvm_fee_kv_slots(uint32_t length)
 {
-    osalDbgCheck((nvmfeep != NULL));
+    /* Values are padded to whole slot payloads. */
+    const uint32_t entries = length > NVM_FEE_SLOT_PAYLOAD_SIZE ?
+            (length + NVM_FEE_SLOT_PAYLOAD_SIZE - 1) /
+                    NVM_FEE_SLOT_PAYLOAD_SIZE :
+            1;
 
-    const uint32_t addr = arena *
-            nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size;
+    return nvm_fee_extent_slots(entries);
+}
 
-    bool result;
+static uint32_t nvm_fee_kv_hash(NVMFeeDriver* nvmfeep, uint32_t key)
+{
+    /* Multiplicative hashing spreads consecutive keys. */
+    return ((uint32_t)(key * 0x9e3779b1UL) >> 16) % nvmfeep->kv_num;
+}
 
-    /* Mass erase underlying nvm device. */
-    result = nvmErase(nvmfeep->config->nvmp, addr,
-            nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size);
-    if (result != HAL_SUCCESS)
-        return result;
+static void nvm_fee_kv_clear(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
 
-    /* Set magic. */
-    const struct arena_header header =
-    {
-        .magic = nvm_fee_magic,
-#if NVM_FEE_WRITE_UNIT_SIZE == 8
-        .magic2 = nvm_fee_magic,
-#endif
-        .state_mark[0] = (write_unit_t)0xffffffffffffffffULL,
-        .state_mark[1] = (write_unit_t)0xffffffffffffffffULL,
-    };
+    for (uint32_t i = 0; i < nvmfeep->kv_num; ++i)
+        nvmfeep->config->kv[i].slot = NVM_FEE_KV_NONE;
+    nvmfeep->kv_count = 0;
+}
 
-    result = nvmWrite(nvmfeep->config->nvmp, addr,
-            sizeof(header), (uint8_t*)&header);
-    if (result != HAL_SUCCESS)
-        return result;
+static nvmfeekv_t* nvm_fee_kv_find(NVMFeeDriver* nvmfeep, uint32_t key)
+{
+    osalDbgCheck((nvmfeep != NULL));
 
-    nvmfeep->arena_slots[arena] = 0;
+    nvmfeekv_t* table = nvmfeep->config->kv;
 
-    return HAL_SUCCESS;
+    /* Linear probing, returns the entry of the key or the free entry ending
+     * its probe sequence. */
+    uint32_t i = nvm_fee_kv_hash(nvmfeep, key);
+    while (table[i].slot != NVM_FEE_KV_NONE && table[i].key != key)
+        i = (i + 1) % nvmfeep->kv_num;
+
+    return &table[i];
 }
 
-static bool nvm_fee_gc(NVMFeeDriver* nvmfeep, uint32_t omit_addr)
+static void nvm_fee_kv_update(NVMFeeDriver* nvmfeep, uint32_t key,
+        uint32_t length, uint32_t arena, uint32_t slot)
 {
     osalDbgCheck((nvmfeep != NULL));
 
-    uint32_t src_arena;
-    uint32_t dst_arena;
+    nvmfeekv_t* kvp = nvm_fee_kv_find(nvmfeep, key);
 
-    if (nvmfeep->arena_active == 0)
+    /* A free entry has to be left to end probing. */
+    if (kvp->slot == NVM_FEE_KV_NONE)
     {
-        src_arena = 0;
-        dst_arena = 1;
+        if (nvmfeep->kv_count + 1 >= nvmfeep->kv_num)
+            return;
+        nvmfeep->kv_count++;
+    }
+
+    /* The ring layout numbers slots across all sectors. */
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+        slot += arena * nvmfeep->arena_num_slots;
+
+    kvp->key = key;
+    kvp->length = length;
+    kvp->slot = slot;
+}
+
+static void nvm_fee_kv_drop(NVMFeeDriver* nvmfeep, nvmfeekv_t* kvp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    nvmfeekv_t* table = nvmfeep->config->kv;
+    const uint32_t num = nvmfeep->kv_num;
+    uint32_t hole = kvp - table;
+
+    /* Move later entries of the probe sequence into the hole unless their
+     * home entry lies between the hole and themselves. */
+    for (uint32_t i = (hole + 1) % num;
+            table[i].slot != NVM_FEE_KV_NONE;
+            i = (i + 1) % num)
+    {
+        const uint32_t home = nvm_fee_kv_hash(nvmfeep, table[i].key);
+
+        if ((i + num - home) % num >= (i + num - hole) % num)
+        {
+            table[hole] = table[i];
+            hole = i;
+        }
+    }
+
+    table[hole].slot = NVM_FEE_KV_NONE;
+    nvmfeep->kv_count--;
+}
+
+static void nvm_fee_kv_locate(NVMFeeDriver* nvmfeep, const nvmfeekv_t* kvp,
+        uint32_t* arenap, uint32_t* slotp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+    {
+        *arenap = kvp->slot / nvmfeep->arena_num_slots;
+        *slotp = kvp->slot % nvmfeep->arena_num_slots;
     }
     else
     {
-        src_arena = 1;
-        dst_arena = 0;
+        *arenap = nvmfeep->arena_active;
+        *slotp = kvp->slot;
+    }
+}
+
+static bool nvm_fee_kv_read(NVMFeeDriver* nvmfeep, const nvmfeekv_t* kvp,
+        uint32_t offset, uint32_t n, uint8_t* buffer)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    uint32_t arena;
+    uint32_t slot;
+    nvm_fee_kv_locate(nvmfeep, kvp, &arena, &slot);
+
+    /* The first bytes are part of the first slot. */
+    if (offset < NVM_FEE_SLOT_PAYLOAD_SIZE)
+    {
+        uint32_t n_first = NVM_FEE_SLOT_PAYLOAD_SIZE - offset;
+        if (n_first > n)
+            n_first = n;
+
+        bool result = nvmRead(nvmfeep->config->nvmp,
+                nvm_fee_slot_offset(nvmfeep, arena, slot) +
+                        offsetof(struct slot, payload) + offset,
+                n_first, buffer);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        offset += n_first;
+        buffer += n_first;
+        n -= n_first;
+    }
+
+    if (n == 0)
+        return HAL_SUCCESS;
+
+    return nvm_fee_record_cont_read(nvmfeep, arena, slot,
+            offset - NVM_FEE_SLOT_PAYLOAD_SIZE, n, buffer);
+}
+#endif /* NVM_FEE_USE_KV */
+
+static bool nvm_fee_record_read(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t slot, struct record* recordp, bool verify)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    struct slot* slotp = &recordp->slot;
+    bool result;
+
+    result = nvm_fee_slot_read_raw(nvmfeep, arena, slot, slotp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    const uint32_t word = slotp->address;
+    const uint32_t flags = word &
+            (NVM_FEE_ADDRESS_EXTENT | NVM_FEE_ADDRESS_CONT);
+
+    recordp->address = word;
+    recordp->entries = 1;
+    recordp->present = 1;
+    recordp->erased = false;
+    recordp->kv = false;
+    recordp->slots = 1;
+
+    /* Tombstone, its payload holds the number of erased payloads. */
+    if ((word & NVM_FEE_ADDRESS_KIND_MASK) == NVM_FEE_ADDRESS_TOMBSTONE)
+    {
+        nvm_fee_slot_normalize(nvmfeep, arena, slotp);
+        recordp->state = nvm_fee_mark_2_slot_state(slotp->state_mark);
+
+        uint32_t entries = 0;
+        for (size_t i = 0;
+                i < sizeof(entries) && i < sizeof(slotp->payload);
+                ++i)
+            entries |= (uint32_t)slotp->payload[i] << (8 * i);
+
+        const uint32_t address = word & NVM_FEE_ADDRESS_MASK;
+        if (entries == 0 || address >= nvmfeep->fee_size ||
+                entries > (nvmfeep->fee_size - address) /
+                        NVM_FEE_SLOT_PAYLOAD_SIZE)
+            recordp->state = SLOT_STATE_DIRTY;
+
+        recordp->address = address;
+        recordp->entries = entries;
+        recordp->present = 0xffffffffffffffffULL;
+        recordp->erased = true;
+
+        return HAL_SUCCESS;
+    }
+
+#if NVM_FEE_USE_KV
+    /* Key/value record, its slots follow the extent layout. */
+    const uint32_t kind = word & NVM_FEE_ADDRESS_KIND_MASK;
+    if ((kind == NVM_FEE_ADDRESS_KV || kind == NVM_FEE_ADDRESS_KV_DELETE) &&
+            nvm_fee_arena_format(nvmfeep, arena) == NVM_FEE_FORMAT_EXTENTS)
+    {
+        const uint32_t length = kind == NVM_FEE_ADDRESS_KV ?
+                word & NVM_FEE_ADDRESS_LENGTH_MASK : 0;
+        const uint32_t slots = nvm_fee_kv_slots(length);
+
+        recordp->state = SLOT_STATE_DIRTY;
+        if (slot + slots > nvmfeep->arena_num_slots)
+            return HAL_SUCCESS;
+
+        /* Always verified, values are read without the record. */
+        uint64_t present;
+        bool valid;
+        result = nvm_fee_record_verify(nvmfeep, arena, slot, slotp, slots, 0,
+                &present, &valid);
+        if (result != HAL_SUCCESS || valid == false)
+            return result;
+
+        recordp->state = SLOT_STATE_VALID;
+        recordp->address = 0;
+        recordp->entries = 0;
+        recordp->present = 0;
+        recordp->erased = kind == NVM_FEE_ADDRESS_KV_DELETE;
+        recordp->kv = true;
+        recordp->key = (word >> NVM_FEE_ADDRESS_KEY_POS) & 0xffff;
+        recordp->length = length;
+        recordp->slots = slots;
+
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_FEE_USE_KV */
+
+    /* Single slot. */
+    if (nvm_fee_arena_format(nvmfeep, arena) != NVM_FEE_FORMAT_EXTENTS ||
+            word == 0xffffffff || flags == 0)
+    {
+        nvm_fee_slot_normalize(nvmfeep, arena, slotp);
+        recordp->state = nvm_fee_mark_2_slot_state(slotp->state_mark);
+
+        /* Checkpoints written by earlier versions are outdated. */
+        if (word == NVM_FEE_ADDRESS_CHECKPOINT)
+            recordp->state = SLOT_STATE_DIRTY;
+
+        return HAL_SUCCESS;
+    }
+
+    /* Parts of extents and torn records are not usable on their own. */
+    recordp->state = SLOT_STATE_DIRTY;
+    if (flags != NVM_FEE_ADDRESS_EXTENT)
+        return HAL_SUCCESS;
+
+    const uint32_t entries = (word >> NVM_FEE_ADDRESS_ENTRIES_POS) & 0x3f;
+    const uint32_t slots = nvm_fee_extent_slots(entries);
+    if (entries < 2 || slot + slots > nvmfeep->arena_num_slots)
+        return HAL_SUCCESS;
+
+    /* Holes are only known to verified records. */
+    uint64_t present = 0xffffffffffffffffULL;
+    if (verify == true)
+    {
+        bool valid;
+        result = nvm_fee_record_verify(nvmfeep, arena, slot, slotp, slots,
+                entries, &present, &valid);
+        if (result != HAL_SUCCESS || valid == false)
+            return result;
+    }
+
+    recordp->state = SLOT_STATE_VALID;
+    recordp->address = word & NVM_FEE_ADDRESS_MASK;
+    recordp->entries = entries;
+    recordp->present = present;
+    recordp->slots = slots;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_record_read_prev(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t* slotp, struct record* recordp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t slot = --*slotp;
+
+    bool result = nvm_fee_record_read(nvmfeep, arena, slot, recordp, true);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    const uint32_t word = recordp->slot.address;
+
+    if (recordp->state != SLOT_STATE_DIRTY ||
+            nvm_fee_arena_format(nvmfeep, arena) != NVM_FEE_FORMAT_EXTENTS ||
+            (word & (NVM_FEE_ADDRESS_EXTENT | NVM_FEE_ADDRESS_CONT)) !=
+                    NVM_FEE_ADDRESS_CONT)
+        return HAL_SUCCESS;
+
+    /* Part of an extent, the whole extent is one record unless its first
+     * slot disagrees. */
+    const uint32_t k = word & NVM_FEE_ADDRESS_POS_MASK;
+    if (k == 0 || k > slot)
+        return HAL_SUCCESS;
+
+    struct record header;
+    result = nvm_fee_record_read(nvmfeep, arena, slot - k, &header, true);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    if (header.state == SLOT_STATE_VALID && header.slots > k)
+    {
+        *recordp = header;
+        *slotp = slot - k;
+    }
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_record_entry_read(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t slot, const struct record* recordp, uint32_t address,
+        uint8_t* payload)
+{
+    osalDbgCheck((nvmfeep != NULL));
+    osalDbgAssert(address >= recordp->address &&
+            address < recordp->address +
+                    recordp->entries * NVM_FEE_SLOT_PAYLOAD_SIZE,
+            "address not in record");
+
+    if (recordp->erased == true)
+    {
+        memset(payload, 0xff, NVM_FEE_SLOT_PAYLOAD_SIZE);
+
+        return HAL_SUCCESS;
+    }
+
+    /* First payload is part of the first slot. */
+    if (address == recordp->address)
+    {
+        memcpy(payload, recordp->slot.payload, NVM_FEE_SLOT_PAYLOAD_SIZE);
+
+        return HAL_SUCCESS;
+    }
+
+    return nvm_fee_record_cont_read(nvmfeep, arena, slot,
+            address - recordp->address - NVM_FEE_SLOT_PAYLOAD_SIZE,
+            NVM_FEE_SLOT_PAYLOAD_SIZE, payload);
+}
+
+static bool nvm_fee_record_register(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t slot, const struct record* recordp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+#if NVM_FEE_USE_KV
+    /* The record supersedes all earlier ones of its key. */
+    if (recordp->kv == true)
+    {
+        if (nvmfeep->kv_num == 0)
+            return HAL_SUCCESS;
+
+        nvmfeekv_t* kvp = nvm_fee_kv_find(nvmfeep, recordp->key);
+        if (recordp->erased == false)
+            nvm_fee_kv_update(nvmfeep, recordp->key, recordp->length, arena,
+                    slot);
+        else if (kvp->slot != NVM_FEE_KV_NONE)
+            nvm_fee_kv_drop(nvmfeep, kvp);
+
+        return HAL_SUCCESS;
     }
+#endif /* NVM_FEE_USE_KV */
+
+    /* The record supersedes all earlier ones of its addresses. */
+    if (recordp->erased == true)
+    {
+        nvm_fee_index_drop_range(nvmfeep, recordp->address, recordp->entries);
+#if NVM_FEE_USE_SHADOW
+        if (nvmfeep->shadow != NULL)
+            memset(nvmfeep->shadow + recordp->address, 0xff,
+                    recordp->entries * NVM_FEE_SLOT_PAYLOAD_SIZE);
+#endif /* NVM_FEE_USE_SHADOW */
+
+        return HAL_SUCCESS;
+    }
+
+    nvm_fee_index_update_range(nvmfeep, recordp->address, recordp->entries,
+            recordp->present, arena, slot);
+#if NVM_FEE_USE_SHADOW
+    if (nvmfeep->shadow != NULL)
+    {
+        for (uint32_t i = 0; i < recordp->entries; ++i)
+        {
+            const uint32_t address = recordp->address +
+                    i * NVM_FEE_SLOT_PAYLOAD_SIZE;
+            if (address >= nvmfeep->fee_size)
+                break;
+            if (nvm_fee_record_has(recordp, i) == false)
+                continue;
+
+            bool result = nvm_fee_record_entry_read(nvmfeep, arena, slot,
+                    recordp, address, nvmfeep->shadow + address);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+    }
+#endif /* NVM_FEE_USE_SHADOW */
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_slot_lookup(NVMFeeDriver* nvmfeep, uint32_t address,
+        uint32_t* arenap, uint32_t* slotp, bool* foundp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    *foundp = false;
+
+#if NVM_FEE_USE_INDEX
+    /* Use RAM index if it covers the address. */
+    const uint32_t entry = address / NVM_FEE_SLOT_PAYLOAD_SIZE;
+
+    if (entry < nvmfeep->index_num)
+    {
+        const uint32_t slot = nvmfeep->config->index[entry];
+
+        if (slot != NVM_FEE_INDEX_NONE)
+        {
+            *foundp = true;
+            if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+            {
+                *arenap = slot / nvmfeep->arena_num_slots;
+                *slotp = slot % nvmfeep->arena_num_slots;
+            }
+            else
+            {
+                *arenap = nvmfeep->arena_active;
+                *slotp = slot;
+            }
+        }
+
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_FEE_USE_INDEX */
+
+    /* Walk through used records. */
+    for (uint32_t unit = 0; unit < nvm_fee_log_units(nvmfeep); ++unit)
+    {
+        const uint32_t arena = nvm_fee_log_arena(nvmfeep, unit);
+        const uint32_t used = nvm_fee_log_used(nvmfeep, unit);
+
+        struct record record;
+        for (uint32_t slot = 0; slot < used; slot += record.slots)
+        {
+            bool result;
+
+            /* Read record. */
+            result = nvm_fee_record_read(nvmfeep, arena, slot, &record, true);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            /* Skip if record is not in valid state. */
+            if (record.state != SLOT_STATE_VALID)
+                continue;
+
+            /* Check if record covers the address. */
+            if (address >= record.address &&
+                    address - record.address <
+                            record.entries * NVM_FEE_SLOT_PAYLOAD_SIZE &&
+                    nvm_fee_record_has(&record, (address - record.address) /
+                            NVM_FEE_SLOT_PAYLOAD_SIZE))
+            {
+                *foundp = true;
+                *arenap = arena;
+                *slotp = slot;
+            }
+        }
+    }
+
+    return HAL_SUCCESS;
+}
+
+static void nvm_fee_writer_begin(NVMFeeDriver* nvmfeep,
+        struct record_writer* writerp, uint32_t arena, uint32_t* usedp,
+        uint32_t address, const uint8_t* payload)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    writerp->arena = arena;
+    writerp->slot = (*usedp)++;
+    writerp->usedp = usedp;
+    writerp->slots = 1;
+    writerp->address = address;
+    writerp->entries = 1;
+    writerp->present = 1;
+    writerp->extents =
+            nvm_fee_arena_format(nvmfeep, arena) == NVM_FEE_FORMAT_EXTENTS;
+    writerp->crc = 0;
+    writerp->fill = 0;
+    writerp->header.address = address;
+    memcpy(writerp->header.payload, payload, NVM_FEE_SLOT_PAYLOAD_SIZE);
+}
+
+static bool nvm_fee_writer_room(NVMFeeDriver* nvmfeep,
+        const struct record_writer* writerp, uint32_t address)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    /* Only the next address fits, within the same arena. */
+    return writerp->entries != 0 &&
+            writerp->extents == true &&
+            writerp->entries < NVM_FEE_EXTENT_ENTRIES &&
+            address == writerp->address +
+                    writerp->entries * NVM_FEE_SLOT_PAYLOAD_SIZE &&
+            writerp->slot + nvm_fee_extent_slots(writerp->entries + 1) <=
+                    nvmfeep->arena_num_slots;
+}
+
+static bool nvm_fee_writer_flush(NVMFeeDriver* nvmfeep,
+        struct record_writer* writerp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t k = writerp->slots - 1;
+
+    writerp->crc = nvm_fee_crc32(writerp->crc, &writerp->cont,
+            sizeof(writerp->cont));
+    writerp->fill = 0;
+
+    return nvmWrite(nvmfeep->config->nvmp,
+            nvm_fee_slot_offset(nvmfeep, writerp->arena, writerp->slot + k),
+            sizeof(writerp->cont), (uint8_t*)&writerp->cont);
+}
+
+static bool nvm_fee_writer_add(NVMFeeDriver* nvmfeep,
+        struct record_writer* writerp, const uint8_t* payload)
+{
+    osalDbgCheck((nvmfeep != NULL));
+    osalDbgAssert(writerp->entries != 0, "no record");
+
+    /* A missing payload leaves a hole, its bytes stay erased. */
+    const uint32_t entry = writerp->entries;
+    if (payload != NULL)
+        writerp->present |= 1ULL << entry;
+
+    for (uint32_t done = 0; done < NVM_FEE_SLOT_PAYLOAD_SIZE;)
+    {
+        /* Take the next slot, it is consumed even if the write fails. */
+        if (writerp->fill == 0)
+        {
+            memset(&writerp->cont, 0xff, sizeof(writerp->cont));
+            writerp->cont.address = NVM_FEE_ADDRESS_HOLES_MASK |
+                    NVM_FEE_ADDRESS_CONT | writerp->slots;
+            writerp->slots++;
+            *writerp->usedp = writerp->slot + writerp->slots;
+        }
+
+        uint32_t pos;
+        uint32_t n = nvm_fee_extent_piece(writerp->fill, &pos);
+        if (n > NVM_FEE_SLOT_PAYLOAD_SIZE - done)
+            n = NVM_FEE_SLOT_PAYLOAD_SIZE - done;
+
+        if (payload != NULL)
+            memcpy((uint8_t*)&writerp->cont + pos, payload + done, n);
+        writerp->fill += n;
+        done += n;
+
+        if (payload == NULL && done == NVM_FEE_SLOT_PAYLOAD_SIZE)
+            writerp->cont.address &= ~nvm_fee_extent_hole_bit(entry);
+
+        if (writerp->fill == NVM_FEE_EXTENT_CONT_SIZE)
+        {
+            bool result = nvm_fee_writer_flush(nvmfeep, writerp);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+    }
+
+    writerp->entries++;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_writer_end(NVMFeeDriver* nvmfeep,
+        struct record_writer* writerp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t entries = writerp->entries;
+
+    bool result;
+
+    writerp->entries = 0;
+
+    /* A single payload is written as a plain slot. */
+    if (entries == 1)
+        return nvm_fee_slot_write(nvmfeep, writerp->arena, writerp->slot,
+                &writerp->header);
+
+    if (writerp->fill != 0)
+    {
+        result = nvm_fee_writer_flush(nvmfeep, writerp);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    /* Commit the extent, special records keep their kind. */
+    if ((writerp->address & NVM_FEE_ADDRESS_SPECIAL) !=
+            NVM_FEE_ADDRESS_SPECIAL)
+        writerp->header.address |= NVM_FEE_ADDRESS_EXTENT |
+                (entries << NVM_FEE_ADDRESS_ENTRIES_POS);
+    nvm_fee_check_set((uint8_t*)writerp->header.state_mark,
+            nvm_fee_crc32(writerp->crc, &writerp->header.address,
+                    sizeof(writerp->header) -
+                            offsetof(struct slot, address)));
+
+    return nvmWrite(nvmfeep->config->nvmp,
+            nvm_fee_slot_offset(nvmfeep, writerp->arena, writerp->slot),
+            sizeof(writerp->header), (uint8_t*)&writerp->header);
+}
+
+static bool nvm_fee_copy_end(NVMFeeDriver* nvmfeep,
+        struct record_writer* writerp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    if (writerp->entries == 0)
+        return HAL_SUCCESS;
+
+    const uint32_t entries = writerp->entries;
+
+    bool result = nvm_fee_writer_end(nvmfeep, writerp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Each address is copied exactly once, so its index entry is not
+     * consulted again for the source. */
+    nvm_fee_index_update_range(nvmfeep, writerp->address, entries,
+            writerp->present, writerp->arena, writerp->slot);
+
+    return HAL_SUCCESS;
+}
+
+static enum slot_state nvm_fee_mark_2_arena_state(const write_unit_t markp[])
+{
+    return (enum arena_state)nvm_fee_mark_2_slot_state(markp);
+}
+
+static uint32_t nvm_fee_magic_get(NVMFeeDriver* nvmfeep,
+        nvmfeeformat_t format)
+{
+    const bool ring = nvmfeep->config->layout == NVM_FEE_LAYOUT_RING;
+
+    switch (format)
+    {
+    case NVM_FEE_FORMAT_CRC:
+        return ring ? nvm_fee_ring_crc_magic : nvm_fee_crc_magic;
+    case NVM_FEE_FORMAT_EXTENTS:
+        return ring ? nvm_fee_ring_extent_magic : nvm_fee_extent_magic;
+    default:
+        return ring ? nvm_fee_ring_magic : nvm_fee_magic;
+    }
+}
+
+static enum arena_state nvm_fee_arena_header_read(NVMFeeDriver* nvmfeep,
+        uint32_t arena, struct arena_header* headerp, nvmfeeformat_t* formatp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t addr = arena *
+            nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size;
+
+    *formatp = nvmfeep->format;
+
+    bool result = nvmRead(nvmfeep->config->nvmp, addr,
+            sizeof(*headerp), (uint8_t*)headerp);
+    if (result != HAL_SUCCESS)
+        return ARENA_STATE_UNKNOWN;
+
+    /* Magic tells the slot format. */
+    if (headerp->magic == nvm_fee_magic_get(nvmfeep, NVM_FEE_FORMAT_MARKS))
+        *formatp = NVM_FEE_FORMAT_MARKS;
+    else if (headerp->magic == nvm_fee_magic_get(nvmfeep, NVM_FEE_FORMAT_CRC))
+        *formatp = NVM_FEE_FORMAT_CRC;
+    else if (headerp->magic ==
+            nvm_fee_magic_get(nvmfeep, NVM_FEE_FORMAT_EXTENTS))
+        *formatp = NVM_FEE_FORMAT_EXTENTS;
+    else
+        return ARENA_STATE_UNKNOWN;
+
+    return nvm_fee_mark_2_arena_state(headerp->state_mark);
+}
+
+static enum arena_state nvm_fee_arena_state_get(NVMFeeDriver* nvmfeep,
+        uint32_t arena)
+{
+    struct arena_header header;
+
+    /* Remember slot format of the arena as well. */
+    return nvm_fee_arena_header_read(nvmfeep, arena, &header,
+            &nvmfeep->arena_format[arena]);
+}
+
+static nvmfeeformat_t nvm_fee_arena_format(NVMFeeDriver* nvmfeep,
+        uint32_t arena)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    if (nvmfeep->config->layout != NVM_FEE_LAYOUT_RING)
+        return nvmfeep->arena_format[arena];
+
+    /* Ring layout: sectors not yet converted are rare, look them up. */
+    if (nvmfeep->ring_foreign == 0)
+        return nvmfeep->format;
+
+    if (nvmfeep->ring_format_sector != arena)
+    {
+        struct arena_header header;
+
+        nvm_fee_arena_header_read(nvmfeep, arena, &header,
+                &nvmfeep->ring_format);
+        nvmfeep->ring_format_sector = arena;
+    }
+
+    return nvmfeep->ring_format;
+}
+
+static bool nvm_fee_arena_state_update(NVMFeeDriver* nvmfeep, uint32_t arena,
+        enum arena_state state)
+{
+    osalDbgCheck((nvmfeep != NULL));
+    osalDbgCheck(state == ARENA_STATE_ACTIVE || state == ARENA_STATE_FROZEN);
+
+    const uint32_t addr = arena *
+            nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size;
+
+    static const write_unit_t zero_mark;
+
+    bool result = false;
+    if (state == ARENA_STATE_ACTIVE)
+        result = nvmWrite(nvmfeep->config->nvmp,
+                    addr + offsetof(struct arena_header, state_mark[0]),
+                    sizeof(zero_mark), (uint8_t*)&zero_mark);
+    else if (state == ARENA_STATE_FROZEN)
+        result = nvmWrite(nvmfeep->config->nvmp,
+                    addr + offsetof(struct arena_header, state_mark[1]),
+                    sizeof(zero_mark), (uint8_t*)&zero_mark);
+
+    if (result != HAL_SUCCESS)
+        return result;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_log_end_find(NVMFeeDriver* nvmfeep, uint32_t arena,
+        uint32_t* usedp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t num_slots = nvmfeep->arena_num_slots;
+    uint32_t low = 0;
+    uint32_t high = num_slots;
+    bool result;
+
+    for (;;)
+    {
+        /* Slots are appended in order, search the first erased one. */
+        while (low < high)
+        {
+            const uint32_t mid = low + (high - low) / 2;
+
+            struct slot temp_slot;
+            result = nvm_fee_slot_read_raw(nvmfeep, arena, mid, &temp_slot);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            if (memtst(&temp_slot, 0xff, sizeof(temp_slot)) == 0)
+                high = mid;
+            else
+                low = mid + 1;
+        }
+
+        /* A failed or torn record leaves up to two erased slots ahead of
+         * written ones, continue past them. */
+        uint32_t next = low + 1;
+        for (; next <= low + 2 && next < num_slots; ++next)
+        {
+            struct slot temp_slot;
+            result = nvm_fee_slot_read_raw(nvmfeep, arena, next, &temp_slot);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            if (memtst(&temp_slot, 0xff, sizeof(temp_slot)) != 0)
+                break;
+        }
+
+        if (next > low + 2 || next >= num_slots)
+            break;
+
+        low = next + 1;
+        high = num_slots;
+    }
+
+    *usedp = low;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_log_load(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    nvm_fee_index_clear(nvmfeep);
+#if NVM_FEE_USE_SHADOW
+    if (nvmfeep->shadow != NULL)
+        memset(nvmfeep->shadow, 0xff, nvmfeep->fee_size);
+#endif /* NVM_FEE_USE_SHADOW */
+#if NVM_FEE_USE_KV
+    nvm_fee_kv_clear(nvmfeep);
+#endif /* NVM_FEE_USE_KV */
+
+    /* Records are only read to rebuild RAM structures. */
+    bool rebuild = false;
+#if NVM_FEE_USE_INDEX
+    rebuild |= nvmfeep->index_num != 0;
+#endif /* NVM_FEE_USE_INDEX */
+#if NVM_FEE_USE_SHADOW
+    rebuild |= nvmfeep->shadow != NULL;
+#endif /* NVM_FEE_USE_SHADOW */
+#if NVM_FEE_USE_KV
+    rebuild |= nvmfeep->kv_num != 0;
+#endif /* NVM_FEE_USE_KV */
+    if (rebuild == false)
+        return HAL_SUCCESS;
+
+    bool result;
+
+    /* Walk through all records of the log. */
+    for (uint32_t unit = 0; unit < nvm_fee_log_units(nvmfeep); ++unit)
+    {
+        const uint32_t arena = nvm_fee_log_arena(nvmfeep, unit);
+        const uint32_t used = nvm_fee_log_used(nvmfeep, unit);
+
+        struct record record;
+        for (uint32_t slot = 0; slot < used; slot += record.slots)
+        {
+            /* Read record. */
+            result = nvm_fee_record_read(nvmfeep, arena, slot, &record, true);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            /* Later records supersede earlier ones. */
+            if (record.state == SLOT_STATE_VALID)
+            {
+                result = nvm_fee_record_register(nvmfeep, arena, slot,
+                        &record);
+                if (result != HAL_SUCCESS)
+                    return result;
+            }
+        }
+    }
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_log_mount(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t arena =
+            nvm_fee_log_arena(nvmfeep, nvm_fee_log_units(nvmfeep) - 1);
+
+    uint32_t used;
+    bool result;
+
+    /* Only the newest unit is appended to. */
+    result = nvm_fee_log_end_find(nvmfeep, arena, &used);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+        nvmfeep->ring_head_slots = used;
+    else
+        nvmfeep->arena_slots[arena] = used;
+
+    return nvm_fee_log_load(nvmfeep);
+}
+
+static bool nvm_fee_arena_erase(NVMFeeDriver* nvmfeep, uint32_t arena)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t addr = arena *
+            nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size;
+
+    bool result;
+
+    /* Mass erase underlying nvm device. */
+    result = nvmErase(nvmfeep->config->nvmp, addr,
+            nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Set magic. */
+    const struct arena_header header =
+    {
+        .magic = nvm_fee_magic_get(nvmfeep, nvmfeep->format),
+#if NVM_FEE_WRITE_UNIT_SIZE == 8
+        .magic2 = nvm_fee_magic_get(nvmfeep, nvmfeep->format),
+#endif
+        .state_mark[0] = (write_unit_t)0xffffffffffffffffULL,
+        .state_mark[1] = (write_unit_t)0xffffffffffffffffULL,
+        .sequence = (sequence_t)0xffffffffffffffffULL,
+    };
+
+    result = nvmWrite(nvmfeep->config->nvmp, addr,
+            sizeof(header), (uint8_t*)&header);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    if (nvmfeep->config->layout != NVM_FEE_LAYOUT_RING)
+    {
+        nvmfeep->arena_slots[arena] = 0;
+        nvmfeep->arena_format[arena] = nvmfeep->format;
+    }
+    else if (nvmfeep->ring_format_sector == arena)
+    {
+        nvmfeep->ring_format = nvmfeep->format;
+    }
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_gc_copy(NVMFeeDriver* nvmfeep,
+        struct record_writer* writerp, uint32_t dst_arena, uint32_t address,
+        const uint8_t* payload)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    /* Consecutive addresses extend the record being written. */
+    if (nvm_fee_writer_room(nvmfeep, writerp, address))
+        return nvm_fee_writer_add(nvmfeep, writerp, payload);
+
+    bool result = nvm_fee_copy_end(nvmfeep, writerp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    nvm_fee_writer_begin(nvmfeep, writerp, dst_arena,
+            &nvmfeep->arena_slots[dst_arena], address, payload);
+
+    return HAL_SUCCESS;
+}
+
+#if NVM_FEE_USE_KV
+static bool nvm_fee_kv_copy(NVMFeeDriver* nvmfeep, const nvmfeekv_t* kvp,
+        uint32_t dst_arena, uint32_t* usedp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t slots = nvm_fee_kv_slots(kvp->length);
+    const uint32_t dst_slot = *usedp;
+
+    uint32_t src_arena;
+    uint32_t src_slot;
+    nvm_fee_kv_locate(nvmfeep, kvp, &src_arena, &src_slot);
+
+    /* Following slots refer to the first one by position only, so the
+     * record is copied as is, in log order. A torn copy fails the record
+     * CRC and reads as dirty. Slots are consumed one at a time, so a failed
+     * copy does not leave erased slots behind the end of the log. */
+    for (uint32_t k = 0; k < slots; ++k)
+    {
+        ++*usedp;
+
+        struct slot temp_slot;
+        bool result = nvm_fee_slot_read_raw(nvmfeep, src_arena, src_slot + k,
+                &temp_slot);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        result = nvmWrite(nvmfeep->config->nvmp,
+                nvm_fee_slot_offset(nvmfeep, dst_arena, dst_slot + k),
+                sizeof(temp_slot), (uint8_t*)&temp_slot);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_FEE_USE_KV */
+
+static bool nvm_fee_gc(NVMFeeDriver* nvmfeep, uint32_t omit_addr)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    uint32_t src_arena;
+    uint32_t dst_arena;
+
+    if (nvmfeep->arena_active == 0)
+    {
+        src_arena = 0;
+        dst_arena = 1;
+    }
+    else
+    {
+        src_arena = 1;
+        dst_arena = 0;
+    }
+
+    nvmfeep->arena_slots[dst_arena] = 0;
+
+    struct record_writer writer;
+    bool result;
+
+    writer.entries = 0;
+
+    /* Destination got erased using the other slot format, redo it. */
+    if (nvmfeep->arena_format[dst_arena] != nvmfeep->format)
+    {
+        result = nvm_fee_arena_erase(nvmfeep, dst_arena);
+        if (result != HAL_SUCCESS)
+            goto out_error;
+    }
+
+    /* stage 1: Freeze source arena. */
+    result = nvm_fee_arena_state_update(nvmfeep, src_arena, ARENA_STATE_FROZEN);
+    if (result != HAL_SUCCESS)
+        goto out_error;
+
+#if NVM_FEE_USE_KV
+    /* Key/value records go first. Their hash table entries are updated
+     * once the destination arena is active. */
+    for (uint32_t i = 0; i < nvmfeep->kv_num; ++i)
+    {
+        if (nvmfeep->config->kv[i].slot == NVM_FEE_KV_NONE)
+            continue;
+
+        result = nvm_fee_kv_copy(nvmfeep, &nvmfeep->config->kv[i], dst_arena,
+                &nvmfeep->arena_slots[dst_arena]);
+        if (result != HAL_SUCCESS)
+            goto out_error;
+    }
+#endif /* NVM_FEE_USE_KV */
+
+    /* stage 2: Copy active slots to destination arena. */
+#if NVM_FEE_USE_SHADOW
+    if (nvmfeep->shadow != NULL)
+    {
+        /* The shadow image holds the newest content of every address. */
+        nvm_fee_index_clear(nvmfeep);
+
+        for (uint32_t addr = 0;
+                addr < nvmfeep->fee_size;
+                addr += NVM_FEE_SLOT_PAYLOAD_SIZE)
+        {
+            /* Skip one slot to allow full write. */
+            if (addr == omit_addr)
+                continue;
+
+            /* Erased content does not need a slot. */
+            if (memtst(nvmfeep->shadow + addr, 0xff,
+                    NVM_FEE_SLOT_PAYLOAD_SIZE) == 0)
+                continue;
+
+            result = nvm_fee_gc_copy(nvmfeep, &writer, dst_arena, addr,
+                    nvmfeep->shadow + addr);
+            if (result != HAL_SUCCESS)
+                goto out_error;
+        }
+
+        goto out_activate;
+    }
+#endif /* NVM_FEE_USE_SHADOW */
+
+#if NVM_FEE_USE_INDEX
+    /* Addresses covered by the RAM index: the newest slots are known. */
+    const uint32_t entries_indexed = nvmfeep->index_num;
+
+    struct record record;
+    uint32_t record_slot = NVM_FEE_INDEX_NONE;
+
+    for (uint32_t entry = 0; entry < entries_indexed; ++entry)
+    {
+        const uint32_t slot = nvmfeep->config->index[entry];
+        const uint32_t addr = entry * NVM_FEE_SLOT_PAYLOAD_SIZE;
+
+        if (slot == NVM_FEE_INDEX_NONE)
+            continue;
+
+        /* Skip one slot to allow full write. */
+        if (addr == omit_addr)
+        {
+            nvmfeep->config->index[entry] = NVM_FEE_INDEX_NONE;
+            continue;
+        }
+
+        /* Consecutive addresses often share a record. */
+        if (slot != record_slot)
+        {
+            result = nvm_fee_record_read(nvmfeep, src_arena, slot, &record,
+                    false);
+            if (result != HAL_SUCCESS)
+                goto out_error;
+            record_slot = slot;
+        }
+
+        uint8_t payload[NVM_FEE_SLOT_PAYLOAD_SIZE];
+        result = nvm_fee_record_entry_read(nvmfeep, src_arena, slot, &record,
+                addr, payload);
+        if (result != HAL_SUCCESS)
+            goto out_error;
+
+        result = nvm_fee_gc_copy(nvmfeep, &writer, dst_arena, addr, payload);
+        if (result != HAL_SUCCESS)
+            goto out_error;
+    }
+#else
+    const uint32_t entries_indexed = 0;
+#endif /* NVM_FEE_USE_INDEX */
+
+    /* Remaining addresses: scan the source arena backwards so the first
+     * slot seen for an address is the newest one. Each pass covers the
+     * addresses of the seen-bitmap, none is left with a full index. */
+    for (uint32_t first_entry = entries_indexed;
+            first_entry < nvmfeep->fee_size / NVM_FEE_SLOT_PAYLOAD_SIZE;
+            first_entry += 8 * NVM_FEE_GC_BITMAP_SIZE)
+    {
+        uint8_t seen[NVM_FEE_GC_BITMAP_SIZE];
+        memset(seen, 0, sizeof(seen));
+
+        for (uint32_t slot = nvmfeep->arena_slots[src_arena]; slot > 0;)
+        {
+            struct record record;
+            result = nvm_fee_record_read_prev(nvmfeep, src_arena, &slot,
+                    &record);
+            if (result != HAL_SUCCESS)
+                goto out_error;
+
+            /* Skip if record is not in valid state. */
+            if (record.state != SLOT_STATE_VALID)
+                continue;
+
+            /* Only addresses of the current pass. */
+            uint32_t end;
+            for (uint32_t i = nvm_fee_record_clip(&record, first_entry,
+                            8 * NVM_FEE_GC_BITMAP_SIZE, &end);
+                    i < end;
+                    ++i)
+            {
+                const uint32_t addr = record.address +
+                        i * NVM_FEE_SLOT_PAYLOAD_SIZE;
+
+                /* Skip holes and one slot to allow full write. */
+                if (nvm_fee_record_has(&record, i) == false ||
+                        addr == omit_addr)
+                    continue;
+
+                /* Skip older copies. */
+                const uint32_t bit = addr / NVM_FEE_SLOT_PAYLOAD_SIZE -
+                        first_entry;
+                if (seen[bit / 8] & (1U << (bit % 8)))
+                    continue;
+                seen[bit / 8] |= 1U << (bit % 8);
+
+                /* Erased content does not need a slot. */
+                if (record.erased == true)
+                    continue;
+
+                uint8_t payload[NVM_FEE_SLOT_PAYLOAD_SIZE];
+                result = nvm_fee_record_entry_read(nvmfeep, src_arena, slot,
+                        &record, addr, payload);
+                if (result != HAL_SUCCESS)
+                    goto out_error;
+
+                result = nvm_fee_gc_copy(nvmfeep, &writer, dst_arena, addr,
+                        payload);
+                if (result != HAL_SUCCESS)
+                    goto out_error;
+            }
+        }
+    }
+
+#if NVM_FEE_USE_SHADOW
+out_activate:
+#endif /* NVM_FEE_USE_SHADOW */
+    result = nvm_fee_copy_end(nvmfeep, &writer);
+    if (result != HAL_SUCCESS)
+        goto out_error;
+
+    /* stage 3: Activate destination arena. */
+    result = nvm_fee_arena_state_update(nvmfeep, dst_arena, ARENA_STATE_ACTIVE);
+    if (result != HAL_SUCCESS)
+        goto out_error;
+
+    /* Update driver state. */
+    nvmfeep->arena_active = dst_arena;
+
+#if NVM_FEE_USE_KV
+    /* Copies were appended in hash table order. */
+    uint32_t kv_slot = 0;
+    for (uint32_t i = 0; i < nvmfeep->kv_num; ++i)
+    {
+        nvmfeekv_t* kvp = &nvmfeep->config->kv[i];
+
+        if (kvp->slot == NVM_FEE_KV_NONE)
+            continue;
+
+        kvp->slot = kv_slot;
+        kv_slot += nvm_fee_kv_slots(kvp->length);
+    }
+#endif /* NVM_FEE_USE_KV */
+
+    /* stage 4: Reinit source arena. */
+    result = nvm_fee_arena_erase(nvmfeep, src_arena);
+    if (result != HAL_SUCCESS)
+        goto out_error;
+
+    return HAL_SUCCESS;
+
+out_error:
+    /* RAM structures are partially updated, rebuild them from the active
+     * arena. If that fails as well they can not be trusted anymore and the
+     * driver has to be started again. */
+    if (nvm_fee_log_load(nvmfeep) != HAL_SUCCESS)
+        nvmfeep->state = NVM_STOP;
+    return result;
+}
+
+static uint32_t nvm_fee_ring_head(NVMFeeDriver* nvmfeep)
+{
+    return (nvmfeep->ring_tail + nvmfeep->ring_sectors - 1) %
+            nvmfeep->llnvmdi.sector_num;
+}
+
+static bool nvm_fee_ring_open(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+    osalDbgAssert(nvmfeep->ring_sectors < nvmfeep->llnvmdi.sector_num,
+            "no free sector");
+
+    const uint32_t sector = (nvmfeep->ring_tail + nvmfeep->ring_sectors) %
+            nvmfeep->llnvmdi.sector_num;
+    const uint32_t addr = sector * nvmfeep->llnvmdi.sector_size;
+    const sequence_t sequence = nvmfeep->ring_sequence + 1;
+
+    bool result;
+
+    /* Sequence number has to be written prior to activation. */
+    result = nvmWrite(nvmfeep->config->nvmp,
+            addr + offsetof(struct arena_header, sequence),
+            sizeof(sequence), (uint8_t*)&sequence);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    result = nvm_fee_arena_state_update(nvmfeep, sector, ARENA_STATE_ACTIVE);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Update driver state. */
+    nvmfeep->ring_sectors++;
+    nvmfeep->ring_head_slots = 0;
+    nvmfeep->ring_sequence = sequence;
+
+    return HAL_SUCCESS;
+}
+
+#if NVM_FEE_USE_KV
+static bool nvm_fee_kv_ring_copy(NVMFeeDriver* nvmfeep, nvmfeekv_t* kvp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    bool result;
+
+    /* Garbage collection may use the sector kept in reserve. A record is
+     * not split across sectors. */
+    if (nvmfeep->ring_head_slots + nvm_fee_kv_slots(kvp->length) >
+            nvmfeep->arena_num_slots)
+    {
+        if (nvmfeep->ring_sectors == nvmfeep->llnvmdi.sector_num)
+            return HAL_FAILED;
+
+        result = nvm_fee_ring_open(nvmfeep);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    const uint32_t head = nvm_fee_ring_head(nvmfeep);
+    const uint32_t slot = nvmfeep->ring_head_slots;
+
+    result = nvm_fee_kv_copy(nvmfeep, kvp, head, &nvmfeep->ring_head_slots);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* The copy is the newest record of the key. */
+    kvp->slot = head * nvmfeep->arena_num_slots + slot;
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_FEE_USE_KV */
+
+static uint32_t nvm_fee_ring_copy_slots(NVMFeeDriver* nvmfeep,
+        const struct record* recordp, uint64_t live)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+#if NVM_FEE_USE_KV
+    /* Key/value records are copied as is. */
+    if (recordp->kv == true)
+        return recordp->slots;
+#else
+    (void)recordp;
+#endif /* NVM_FEE_USE_KV */
+
+    /* Payloads from the first to the last live one make up one record
+     * unless the newest sector holds single slots only. */
+    if (nvm_fee_arena_format(nvmfeep, nvm_fee_ring_head(nvmfeep)) !=
+            NVM_FEE_FORMAT_EXTENTS)
+        return 1;
+
+    return nvm_fee_extent_slots(64 - __builtin_clzll(live) -
+            __builtin_ctzll(live));
+}
+
+static bool nvm_fee_ring_copy(NVMFeeDriver* nvmfeep, uint32_t sector,
+        uint32_t slot, const struct record* recordp, uint64_t live)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+#if NVM_FEE_USE_KV
+    if (recordp->kv == true)
+        return nvm_fee_kv_ring_copy(nvmfeep,
+                nvm_fee_kv_find(nvmfeep, recordp->key));
+#endif /* NVM_FEE_USE_KV */
+
+    struct record_writer writer;
+    bool result;
+
+    writer.entries = 0;
+
+    /* Outdated payloads between live ones are left as holes, so the copy
+     * never takes more slots than the record itself. */
+    for (uint32_t i = 0; i < recordp->entries && (live >> i) != 0; ++i)
+    {
+        const uint32_t addr = recordp->address + i * NVM_FEE_SLOT_PAYLOAD_SIZE;
+        const bool alive = (live & (1ULL << i)) != 0;
+
+        uint8_t payload[NVM_FEE_SLOT_PAYLOAD_SIZE];
+        if (alive == true)
+        {
+            result = nvm_fee_record_entry_read(nvmfeep, sector, slot, recordp,
+                    addr, payload);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+
+        if (writer.entries != 0 && writer.extents == true)
+        {
+            result = nvm_fee_writer_add(nvmfeep, &writer,
+                    alive == true ? payload : NULL);
+            if (result != HAL_SUCCESS)
+                return result;
+            continue;
+        }
+
+        if (alive == false)
+            continue;
+
+        result = nvm_fee_copy_end(nvmfeep, &writer);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        /* Garbage collection may use the sector kept in reserve. A record
+         * is not split across sectors. */
+        if (nvmfeep->ring_head_slots +
+                nvm_fee_ring_copy_slots(nvmfeep, recordp, live >> i) >
+                nvmfeep->arena_num_slots)
+        {
+            if (nvmfeep->ring_sectors == nvmfeep->llnvmdi.sector_num)
+                return HAL_FAILED;
+
+            result = nvm_fee_ring_open(nvmfeep);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+
+        nvm_fee_writer_begin(nvmfeep, &writer, nvm_fee_ring_head(nvmfeep),
+                &nvmfeep->ring_head_slots, addr, payload);
+    }
+
+    return nvm_fee_copy_end(nvmfeep, &writer);
+}
+
+static bool nvm_fee_ring_release(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t tail = nvmfeep->ring_tail;
+    const bool foreign =
+            nvm_fee_arena_format(nvmfeep, tail) != nvmfeep->format;
+
+    bool result;
+
+    /* stage 2: Freeze oldest sector, it holds outdated slots only. */
+    result = nvm_fee_arena_state_update(nvmfeep, tail, ARENA_STATE_FROZEN);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* stage 3: Reinit oldest sector. */
+    result = nvm_fee_arena_erase(nvmfeep, tail);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Update driver state. */
+    nvmfeep->ring_tail = (tail + 1) % nvmfeep->llnvmdi.sector_num;
+    nvmfeep->ring_sectors--;
+    if (foreign == true)
+        nvmfeep->ring_foreign--;
+#if NVM_FEE_USE_GC_THREAD
+    nvmfeep->gc_cursor = 0;
+#endif /* NVM_FEE_USE_GC_THREAD */
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_ring_reclaim(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+    osalDbgAssert(nvmfeep->ring_sectors > 1, "nothing to reclaim");
+
+    bool result;
+
+    /* stage 1: Copy live records of the oldest sector to the newest one.
+     * Copies fit into the reserve sector as each one takes at most the
+     * slots of its source record. */
+#if NVM_FEE_USE_KV
+    /* Key/value records still referred to by the hash table. */
+    for (uint32_t i = 0; i < nvmfeep->kv_num; ++i)
+    {
+        nvmfeekv_t* kvp = &nvmfeep->config->kv[i];
+
+        if (kvp->slot == NVM_FEE_KV_NONE ||
+                kvp->slot / nvmfeep->arena_num_slots != nvmfeep->ring_tail)
+            continue;
+
+        result = nvm_fee_kv_ring_copy(nvmfeep, kvp);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+#endif /* NVM_FEE_USE_KV */
+#if NVM_FEE_USE_INDEX
+    /* The RAM index covers all addresses, so the newest slots are known. */
+    const uint32_t tail = nvmfeep->ring_tail;
+
+    struct record record;
+    for (uint32_t slot = 0;
+            slot < nvmfeep->arena_num_slots;
+            slot += record.slots)
+    {
+        result = nvm_fee_record_read(nvmfeep, tail, slot, &record, true);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        /* Skip if record is not in valid state. Nothing older than a
+         * tombstone of the oldest sector is left. */
+        const uint32_t first = record.address / NVM_FEE_SLOT_PAYLOAD_SIZE;
+        if (record.state != SLOT_STATE_VALID || record.erased == true)
+            continue;
+
+        /* Skip older copies. Key/value records have no entries. */
+        uint64_t live = 0;
+        for (uint32_t i = 0; i < record.entries; ++i)
+            if (nvm_fee_record_has(&record, i) &&
+                    nvmfeep->config->index[first + i] ==
+                            tail * nvmfeep->arena_num_slots + slot)
+                live |= 1ULL << i;
+
+        if (live == 0)
+            continue;
+
+        result = nvm_fee_ring_copy(nvmfeep, tail, slot, &record, live);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+#endif /* NVM_FEE_USE_INDEX */
+
+    return nvm_fee_ring_release(nvmfeep);
+}
+
+static bool nvm_fee_ring_reserve(NVMFeeDriver* nvmfeep, uint32_t slots,
+        bool* collectedp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t sector_num = nvmfeep->llnvmdi.sector_num;
+
+    bool result;
+
+    /* Keep one sector erased for garbage collection and room for the
+     * record in the newest one. Reclaiming a sector usually frees space,
+     * otherwise the next oldest one is reclaimed. */
+    while (nvmfeep->ring_sectors >= sector_num ||
+            nvmfeep->ring_head_slots + slots > nvmfeep->arena_num_slots)
+    {
+        if (nvmfeep->ring_sectors < sector_num - 1)
+        {
+            result = nvm_fee_ring_open(nvmfeep);
+        }
+        else
+        {
+            result = nvm_fee_ring_reclaim(nvmfeep);
+            *collectedp = true;
+        }
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    return HAL_SUCCESS;
+}
+
+#if NVM_FEE_USE_GC_THREAD
+static bool nvm_fee_ring_reclaim_step(NVMFeeDriver* nvmfeep, uint32_t slots,
+        bool* donep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+    osalDbgAssert(nvmfeep->ring_sectors > 1, "nothing to reclaim");
+
+    const uint32_t tail = nvmfeep->ring_tail;
+
+    bool result;
+
+    *donep = false;
+
+    /* Writers may have appended since the last step, so every address is
+     * looked up again right before it is copied. The RAM index covers all
+     * addresses, see @p nvmfeeStart(), which keeps a step short. */
+    while (slots > 0 && nvmfeep->gc_cursor < nvmfeep->arena_num_slots)
+    {
+        const uint32_t slot = nvmfeep->gc_cursor;
+
+        struct record record;
+        result = nvm_fee_record_read(nvmfeep, tail, slot, &record, true);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        /* Nothing older than a tombstone of the oldest sector is left. */
+        uint64_t live = 0;
+        for (uint32_t i = 0;
+                record.state == SLOT_STATE_VALID && record.erased == false &&
+                        i < record.entries;
+                ++i)
+        {
+            bool found;
+            uint32_t found_arena;
+            uint32_t found_slot;
+
+            if (nvm_fee_record_has(&record, i) == false)
+                continue;
+
+            result = nvm_fee_slot_lookup(nvmfeep,
+                    record.address + i * NVM_FEE_SLOT_PAYLOAD_SIZE,
+                    &found_arena, &found_slot, &found);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            if (found == true && found_arena == tail && found_slot == slot)
+                live |= 1ULL << i;
+        }
+
+#if NVM_FEE_USE_KV
+        /* Key/value records are live while the hash table refers to
+         * them. */
+        if (record.state == SLOT_STATE_VALID && record.kv == true &&
+                record.erased == false && nvmfeep->kv_num != 0 &&
+                nvm_fee_kv_find(nvmfeep, record.key)->slot ==
+                        tail * nvmfeep->arena_num_slots + slot)
+            live = 1;
+#endif /* NVM_FEE_USE_KV */
+
+        if (live != 0)
+        {
+            /* The reserve sector is left to writers, they finish the
+             * whole sector if needed. */
+            if (nvmfeep->ring_head_slots +
+                    nvm_fee_ring_copy_slots(nvmfeep, &record, live) >
+                    nvmfeep->arena_num_slots &&
+                    nvmfeep->ring_sectors >=
+                            nvmfeep->llnvmdi.sector_num - 1)
+            {
+                *donep = true;
+                return nvm_fee_ring_reclaim(nvmfeep);
+            }
+
+            result = nvm_fee_ring_copy(nvmfeep, tail, slot, &record, live);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+
+        nvmfeep->gc_cursor += record.slots;
+        slots -= record.slots < slots ? record.slots : slots;
+    }
+
+    if (nvmfeep->gc_cursor < nvmfeep->arena_num_slots)
+        return HAL_SUCCESS;
+
+    *donep = true;
+    return nvm_fee_ring_release(nvmfeep);
+}
+#endif /* NVM_FEE_USE_GC_THREAD */
+
+static bool nvm_fee_ring_format(NVMFeeDriver* nvmfeep, uint32_t head)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    struct arena_header header;
+    nvmfeeformat_t format;
+    bool result;
+
+    /* Freeze newest sector first. Mount takes a frozen newest sector for an
+     * interrupted format, so the older ones can not come back as a log. */
+    if (head != 0xffffffff &&
+            nvm_fee_arena_header_read(nvmfeep, head, &header, &format) ==
+                    ARENA_STATE_ACTIVE)
+    {
+        result = nvm_fee_arena_state_update(nvmfeep, head, ARENA_STATE_FROZEN);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    /* Newest sector goes last. */
+    for (uint32_t sector = 0; sector < nvmfeep->llnvmdi.sector_num; ++sector)
+    {
+        if (sector == head)
+            continue;
+
+        result = nvm_fee_arena_erase(nvmfeep, sector);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    if (head != 0xffffffff)
+    {
+        result = nvm_fee_arena_erase(nvmfeep, head);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    nvmfeep->ring_tail = 0;
+    nvmfeep->ring_sectors = 0;
+    nvmfeep->ring_sequence = 0;
+    nvmfeep->ring_foreign = 0;
+#if NVM_FEE_USE_GC_THREAD
+    nvmfeep->gc_cursor = 0;
+#endif /* NVM_FEE_USE_GC_THREAD */
+    nvm_fee_index_clear(nvmfeep);
+#if NVM_FEE_USE_SHADOW
+    if (nvmfeep->shadow != NULL)
+        memset(nvmfeep->shadow, 0xff, nvmfeep->fee_size);
+#endif /* NVM_FEE_USE_SHADOW */
+#if NVM_FEE_USE_KV
+    nvm_fee_kv_clear(nvmfeep);
+#endif /* NVM_FEE_USE_KV */
+
+    return nvm_fee_ring_open(nvmfeep);
+}
+
+static bool nvm_fee_ring_mount(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t sector_num = nvmfeep->llnvmdi.sector_num;
+
+    struct arena_header header;
+    nvmfeeformat_t format;
+    bool found = false;
+    uint32_t head = 0;
+    sequence_t head_sequence = 0;
+    enum arena_state head_state = ARENA_STATE_UNUSED;
+    bool result;
+
+    /* Find newest sector in use. Only the oldest sector is frozen while
+     * the ring is in use. */
+    for (uint32_t sector = 0; sector < sector_num; ++sector)
+    {
+        const enum arena_state state =
+                nvm_fee_arena_header_read(nvmfeep, sector, &header, &format);
+        if (state != ARENA_STATE_ACTIVE && state != ARENA_STATE_FROZEN)
+            continue;
+
+        if (found == false || header.sequence > head_sequence)
+        {
+            found = true;
+            head = sector;
+            head_sequence = header.sequence;
+            head_state = state;
+        }
+    }
+
+    /* Pristine or totally broken memory. */
+    if (found == false)
+        return nvm_fee_ring_format(nvmfeep, 0xffffffff);
+
+    /* Format got interrupted, finish it. */
+    if (head_state == ARENA_STATE_FROZEN)
+        return nvm_fee_ring_format(nvmfeep, head);
+
+    /* Sectors in use precede the newest one with consecutive sequence
+     * numbers. */
+    uint32_t sectors = 1;
+    while (sectors < sector_num)
+    {
+        const uint32_t sector = (head + sector_num - sectors) % sector_num;
+
+        if (nvm_fee_arena_header_read(nvmfeep, sector, &header, &format) !=
+                ARENA_STATE_ACTIVE ||
+                header.sequence != head_sequence - sectors)
+            break;
+
+        ++sectors;
+    }
+
+    nvmfeep->ring_tail = (head + sector_num + 1 - sectors) % sector_num;
+    nvmfeep->ring_sectors = sectors;
+    nvmfeep->ring_sequence = head_sequence;
+#if NVM_FEE_USE_GC_THREAD
+    nvmfeep->gc_cursor = 0;
+#endif /* NVM_FEE_USE_GC_THREAD */
+
+    /* Garbage collection got interrupted while using the reserve sector.
+     * Slots are only copied there, so drop it and restart later on. */
+    if (sectors == sector_num)
+    {
+        result = nvm_fee_arena_erase(nvmfeep, head);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        nvmfeep->ring_sectors--;
+        nvmfeep->ring_sequence--;
+    }
+
+    /* Extents are kept once written, see @p NVMFeeConfig. */
+    for (uint32_t i = 0; i < nvmfeep->ring_sectors; ++i)
+    {
+        const uint32_t sector = (nvmfeep->ring_tail + i) % sector_num;
+
+        nvm_fee_arena_header_read(nvmfeep, sector, &header, &format);
+        if (format == NVM_FEE_FORMAT_EXTENTS)
+            nvmfeep->format = NVM_FEE_FORMAT_EXTENTS;
+    }
+
+    /* Count sectors written in another slot format, reclaiming converts
+     * them. */
+    nvmfeep->ring_foreign = 0;
+    nvmfeep->ring_format_sector = 0xffffffff;
+    for (uint32_t i = 0; i < nvmfeep->ring_sectors; ++i)
+    {
+        const uint32_t sector = (nvmfeep->ring_tail + i) % sector_num;
+
+        nvm_fee_arena_header_read(nvmfeep, sector, &header, &format);
+        if (format != nvmfeep->format)
+            nvmfeep->ring_foreign++;
+    }
+
+    /* Clear remaining sectors unless they are cleanly erased. This covers
+     * interrupted reclaims, erases and openings. */
+    for (uint32_t i = nvmfeep->ring_sectors; i < sector_num; ++i)
+    {
+        const uint32_t sector = (nvmfeep->ring_tail + i) % sector_num;
+
+        if (nvm_fee_arena_header_read(nvmfeep, sector, &header, &format) ==
+                ARENA_STATE_UNUSED &&
+                header.sequence == (sequence_t)0xffffffffffffffffULL &&
+                format == nvmfeep->format)
+            continue;
+
+        result = nvm_fee_arena_erase(nvmfeep, sector);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    return nvm_fee_log_mount(nvmfeep);
+}
+
+#if NVM_FEE_USE_GC_THREAD
+static bool nvm_fee_gc_step(NVMFeeDriver* nvmfeep, bool* donep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    *donep = true;
+
+    /* The newest sector can not be reclaimed. */
+    if (nvmfeep->ring_sectors < 2)
+        return HAL_SUCCESS;
+
+    return nvm_fee_ring_reclaim_step(nvmfeep, NVM_FEE_GC_STEP_SLOTS, donep);
+}
+
+static void nvm_fee_gc_kick(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    const uint32_t high = nvmfeep->config->gc_high_watermark;
+    const uint32_t low = nvmfeep->config->gc_low_watermark;
+    const uint32_t usage = nvm_fee_log_usage(nvmfeep);
+    const uint32_t capacity = nvm_fee_log_capacity(nvmfeep);
+
+    if (high == 0 || usage * 100 < high * capacity)
+        return;
+
+    /* A pass stopping above the low watermark had nothing to gain, so
+     * wait for as much new data as a regular pass would remove. */
+    if (usage > nvmfeep->gc_mark &&
+            (usage - nvmfeep->gc_mark) * 100 < (high - low) * capacity)
+        return;
+
+    osalSysLock();
+    nvmfeep->gc_pending = true;
+    if (nvmfeep->gc_wait != NULL)
+        chThdResumeS(&nvmfeep->gc_wait, MSG_OK);
+    osalSysUnlock();
+}
+
+static void nvm_fee_gc_pass(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    uint32_t usage_before = 0;
+    bool done = true;
+
+    while (true)
+    {
+        nvmfeeAcquireBus(nvmfeep);
+
+        if (nvmfeep->state == NVM_STOP)
+        {
+            nvmfeeReleaseBus(nvmfeep);
+            return;
+        }
+
+        const uint32_t usage = nvm_fee_log_usage(nvmfeep);
+
+        /* Low watermark reached. */
+        if (usage * 100 <=
+                nvmfeep->config->gc_low_watermark *
+                nvm_fee_log_capacity(nvmfeep))
+        {
+            nvmfeep->gc_mark = usage;
+            nvmfeeReleaseBus(nvmfeep);
+            break;
+        }
+
+        /* Usage at the beginning of a whole arena or sector. */
+        if (done == true)
+            usage_before = usage;
+
+        const systime_t start = osalOsGetSystemTimeX();
+        bool result = nvm_fee_gc_step(nvmfeep, &done);
+        const sysinterval_t elapsed = chVTTimeElapsedSinceX(start);
+
+        nvmfeep->gc_info.steps++;
+        nvmfeep->gc_info.step_last = elapsed;
+        if (elapsed > nvmfeep->gc_info.step_max)
+            nvmfeep->gc_info.step_max = elapsed;
+
+        /* Stop if collection failed or did not free anything. */
+        if (result != HAL_SUCCESS ||
+                (done == true &&
+                        nvm_fee_log_usage(nvmfeep) >= usage_before))
+        {
+            nvmfeep->gc_mark = nvm_fee_log_usage(nvmfeep);
+            nvmfeeReleaseBus(nvmfeep);
+            break;
+        }
+
+        nvmfeeReleaseBus(nvmfeep);
+    }
+
+    nvmfeep->gc_info.passes++;
+}
+
+static void nvm_fee_gc_thread(void* parameters)
+{
+    NVMFeeDriver* nvmfeep = (NVMFeeDriver*)parameters;
+
+    chRegSetThreadName("nvm_fee_gc");
+
+    while (true)
+    {
+        /* Nothing to do, going to sleep. */
+        osalSysLock();
+        if (nvmfeep->gc_pending == false)
+            chThdSuspendS(&nvmfeep->gc_wait);
+        nvmfeep->gc_pending = false;
+        osalSysUnlock();
+
+        nvm_fee_gc_pass(nvmfeep);
+    }
+}
+#endif /* NVM_FEE_USE_GC_THREAD */
+
+static bool nvm_fee_slot_fetch(NVMFeeDriver* nvmfeep, uint32_t address,
+        struct slot* slotp)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+#if NVM_FEE_USE_SHADOW
+    /* Current content is available in RAM. */
+    if (nvmfeep->shadow != NULL)
+    {
+        slotp->address = address;
+        memcpy(slotp->payload, nvmfeep->shadow + address,
+                sizeof(slotp->payload));
 
-    nvmfeep->arena_slots[dst_arena] = 0;
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_FEE_USE_SHADOW */
 
+    /* Look for existing slot. */
+    bool found;
+    uint32_t arena;
+    uint32_t slot;
     bool result;
 
-    /* stage 1: Freeze source arena. */
-    result = nvm_fee_arena_state_update(nvmfeep, src_arena, ARENA_STATE_FROZEN);
+    result = nvm_fee_slot_lookup(nvmfeep, address, &arena, &slot, &found);
     if (result != HAL_SUCCESS)
         return result;
 
-    /* stage 2: Copy active slots to destination arena. */
-    for (uint32_t addr = 0;
-            addr < nvmfeep->fee_size;
-            addr += NVM_FEE_SLOT_PAYLOAD_SIZE)
+    if (found == true)
     {
-        /* Skip one slot to allow full write. */
-        if (addr == omit_addr)
-            continue;
-
-        /* Look for existing slot. */
-        bool found;
-        uint32_t slot;
-
-        result = nvm_fee_slot_lookup(nvmfeep, src_arena, addr, &slot, &found);
+        /* Existing record so read the payload from it. */
+        struct record record;
+        result = nvm_fee_record_read(nvmfeep, arena, slot, &record, false);
         if (result != HAL_SUCCESS)
             return result;
 
-        if (found)
-        {
-            /* Read slot. */
-            struct slot temp_slot;
-            result = nvm_fee_slot_read(nvmfeep, src_arena, slot, &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
-
-            /* Write new slot. */
-            result = nvm_fee_slot_write(nvmfeep, dst_arena,
-                    nvmfeep->arena_slots[dst_arena], &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
-
-            ++nvmfeep->arena_slots[dst_arena];
-        }
+        slotp->address = address;
+        return nvm_fee_record_entry_read(nvmfeep, arena, slot, &record,
+                address, slotp->payload);
     }
 
-    /* stage 3: Activate destination arena. */
-    result = nvm_fee_arena_state_update(nvmfeep, dst_arena, ARENA_STATE_ACTIVE);
-    if (result != HAL_SUCCESS)
-        return result;
-
-    /* stage 4: Reinit source arena. */
-    result = nvm_fee_arena_erase(nvmfeep, src_arena);
-    if (result != HAL_SUCCESS)
-        return result;
-
-    /* Update driver state. */
-    nvmfeep->arena_active = dst_arena;
+    /* No existing slot so initialize a pristine one. */
+    slotp->address = address;
+    memset(slotp->payload, 0xff, sizeof(slotp->payload));
 
     return HAL_SUCCESS;
 }
 
-static bool nvm_fee_read(NVMFeeDriver* nvmfeep, uint32_t arena,
-        uint32_t startaddr, uint32_t n, uint8_t* buffer)
+static bool nvm_fee_append_begin(NVMFeeDriver* nvmfeep,
+        struct record_writer* writerp, const struct slot* slotp,
+        uint32_t slots, uint32_t omit_addr)
 {
     osalDbgCheck((nvmfeep != NULL));
 
-    const uint32_t first_slot_addr = startaddr -
-            (startaddr % NVM_FEE_SLOT_PAYLOAD_SIZE);
-    const uint32_t last_slot_addr = (startaddr + n) -
-            ((startaddr + n) % NVM_FEE_SLOT_PAYLOAD_SIZE);
-    const uint32_t pre_pad = startaddr % NVM_FEE_SLOT_PAYLOAD_SIZE;
-    const uint32_t post_pad = NVM_FEE_SLOT_PAYLOAD_SIZE -
-            ((startaddr + n) % NVM_FEE_SLOT_PAYLOAD_SIZE);
+    bool collected = false;
+    bool result;
 
-    /* Initially set all content to 0xff. */
-    for (uint32_t i = 0; i < n; ++i)
-        buffer[i] = 0xff;
+#if NVM_FEE_USE_GC_THREAD
+    const systime_t start = osalOsGetSystemTimeX();
+#endif /* NVM_FEE_USE_GC_THREAD */
 
-    /* Walk through active slots. */
-    for (uint32_t slot = 0;
-            slot < nvmfeep->arena_slots[nvmfeep->arena_active];
-            ++slot)
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
     {
-        bool result;
-
-        /* Read slot. */
-        struct slot temp_slot;
-        result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
+        /* Make room in the newest sector. */
+        result = nvm_fee_ring_reserve(nvmfeep, slots, &collected);
         if (result != HAL_SUCCESS)
             return result;
 
-        /* Skip if slot is not valid. */
-        if (nvm_fee_mark_2_slot_state(temp_slot.state_mark) !=
-                SLOT_STATE_VALID)
-            continue;
-
-        /* Check if slot's data is within our desired range. */
-        if (temp_slot.address == first_slot_addr)
-        {
-            /* First (partial) slot */
-            uint32_t n_slot = NVM_FEE_SLOT_PAYLOAD_SIZE - pre_pad;
-            if (n_slot > n)
-                n_slot = n;
-            memcpy(buffer,
-                    temp_slot.payload + pre_pad,
-                    n_slot);
-        }
-        else if (temp_slot.address == last_slot_addr)
-        {
-            /* Last (partial) slot */
-            memcpy(buffer + n - (NVM_FEE_SLOT_PAYLOAD_SIZE - post_pad),
-                    temp_slot.payload,
-                    NVM_FEE_SLOT_PAYLOAD_SIZE - post_pad);
-        }
-        else if (temp_slot.address > first_slot_addr &&
-                temp_slot.address < last_slot_addr)
+        nvm_fee_writer_begin(nvmfeep, writerp, nvm_fee_ring_head(nvmfeep),
+                &nvmfeep->ring_head_slots, slotp->address, slotp->payload);
+    }
+    else
+    {
+        /* Check if arena is full and execute garbage collection. */
+        if (nvmfeep->arena_slots[nvmfeep->arena_active] + slots >
+                nvmfeep->arena_num_slots)
         {
-            /* Full slot */
-            memcpy(buffer + temp_slot.address - startaddr,
-                    temp_slot.payload,
-                    NVM_FEE_SLOT_PAYLOAD_SIZE);
+            result = nvm_fee_gc(nvmfeep, omit_addr);
+            collected = true;
+            if (result != HAL_SUCCESS)
+                return result;
+
+            if (nvmfeep->arena_slots[nvmfeep->arena_active] + slots >
+                    nvmfeep->arena_num_slots)
+                return HAL_FAILED;
         }
+
+        nvm_fee_writer_begin(nvmfeep, writerp, nvmfeep->arena_active,
+                &nvmfeep->arena_slots[nvmfeep->arena_active],
+                slotp->address, slotp->payload);
+    }
+
+#if NVM_FEE_USE_GC_THREAD
+    /* The writer had to wait for garbage collection. */
+    if (collected == true)
+    {
+        const sysinterval_t elapsed = chVTTimeElapsedSinceX(start);
+
+        nvmfeep->gc_info.foreground++;
+        if (elapsed > nvmfeep->gc_info.foreground_max)
+            nvmfeep->gc_info.foreground_max = elapsed;
     }
+#else
+    (void)collected;
+#endif /* NVM_FEE_USE_GC_THREAD */
 
     return HAL_SUCCESS;
 }
 
-static int memtst(const void* block, int c, size_t size)
+static bool nvm_fee_append_end(NVMFeeDriver* nvmfeep,
+        struct record_writer* writerp, uint32_t startaddr, uint32_t endaddr,
+        const uint8_t* buffer, uint8_t pattern)
 {
-    for (size_t i = 0; i < size; ++i)
-        if (((uint8_t*)block)[i] != c)
-            return 1;
-    return 0;
+    osalDbgCheck((nvmfeep != NULL));
+
+    if (writerp->entries == 0)
+        return HAL_SUCCESS;
+
+    const uint32_t entries = writerp->entries;
+
+    /* Write new record. Its slots are consumed even if the write fails. */
+    bool result = nvm_fee_writer_end(nvmfeep, writerp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    nvm_fee_index_update_range(nvmfeep, writerp->address, entries,
+            writerp->present, writerp->arena, writerp->slot);
+#if NVM_FEE_USE_SHADOW
+    /* Bytes of the range not part of the record are unchanged. */
+    if (nvmfeep->shadow != NULL)
+    {
+        if (buffer != NULL)
+            memcpy(nvmfeep->shadow + startaddr, buffer, endaddr - startaddr);
+        else
+            memset(nvmfeep->shadow + startaddr, pattern, endaddr - startaddr);
+    }
+#else
+    (void)startaddr;
+    (void)endaddr;
+    (void)buffer;
+    (void)pattern;
+#endif /* NVM_FEE_USE_SHADOW */
+
+#if NVM_FEE_USE_GC_THREAD
+    nvm_fee_gc_kick(nvmfeep);
+#endif /* NVM_FEE_USE_GC_THREAD */
+
+    return HAL_SUCCESS;
 }
 
-static bool nvm_fee_write(NVMFeeDriver* nvmfeep, uint32_t arena,
-        uint32_t startaddr, uint32_t n, const uint8_t* buffer)
+static bool nvm_fee_read(NVMFeeDriver* nvmfeep, uint32_t startaddr,
+        uint32_t n, uint8_t* buffer)
 {
     osalDbgCheck((nvmfeep != NULL));
 
-    const uint32_t first_slot_addr = startaddr -
-            (startaddr % NVM_FEE_SLOT_PAYLOAD_SIZE);
-    const uint32_t pre_pad = startaddr % NVM_FEE_SLOT_PAYLOAD_SIZE;
+#if NVM_FEE_USE_SHADOW
+    /* Serve read from RAM. */
+    if (nvmfeep->shadow != NULL)
+    {
+        memcpy(buffer, nvmfeep->shadow + startaddr, n);
 
-    bool result;
-    uint32_t n_remaining = n;
-    uint32_t addr = startaddr;
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_FEE_USE_SHADOW */
 
-    /* First (partial) slot */
-    if (pre_pad)
+#if NVM_FEE_USE_INDEX
+    /* Fetch slot by slot if the RAM index covers the whole range. */
+    if ((startaddr + n + NVM_FEE_SLOT_PAYLOAD_SIZE - 1) /
+            NVM_FEE_SLOT_PAYLOAD_SIZE <= nvmfeep->index_num)
     {
-        /* Look for existing slot. */
-        struct slot temp_slot;
-        bool found;
-        uint32_t slot;
-
-        result = nvm_fee_slot_lookup(nvmfeep, arena, first_slot_addr,
-                &slot, &found);
-        if (result != HAL_SUCCESS)
-            return result;
+        uint32_t addr = startaddr;
+        uint32_t n_remaining = n;
 
-        if (found == true)
+        while (n_remaining)
         {
-            /* Existing slot so read it. */
-            result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
+            const uint32_t pad = addr % NVM_FEE_SLOT_PAYLOAD_SIZE;
+
+            uint32_t n_slot = NVM_FEE_SLOT_PAYLOAD_SIZE - pad;
+            if (n_slot > n_remaining)
+                n_slot = n_remaining;
+
+            struct slot temp_slot;
+            bool result = nvm_fee_slot_fetch(nvmfeep, addr - pad, &temp_slot);
             if (result != HAL_SUCCESS)
                 return result;
-        }
-        else
-        {
-            /* No existing slot so initialize a pristine one with state valid. */
-            temp_slot.state_mark[0] = (write_unit_t)0x0000000000000000ULL;
-            temp_slot.state_mark[1] = (write_unit_t)0x0000000000000000ULL;
-            temp_slot.address = first_slot_addr;
-            memset(temp_slot.payload, 0xff, sizeof(temp_slot.payload));
+
+            memcpy(buffer + (addr - startaddr), temp_slot.payload + pad,
+                    n_slot);
+
+            addr += n_slot;
+            n_remaining -= n_slot;
         }
 
-        uint32_t n_slot = NVM_FEE_SLOT_PAYLOAD_SIZE - pre_pad;
-        if (n_slot > n_remaining)
-            n_slot = n_remaining;
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_FEE_USE_INDEX */
 
-        /* Compare slot data. */
-        if (memcmp(temp_slot.payload + pre_pad, buffer, n_slot) != 0)
+    const uint32_t first_slot_addr = startaddr -
+            (startaddr % NVM_FEE_SLOT_PAYLOAD_SIZE);
+
+    /* Initially set all content to 0xff. */
+    for (uint32_t i = 0; i < n; ++i)
+        buffer[i] = 0xff;
+
+    /* Walk through used records. */
+    for (uint32_t unit = 0; unit < nvm_fee_log_units(nvmfeep); ++unit)
+    {
+        const uint32_t arena = nvm_fee_log_arena(nvmfeep, unit);
+        const uint32_t used = nvm_fee_log_used(nvmfeep, unit);
+
+        struct record record;
+        for (uint32_t slot = 0; slot < used; slot += record.slots)
         {
-            /* Update slot data. */
-            memcpy(temp_slot.payload + pre_pad, buffer, n_slot);
+            bool result;
 
-            /* Check if arena is full and execute garbage collection. */
-            if (nvmfeep->arena_slots[nvmfeep->arena_active] ==
-                    nvmfeep->arena_num_slots)
+            /* Read record. */
+            result = nvm_fee_record_read(nvmfeep, arena, slot, &record, true);
+            if (result != HAL_SUCCESS)
+                return result;
+
+            /* Skip if record is not valid. */
+            if (record.state != SLOT_STATE_VALID)
+                continue;
+
+            /* Copy payloads within our desired range. */
+            uint32_t end;
+            for (uint32_t i = nvm_fee_record_clip(&record,
+                            first_slot_addr / NVM_FEE_SLOT_PAYLOAD_SIZE,
+                            (startaddr + n - first_slot_addr +
+                                    NVM_FEE_SLOT_PAYLOAD_SIZE - 1) /
+                                    NVM_FEE_SLOT_PAYLOAD_SIZE, &end);
+                    i < end;
+                    ++i)
             {
-                result = nvm_fee_gc(nvmfeep, temp_slot.address);
+                const uint32_t addr = record.address +
+                        i * NVM_FEE_SLOT_PAYLOAD_SIZE;
+                if (nvm_fee_record_has(&record, i) == false)
+                    continue;
+
+                uint8_t payload[NVM_FEE_SLOT_PAYLOAD_SIZE];
+                result = nvm_fee_record_entry_read(nvmfeep, arena, slot,
+                        &record, addr, payload);
                 if (result != HAL_SUCCESS)
                     return result;
+
+                /* First and last slot may be partial. */
+                const uint32_t from = addr > startaddr ? addr : startaddr;
+                const uint32_t to =
+                        addr + NVM_FEE_SLOT_PAYLOAD_SIZE < startaddr + n ?
+                        addr + NVM_FEE_SLOT_PAYLOAD_SIZE : startaddr + n;
+                memcpy(buffer + (from - startaddr), payload + (from - addr),
+                        to - from);
             }
+        }
+    }
 
-            /* Write new slot. */
-            result = nvm_fee_slot_write(nvmfeep, nvmfeep->arena_active,
-                    nvmfeep->arena_slots[nvmfeep->arena_active], &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
+    return HAL_SUCCESS;
+}
 
-            ++nvmfeep->arena_slots[nvmfeep->arena_active];
-        }
+static bool nvm_fee_write(NVMFeeDriver* nvmfeep, uint32_t startaddr,
+        uint32_t n, const uint8_t* buffer)
+{
+    osalDbgCheck((nvmfeep != NULL));
 
-        addr += n_slot;
-        n_remaining -= n_slot;
-    }
+    struct record_writer writer;
+    uint32_t n_remaining = n;
+    uint32_t addr = startaddr;
+    uint32_t record_addr = startaddr;
+    bool result;
 
-    /* Full slots */
-    while (n_remaining >= NVM_FEE_SLOT_PAYLOAD_SIZE)
+    writer.entries = 0;
+
+    /* Note: Garbage collection may switch the active arena, so lookups
+     *       always refer to the currently active one. */
+    while (n_remaining)
     {
+        /* Offset within a first / last (partial) slot. */
+        const uint32_t pad = addr % NVM_FEE_SLOT_PAYLOAD_SIZE;
+
+        uint32_t n_slot = NVM_FEE_SLOT_PAYLOAD_SIZE - pad;
+        if (n_slot > n_remaining)
+            n_slot = n_remaining;
+
         /* Look for existing slot. */
         struct slot temp_slot;
-        bool found;
-        uint32_t slot;
 
-        result = nvm_fee_slot_lookup(nvmfeep, arena, addr,
-                &slot, &found);
+        result = nvm_fee_slot_fetch(nvmfeep, addr - pad, &temp_slot);
         if (result != HAL_SUCCESS)
             return result;
 
-        if (found == true)
-        {
-            /* Existing slot so read it. */
-            result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
-        }
-        else
-        {
-            /* No existing slot so initialize a pristine one with state valid. */
-            temp_slot.state_mark[0] = (write_unit_t)0x0000000000000000ULL;
-            temp_slot.state_mark[1] = (write_unit_t)0x0000000000000000ULL;
-            temp_slot.address = addr;
-            memset(temp_slot.payload, 0xff, sizeof(temp_slot.payload));
-        }
-
-        uint32_t n_slot = NVM_FEE_SLOT_PAYLOAD_SIZE;
-
         /* Compare slot data. */
-        if (memcmp(temp_slot.payload, buffer + (addr - startaddr), n_slot) != 0)
+        if (memcmp(temp_slot.payload + pad, buffer + (addr - startaddr),
+                n_slot) != 0)
         {
             /* Update slot data. */
-            memcpy(temp_slot.payload, buffer + (addr - startaddr), n_slot);
+            memcpy(temp_slot.payload + pad, buffer + (addr - startaddr),
+                    n_slot);
 
-            /* Check if arena is full and execute garbage collection. */
-            if (nvmfeep->arena_slots[nvmfeep->arena_active] ==
-                    nvmfeep->arena_num_slots)
+            /* Extend the current record or start a new one. */
+            if (nvm_fee_writer_room(nvmfeep, &writer, temp_slot.address))
             {
-                result = nvm_fee_gc(nvmfeep, temp_slot.address);
-                if (result != HAL_SUCCESS)
-                    return result;
+                result = nvm_fee_writer_add(nvmfeep, &writer,
+                        temp_slot.payload);
+            }
+            else
+            {
+                result = nvm_fee_append_end(nvmfeep, &writer, record_addr,
+                        addr, buffer + (record_addr - startaddr), 0);
+                if (result == HAL_SUCCESS)
+                    result = nvm_fee_append_begin(nvmfeep, &writer,
+                            &temp_slot, 1, temp_slot.address);
+                record_addr = addr;
             }
-
-            /* Write new slot. */
-            result = nvm_fee_slot_write(nvmfeep, nvmfeep->arena_active,
-                    nvmfeep->arena_slots[nvmfeep->arena_active], &temp_slot);
             if (result != HAL_SUCCESS)
                 return result;
-
-            ++nvmfeep->arena_slots[nvmfeep->arena_active];
         }
 
         addr += n_slot;
         n_remaining -= n_slot;
     }
 
-    /* Last (partial) slot */
-    if (n_remaining)
+    return nvm_fee_append_end(nvmfeep, &writer, record_addr, addr,
+            buffer + (record_addr - startaddr), 0);
+}
+
+static bool nvm_fee_write_pattern(NVMFeeDriver* nvmfeep, uint32_t startaddr,
+        uint32_t n, uint8_t pattern)
+{
+    osalDbgCheck((nvmfeep != NULL));
+
+    struct record_writer writer;
+    uint32_t n_remaining = n;
+    uint32_t addr = startaddr;
+    uint32_t record_addr = startaddr;
+    bool result;
+
+    writer.entries = 0;
+
+    while (n_remaining)
     {
+        /* Offset within a first / last (partial) slot. */
+        const uint32_t pad = addr % NVM_FEE_SLOT_PAYLOAD_SIZE;
+
+        uint32_t n_slot = NVM_FEE_SLOT_PAYLOAD_SIZE - pad;
+        if (n_slot > n_remaining)
+            n_slot = n_remaining;
+
         /* Look for existing slot. */
         struct slot temp_slot;
-        bool found;
-        uint32_t slot;
 
-        result = nvm_fee_slot_lookup(nvmfeep, arena, addr, &slot, &found);
+        result = nvm_fee_slot_fetch(nvmfeep, addr - pad, &temp_slot);
         if (result != HAL_SUCCESS)
             return result;
 
-        if (found == true)
-        {
-            /* Existing slot so read it. */
-            result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
-        }
-        else
-        {
-            /* No existing slot so initialize a pristine one. */
-            temp_slot.address = addr;
-            memset(temp_slot.payload, 0xff, sizeof(temp_slot.payload));
-        }
-
-        uint32_t n_slot = n_remaining;
-
         /* Compare slot data. */
-        if (memcmp(temp_slot.payload, buffer + (addr - startaddr), n_slot) != 0)
+        if (memtst(temp_slot.payload + pad, pattern, n_slot) != 0)
         {
             /* Update slot data. */
-            memcpy(temp_slot.payload, buffer + (addr - startaddr), n_slot);
+            memset(temp_slot.payload + pad, pattern, n_slot);
 
-            /* Check if arena is full and execute garbage collection. */
-            if (nvmfeep->arena_slots[nvmfeep->arena_active] ==
-                    nvmfeep->arena_num_slots)
+            /* Extend the current record or start a new one. */
+            if (nvm_fee_writer_room(nvmfeep, &writer, temp_slot.address))
             {
-                result = nvm_fee_gc(nvmfeep, temp_slot.address);
-                if (result != HAL_SUCCESS)
-                    return result;
+                result = nvm_fee_writer_add(nvmfeep, &writer,
+                        temp_slot.payload);
+            }
+            else
+            {
+                result = nvm_fee_append_end(nvmfeep, &writer, record_addr,
+                        addr, NULL, pattern);
+                if (result == HAL_SUCCESS)
+                    result = nvm_fee_append_begin(nvmfeep, &writer,
+                            &temp_slot, 1, temp_slot.address);
+                record_addr = addr;
             }
-
-            /* Write new slot. */
-            result = nvm_fee_slot_write(nvmfeep, nvmfeep->arena_active,
-                    nvmfeep->arena_slots[nvmfeep->arena_active], &temp_slot);
             if (result != HAL_SUCCESS)
                 return result;
-
-            ++nvmfeep->arena_slots[nvmfeep->arena_active];
         }
 
         addr += n_slot;
         n_remaining -= n_slot;
     }
 
-    return HAL_SUCCESS;
+    return nvm_fee_append_end(nvmfeep, &writer, record_addr, addr,
+            NULL, pattern);
 }
 
-static bool nvm_fee_write_pattern(NVMFeeDriver* nvmfeep, uint32_t arena,
-        uint32_t startaddr, uint32_t n, uint8_t pattern)
+static bool nvm_fee_erase(NVMFeeDriver* nvmfeep, uint32_t startaddr,
+        uint32_t n)
 {
     osalDbgCheck((nvmfeep != NULL));
 
-    const uint32_t first_slot_addr = startaddr -
-            (startaddr % NVM_FEE_SLOT_PAYLOAD_SIZE);
-    const uint32_t pre_pad = startaddr % NVM_FEE_SLOT_PAYLOAD_SIZE;
+    const uint32_t first = (startaddr + NVM_FEE_SLOT_PAYLOAD_SIZE - 1) /
+            NVM_FEE_SLOT_PAYLOAD_SIZE;
+    const uint32_t last = (startaddr + n) / NVM_FEE_SLOT_PAYLOAD_SIZE;
 
     bool result;
-    uint32_t n_remaining = n;
-    uint32_t addr = startaddr;
-
-    /* First (partial) slot */
-    if (pre_pad)
-    {
-        /* Look for existing slot. */
-        struct slot temp_slot;
-        bool found;
-        uint32_t slot;
 
-        result = nvm_fee_slot_lookup(nvmfeep, arena, first_slot_addr,
-                &slot, &found);
-        if (result != HAL_SUCCESS)
-            return result;
+    /* Tombstones cover whole slot payloads within the reach of their
+     * address word, short ranges are cheaper to overwrite. */
+    if (last < first + 2 || nvmfeep->fee_size > NVM_FEE_ADDRESS_MASK + 1)
+        return nvm_fee_write_pattern(nvmfeep, startaddr, n, 0xff);
 
-        if (found == true)
-        {
-            /* Existing slot so read it. */
-            result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
-        }
-        else
-        {
-            /* No existing slot so initialize a pristine one. */
-            temp_slot.address = first_slot_addr;
-            memset(temp_slot.payload, 0xff, sizeof(temp_slot.payload));
-        }
+    /* Partial slots at both ends. */
+    result = nvm_fee_write_pattern(nvmfeep, startaddr,
+            first * NVM_FEE_SLOT_PAYLOAD_SIZE - startaddr, 0xff);
+    if (result != HAL_SUCCESS)
+        return result;
 
-        uint32_t n_slot = NVM_FEE_SLOT_PAYLOAD_SIZE - pre_pad;
-        if (n_slot > n_remaining)
-            n_slot = n_remaining;
+    result = nvm_fee_write_pattern(nvmfeep, last * NVM_FEE_SLOT_PAYLOAD_SIZE,
+            startaddr + n - last * NVM_FEE_SLOT_PAYLOAD_SIZE, 0xff);
+    if (result != HAL_SUCCESS)
+        return result;
 
-        /* Compare slot data. */
-        if (memtst(temp_slot.payload + pre_pad, pattern, n_slot) != 0)
-        {
-            /* Update slot data. */
-            memset(temp_slot.payload + pre_pad, pattern, n_slot);
+    /* Skip the tombstone if the range is erased already. */
+    uint32_t addr = first * NVM_FEE_SLOT_PAYLOAD_SIZE;
+    while (addr < last * NVM_FEE_SLOT_PAYLOAD_SIZE)
+    {
+        uint8_t buffer[64];
 
-            /* Check if arena is full and execute garbage collection. */
-            if (nvmfeep->arena_slots[nvmfeep->arena_active] ==
-                    nvmfeep->arena_num_slots)
-            {
-                result = nvm_fee_gc(nvmfeep, temp_slot.address);
-                if (result != HAL_SUCCESS)
-                    return result;
-            }
+        uint32_t n_chunk = last * NVM_FEE_SLOT_PAYLOAD_SIZE - addr;
+        if (n_chunk > sizeof(buffer))
+            n_chunk = sizeof(buffer);
 
-            /* Write new slot. */
-            result = nvm_fee_slot_write(nvmfeep, nvmfeep->arena_active,
-                    nvmfeep->arena_slots[nvmfeep->arena_active], &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
+        result = nvm_fee_read(nvmfeep, addr, n_chunk, buffer);
+        if (result != HAL_SUCCESS)
+            return result;
 
-            ++nvmfeep->arena_slots[nvmfeep->arena_active];
-        }
+        if (memtst(buffer, 0xff, n_chunk) != 0)
+            break;
 
-        addr += n_slot;
-        n_remaining -= n_slot;
+        addr += n_chunk;
     }
 
-    /* Full slots */
-    while (n_remaining >= NVM_FEE_SLOT_PAYLOAD_SIZE)
+    if (addr == last * NVM_FEE_SLOT_PAYLOAD_SIZE)
+        return HAL_SUCCESS;
+
+    /* A payload too small for the whole count takes several tombstones. */
+    const uint32_t max_entries = NVM_FEE_SLOT_PAYLOAD_SIZE >= 4 ?
+            0xffffffffUL : (1UL << (8 * NVM_FEE_SLOT_PAYLOAD_SIZE)) - 1;
+
+    for (uint32_t entry = first; entry < last;)
     {
-        /* Look for existing slot. */
-        struct slot temp_slot;
-        bool found;
-        uint32_t slot;
+        uint32_t entries = last - entry;
+        if (entries > max_entries)
+            entries = max_entries;
+
+        struct slot tombstone;
+        tombstone.address = NVM_FEE_ADDRESS_TOMBSTONE |
+                (entry * NVM_FEE_SLOT_PAYLOAD_SIZE);
+        memset(tombstone.payload, 0xff, sizeof(tombstone.payload));
+        for (size_t i = 0;
+                i < sizeof(entries) && i < sizeof(tombstone.payload);
+                ++i)
+            tombstone.payload[i] = (uint8_t)(entries >> (8 * i));
+
+        /* Garbage collection may drop an address about to be erased. */
+        struct record_writer writer;
+        result = nvm_fee_append_begin(nvmfeep, &writer, &tombstone, 1,
+                entry * NVM_FEE_SLOT_PAYLOAD_SIZE);
+        if (result != HAL_SUCCESS)
+            return result;
 
-        result = nvm_fee_slot_lookup(nvmfeep, arena, addr,
-                &slot, &found);
+        result = nvm_fee_append_end(nvmfeep, &writer,
+                entry * NVM_FEE_SLOT_PAYLOAD_SIZE,
+                (entry + entries) * NVM_FEE_SLOT_PAYLOAD_SIZE, NULL, 0xff);
         if (result != HAL_SUCCESS)
             return result;
 
-        if (found == true)
-        {
-            /* Existing slot so read it. */
-            result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
-        }
-        else
-        {
-            /* No existing slot so initialize a pristine one. */
-            temp_slot.address = addr;
-            memset(temp_slot.payload, 0xff, sizeof(temp_slot.payload));
-        }
+        /* The tombstone itself is not indexed, erased addresses have no
+         * slot. */
+        nvm_fee_index_drop_range(nvmfeep, entry * NVM_FEE_SLOT_PAYLOAD_SIZE,
+                entries);
 
-        uint32_t n_slot = NVM_FEE_SLOT_PAYLOAD_SIZE;
+        entry += entries;
+    }
 
-        /* Compare slot data. */
-        if (memtst(temp_slot.payload, pattern, n_slot) != 0)
-        {
-            /* Update slot data. */
-            memset(temp_slot.payload, pattern, n_slot);
+    return HAL_SUCCESS;
+}
+
+#if NVM_FEE_USE_KV
+static bool nvm_fee_kv_append(NVMFeeDriver* nvmfeep, uint32_t word,
+        const uint8_t* buffer, uint32_t length)
+{
+    osalDbgCheck((nvmfeep != NULL));
 
-            /* Check if arena is full and execute garbage collection. */
-            if (nvmfeep->arena_slots[nvmfeep->arena_active] ==
-                    nvmfeep->arena_num_slots)
-            {
-                result = nvm_fee_gc(nvmfeep, temp_slot.address);
-                if (result != HAL_SUCCESS)
-                    return result;
-            }
+    const uint32_t key = (word >> NVM_FEE_ADDRESS_KEY_POS) & 0xffff;
+
+    bool result;
 
-            /* Write new slot. */
-            result = nvm_fee_slot_write(nvmfeep, nvmfeep->arena_active,
-                    nvmfeep->arena_slots[nvmfeep->arena_active], &temp_slot);
+    /* Key/value records need an arena or sector of the extent format. */
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+    {
+        while (nvm_fee_arena_format(nvmfeep, nvm_fee_ring_head(nvmfeep)) !=
+                NVM_FEE_FORMAT_EXTENTS)
+        {
+            if (nvmfeep->ring_sectors < nvmfeep->llnvmdi.sector_num - 1)
+                result = nvm_fee_ring_open(nvmfeep);
+            else
+                result = nvm_fee_ring_reclaim(nvmfeep);
             if (result != HAL_SUCCESS)
                 return result;
-
-            ++nvmfeep->arena_slots[nvmfeep->arena_active];
         }
-
-        addr += n_slot;
-        n_remaining -= n_slot;
     }
+    else if (nvm_fee_arena_format(nvmfeep, nvmfeep->arena_active) !=
+            NVM_FEE_FORMAT_EXTENTS)
+    {
+        result = nvm_fee_gc(nvmfeep, 0xffffffff);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    /* The first slot holds the first bytes of the value. */
+    struct slot temp_slot;
+    temp_slot.address = word;
+    memset(temp_slot.payload, 0xff, sizeof(temp_slot.payload));
+    if (length > 0)
+        memcpy(temp_slot.payload, buffer,
+                length < NVM_FEE_SLOT_PAYLOAD_SIZE ?
+                        length : NVM_FEE_SLOT_PAYLOAD_SIZE);
+
+    /* Room for the record is reserved, no address has to be omitted. */
+    struct record_writer writer;
+    result = nvm_fee_append_begin(nvmfeep, &writer, &temp_slot,
+            nvm_fee_kv_slots(length), 0xffffffff);
+    if (result != HAL_SUCCESS)
+        return result;
 
-    /* Last (partial) slot */
-    if (n_remaining)
+    /* The rest is packed like the payloads of an extent. */
+    for (uint32_t offset = NVM_FEE_SLOT_PAYLOAD_SIZE;
+            offset < length;
+            offset += NVM_FEE_SLOT_PAYLOAD_SIZE)
     {
-        /* Look for existing slot. */
-        struct slot temp_slot;
-        bool found;
-        uint32_t slot;
+        uint8_t payload[NVM_FEE_SLOT_PAYLOAD_SIZE];
+        memset(payload, 0xff, sizeof(payload));
+        memcpy(payload, buffer + offset,
+                length - offset < NVM_FEE_SLOT_PAYLOAD_SIZE ?
+                        length - offset : NVM_FEE_SLOT_PAYLOAD_SIZE);
 
-        result = nvm_fee_slot_lookup(nvmfeep, arena, addr,
-                &slot, &found);
+        result = nvm_fee_writer_add(nvmfeep, &writer, payload);
         if (result != HAL_SUCCESS)
             return result;
+    }
 
-        if (found == true)
-        {
-            /* Existing slot so read it. */
-            result = nvm_fee_slot_read(nvmfeep, arena, slot, &temp_slot);
-            if (result != HAL_SUCCESS)
-                return result;
-        }
-        else
-        {
-            /* No existing slot so initialize a pristine one. */
-            temp_slot.address = addr;
-            memset(temp_slot.payload, 0xff, sizeof(temp_slot.payload));
-        }
+    /* Write new record. Its slots are consumed even if the write fails. */
+    result = nvm_fee_writer_end(nvmfeep, &writer);
+    if (result != HAL_SUCCESS)
+        return result;
 
-        uint32_t n_slot = n_remaining;
+    if ((word & NVM_FEE_ADDRESS_KIND_MASK) == NVM_FEE_ADDRESS_KV_DELETE)
+        nvm_fee_kv_drop(nvmfeep, nvm_fee_kv_find(nvmfeep, key));
+    else
+        nvm_fee_kv_update(nvmfeep, key, length, writer.arena, writer.slot);
 
-        /* Compare slot data. */
-        if (memtst(temp_slot.payload, pattern, n_slot) != 0)
-        {
-            /* Update slot data. */
-            memset(temp_slot.payload, pattern, n_slot);
+#if NVM_FEE_USE_GC_THREAD
+    nvm_fee_gc_kick(nvmfeep);
+#endif /* NVM_FEE_USE_GC_THREAD */
 
-            /* Check if arena is full and execute garbage collection. */
-            if (nvmfeep->arena_slots[nvmfeep->arena_active] ==
-                    nvmfeep->arena_num_slots)
-            {
-                result = nvm_fee_gc(nvmfeep, temp_slot.address);
-                if (result != HAL_SUCCESS)
-                    return result;
-            }
+    return HAL_SUCCESS;
+}
+
+static bool nvm_fee_kv_put(NVMFeeDriver* nvmfeep, uint32_t key,
+        const uint8_t* buffer, uint32_t length)
+{
+    osalDbgCheck((nvmfeep != NULL));
 
-            /* Write new slot. */
-            result = nvm_fee_slot_write(nvmfeep, nvmfeep->arena_active,
-                    nvmfeep->arena_slots[nvmfeep->arena_active], &temp_slot);
+    const nvmfeekv_t* kvp = nvm_fee_kv_find(nvmfeep, key);
+
+    bool result;
+
+    if (kvp->slot == NVM_FEE_KV_NONE)
+    {
+        /* Room is only reserved for so many keys. */
+        if (nvmfeep->kv_count >= nvmfeeGetKvKeysMax(nvmfeep))
+            return HAL_FAILED;
+    }
+    else if (kvp->length == length)
+    {
+        /* Compare with current value to avoid unnecessary writes. */
+        uint32_t offset;
+        for (offset = 0;
+                offset < length;
+                offset += NVM_FEE_SLOT_PAYLOAD_SIZE)
+        {
+            const uint32_t n = length - offset < NVM_FEE_SLOT_PAYLOAD_SIZE ?
+                    length - offset : NVM_FEE_SLOT_PAYLOAD_SIZE;
+
+            uint8_t payload[NVM_FEE_SLOT_PAYLOAD_SIZE];
+            result = nvm_fee_kv_read(nvmfeep, kvp, offset, n, payload);
             if (result != HAL_SUCCESS)
                 return result;
 
-            ++nvmfeep->arena_slots[nvmfeep->arena_active];
+            if (memcmp(payload, buffer + offset, n) != 0)
+                break;
         }
 
-        addr += n_slot;
-        n_remaining -= n_slot;
+        if (offset >= length)
+            return HAL_SUCCESS;
     }
 
-    return HAL_SUCCESS;
+    return nvm_fee_kv_append(nvmfeep, NVM_FEE_ADDRESS_KV |
+            (key << NVM_FEE_ADDRESS_KEY_POS) | length, buffer, length);
 }
+#endif /* NVM_FEE_USE_KV */
 
 /*===========================================================================*/
 /* Driver exported functions.                                                */
@@ -979,6 +3286,39 @@ void nvmfeeObjectInit(NVMFeeDriver* nvmfeep)
     nvmfeep->arena_active = 0;
     nvmfeep->arena_slots[0] = 0;
     nvmfeep->arena_slots[1] = 0;
+    nvmfeep->arena_format[0] = NVM_FEE_FORMAT_MARKS;
+    nvmfeep->arena_format[1] = NVM_FEE_FORMAT_MARKS;
+    nvmfeep->ring_tail = 0;
+    nvmfeep->ring_sectors = 0;
+    nvmfeep->ring_head_slots = 0;
+    nvmfeep->ring_sequence = 0;
+    nvmfeep->ring_foreign = 0;
+    nvmfeep->ring_format_sector = 0xffffffff;
+    nvmfeep->ring_format = NVM_FEE_FORMAT_MARKS;
+#if NVM_FEE_USE_INDEX
+    nvmfeep->index_num = 0;
+#endif /* NVM_FEE_USE_INDEX */
+#if NVM_FEE_USE_SHADOW
+    nvmfeep->shadow = NULL;
+#endif /* NVM_FEE_USE_SHADOW */
+#if NVM_FEE_USE_GC_THREAD
+    memset(&nvmfeep->gc_info, 0, sizeof(nvmfeep->gc_info));
+    nvmfeep->gc_mark = 0;
+    nvmfeep->gc_cursor = 0;
+    nvmfeep->gc_pending = false;
+    nvmfeep->gc_thread = NULL;
+    nvmfeep->gc_wait = NULL;
+
+    /* Filling the thread working area here because the function
+       @p chThdCreateI() does not do it.*/
+#if CH_DBG_FILL_THREADS
+    {
+        _thread_memfill((uint8_t*)THD_WORKING_AREA_BASE(nvmfeep->gc_wa),
+            (uint8_t*)THD_WORKING_AREA_END(nvmfeep->gc_wa),
+            CH_DBG_STACK_FILL_VALUE);
+    }
+#endif /* CH_DBG_FILL_THREADS */
+#endif /* NVM_FEE_USE_GC_THREAD */
 }
 
 /**
@@ -997,18 +3337,133 @@ void nvmfeeStart(NVMFeeDriver* nvmfeep, const NVMFeeConfig* config)
             "invalid state");
 
     nvmfeep->config = config;
+    nvmfeep->format = config->format;
 
     /* Calculate and cache often reused values. */
     nvmGetInfo(nvmfeep->config->nvmp, &nvmfeep->llnvmdi);
 
-    nvmfeep->arena_num_sectors = nvmfeep->llnvmdi.sector_num / 2;
-    nvmfeep->arena_num_slots =
-            (nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size
-                    - sizeof(struct arena_header)) /
-            sizeof(struct slot);
-    nvmfeep->fee_size = nvmfeep->arena_num_slots * NVM_FEE_SLOT_PAYLOAD_SIZE;
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+    {
+        osalDbgAssert(nvmfeep->llnvmdi.sector_num >= 3, "too few sectors");
+
+        /* Every sector is an arena. One sector is kept erased and one
+         * sector worth of slots is left for outdated copies. */
+        nvmfeep->arena_num_sectors = 1;
+        nvmfeep->arena_num_slots =
+                (nvmfeep->llnvmdi.sector_size - sizeof(struct arena_header)) /
+                sizeof(struct slot);
+        nvmfeep->fee_size = (nvmfeep->llnvmdi.sector_num - 2) *
+                nvmfeep->arena_num_slots * NVM_FEE_SLOT_PAYLOAD_SIZE;
+    }
+    else
+    {
+        nvmfeep->arena_num_sectors = nvmfeep->llnvmdi.sector_num / 2;
+        nvmfeep->arena_num_slots =
+                (nvmfeep->arena_num_sectors * nvmfeep->llnvmdi.sector_size
+                        - sizeof(struct arena_header)) /
+                sizeof(struct slot);
+        nvmfeep->fee_size = nvmfeep->arena_num_slots * NVM_FEE_SLOT_PAYLOAD_SIZE;
+    }
+
+#if NVM_FEE_USE_KV
+    /* Setup key/value hash table. Room for every key holding a value of
+     * the maximum length, and for one more record, is taken from the
+     * virtual address room. */
+    nvmfeep->kv_num = 0;
+    nvmfeep->kv_count = 0;
+    if (nvmfeep->config->kv != NULL)
+    {
+        osalDbgAssert(nvmfeep->config->format == NVM_FEE_FORMAT_EXTENTS,
+                "key/value records require extents");
+
+        nvmfeep->kv_num = nvmfeep->config->kv_num;
+
+        const uint32_t slots = nvm_fee_kv_slots(NVM_FEE_KV_VALUE_SIZE);
+        uint32_t reserve = (nvmfeeGetKvKeysMax(nvmfeep) + 1) * slots;
+
+        /* Records are not split across sectors. */
+        if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+            reserve += nvmfeep->llnvmdi.sector_num * (slots - 1);
+
+        osalDbgAssert(reserve * NVM_FEE_SLOT_PAYLOAD_SIZE < nvmfeep->fee_size,
+                "hash table too large");
+
+        nvmfeep->fee_size -= reserve * NVM_FEE_SLOT_PAYLOAD_SIZE;
+    }
+#endif /* NVM_FEE_USE_KV */
+
+    /* Extent records hold addresses of limited width. */
+    osalDbgAssert(nvmfeep->format != NVM_FEE_FORMAT_EXTENTS ||
+            nvmfeep->fee_size <= NVM_FEE_ADDRESS_MASK + 1,
+            "too large for extents");
+
+#if NVM_FEE_USE_INDEX
+    /* Setup RAM index covering as many addresses as configured. */
+    nvmfeep->index_num = 0;
+    if (nvmfeep->config->index != NULL)
+    {
+        /* Verify slot numbers can be represented by an index entry. */
+        osalDbgAssert(nvmfeep->arena_num_slots *
+                (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING ?
+                        nvmfeep->llnvmdi.sector_num : 1) < NVM_FEE_INDEX_NONE,
+                "index entry too small");
+
+        nvmfeep->index_num = nvmfeep->config->index_num;
+        if (nvmfeep->index_num >
+                nvmfeep->fee_size / NVM_FEE_SLOT_PAYLOAD_SIZE)
+            nvmfeep->index_num =
+                    nvmfeep->fee_size / NVM_FEE_SLOT_PAYLOAD_SIZE;
+    }
+
+    /* Reclaiming a sector of the ring layout looks up the newest slot of
+     * every address it holds, scanning the log for them would take time
+     * quadratic in its size. */
+    osalDbgAssert(nvmfeep->config->layout != NVM_FEE_LAYOUT_RING ||
+            nvmfeep->index_num ==
+                    nvmfeep->fee_size / NVM_FEE_SLOT_PAYLOAD_SIZE,
+            "ring layout requires a full index");
+#else
+    osalDbgAssert(nvmfeep->config->layout != NVM_FEE_LAYOUT_RING,
+            "ring layout requires NVM_FEE_USE_INDEX");
+#endif /* NVM_FEE_USE_INDEX */
+
+#if NVM_FEE_USE_SHADOW
+    /* Setup RAM shadow image if it can hold the whole address room. */
+    nvmfeep->shadow = NULL;
+    if (nvmfeep->config->shadow != NULL)
+    {
+        osalDbgAssert(nvmfeep->config->shadow_size >= nvmfeep->fee_size,
+                "shadow too small");
+
+        if (nvmfeep->config->shadow_size >= nvmfeep->fee_size)
+            nvmfeep->shadow = nvmfeep->config->shadow;
+    }
+#endif /* NVM_FEE_USE_SHADOW */
+
+#if NVM_FEE_USE_GC_THREAD
+    osalDbgAssert(nvmfeep->config->gc_high_watermark == 0 ||
+            (nvmfeep->config->gc_low_watermark <
+                    nvmfeep->config->gc_high_watermark &&
+             nvmfeep->config->gc_high_watermark <= 100),
+            "invalid watermarks");
+    /* Collecting an arena is a single step, the thread would hold the
+     * lock for as long as a writer waits for it. */
+    osalDbgAssert(nvmfeep->config->gc_high_watermark == 0 ||
+            nvmfeep->config->layout == NVM_FEE_LAYOUT_RING,
+            "background collection requires the ring layout");
+#endif /* NVM_FEE_USE_GC_THREAD */
+
+    bool result;
 
     /* Check state and recover if necessary. */
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+    {
+        result = nvm_fee_ring_mount(nvmfeep);
+        if (result != HAL_SUCCESS)
+            goto out_error;
+
+        goto out_ready;
+    }
 
     /* Examine active arena. */
     const enum arena_state states[2] =
@@ -1021,27 +3476,45 @@ void nvmfeeStart(NVMFeeDriver* nvmfeep, const NVMFeeConfig* config)
      *
      * - active / unused
      * - unused / active
+     * - active / unknown, reinit got interrupted
+     * - unknown / active, reinit got interrupted
      * - frozen / any
      * - any / frozen
      * - anything else
      *
      */
 
-    bool result;
-
-    if (states[0] == ARENA_STATE_ACTIVE && states[1] == ARENA_STATE_UNUSED)
+    if (states[0] == ARENA_STATE_ACTIVE &&
+            states[1] != ARENA_STATE_ACTIVE && states[1] != ARENA_STATE_FROZEN)
     {
+        /* Clear arena 1 unless cleanly erased. */
+        if (states[1] != ARENA_STATE_UNUSED)
+        {
+            result = nvm_fee_arena_erase(nvmfeep, 1);
+            if (result != HAL_SUCCESS)
+                goto out_error;
+        }
+
         /* Load arena 0 as active arena. */
         nvmfeep->arena_active = 0;
-        result = nvm_fee_arena_load(nvmfeep, 0);
+        result = nvm_fee_log_mount(nvmfeep);
         if (result != HAL_SUCCESS)
             goto out_error;
     }
-    else if (states[0] == ARENA_STATE_UNUSED && states[1] == ARENA_STATE_ACTIVE)
+    else if (states[1] == ARENA_STATE_ACTIVE &&
+            states[0] != ARENA_STATE_ACTIVE && states[0] != ARENA_STATE_FROZEN)
     {
-        /* Load arena 0 as active arena. */
+        /* Clear arena 0 unless cleanly erased. */
+        if (states[0] != ARENA_STATE_UNUSED)
+        {
+            result = nvm_fee_arena_erase(nvmfeep, 0);
+            if (result != HAL_SUCCESS)
+                goto out_error;
+        }
+
+        /* Load arena 1 as active arena. */
         nvmfeep->arena_active = 1;
-        result = nvm_fee_arena_load(nvmfeep, 1);
+        result = nvm_fee_log_mount(nvmfeep);
         if (result != HAL_SUCCESS)
             goto out_error;
     }
@@ -1054,7 +3527,7 @@ void nvmfeeStart(NVMFeeDriver* nvmfeep, const NVMFeeConfig* config)
 
         /* Load arena 0 as active arena. */
         nvmfeep->arena_active = 0;
-        result = nvm_fee_arena_load(nvmfeep, 0);
+        result = nvm_fee_log_mount(nvmfeep);
         if (result != HAL_SUCCESS)
             goto out_error;
 
@@ -1072,7 +3545,7 @@ void nvmfeeStart(NVMFeeDriver* nvmfeep, const NVMFeeConfig* config)
 
         /* Load arena 1 as active arena. */
         nvmfeep->arena_active = 1;
-        result = nvm_fee_arena_load(nvmfeep, 1);
+        result = nvm_fee_log_mount(nvmfeep);
         if (result != HAL_SUCCESS)
             goto out_error;
 
@@ -1098,9 +3571,42 @@ void nvmfeeStart(NVMFeeDriver* nvmfeep, const NVMFeeConfig* config)
 
         nvmfeep->arena_active = 0;
         nvmfeep->arena_slots[0] = 0;
+        nvm_fee_index_clear(nvmfeep);
+#if NVM_FEE_USE_SHADOW
+        if (nvmfeep->shadow != NULL)
+            memset(nvmfeep->shadow, 0xff, nvmfeep->fee_size);
+#endif /* NVM_FEE_USE_SHADOW */
+#if NVM_FEE_USE_KV
+        nvm_fee_kv_clear(nvmfeep);
+#endif /* NVM_FEE_USE_KV */
     }
 
+out_ready:
     nvmfeep->state = NVM_READY;
+
+#if NVM_FEE_USE_GC_THREAD
+    osalSysLock();
+    /* Creates the garbage collection thread. Note, it is created only
+       once.*/
+    if (nvmfeep->gc_thread == NULL)
+    {
+        thread_descriptor_t gc_descriptor = {
+          "nvm_fee_gc",
+          THD_WORKING_AREA_BASE(nvmfeep->gc_wa),
+          THD_WORKING_AREA_END(nvmfeep->gc_wa),
+          NVM_FEE_GC_THREAD_PRIO,
+          nvm_fee_gc_thread,
+          (void*)nvmfeep
+        };
+        nvmfeep->gc_thread = chThdCreateI(&gc_descriptor);
+    }
+    chSchRescheduleS();
+    osalSysUnlock();
+
+    /* Memory may be above the high watermark already. */
+    nvmfeep->gc_mark = 0;
+    nvm_fee_gc_kick(nvmfeep);
+#endif /* NVM_FEE_USE_GC_THREAD */
     return;
 
 out_error:
@@ -1122,7 +3628,14 @@ void nvmfeeStop(NVMFeeDriver* nvmfeep)
     osalDbgAssert((nvmfeep->state == NVM_STOP) || (nvmfeep->state == NVM_READY),
             "invalid state");
 
+#if NVM_FEE_USE_GC_THREAD
+    /* Wait for a background step in progress. */
+    osalMutexLock(&nvmfeep->mutex);
+#endif /* NVM_FEE_USE_GC_THREAD */
     nvmfeep->state = NVM_STOP;
+#if NVM_FEE_USE_GC_THREAD
+    osalMutexUnlock(&nvmfeep->mutex);
+#endif /* NVM_FEE_USE_GC_THREAD */
 }
 
 /**
@@ -1151,8 +3664,7 @@ bool nvmfeeRead(NVMFeeDriver* nvmfeep, uint32_t startaddr,
     /* Read operation in progress. */
     nvmfeep->state = NVM_READING;
 
-    bool result = nvm_fee_read(nvmfeep, nvmfeep->arena_active, startaddr,
-            n, buffer);
+    bool result = nvm_fee_read(nvmfeep, startaddr, n, buffer);
     if (result != HAL_SUCCESS)
         return result;
 
@@ -1188,8 +3700,7 @@ bool nvmfeeWrite(NVMFeeDriver* nvmfeep, uint32_t startaddr,
     /* Write operation in progress. */
     nvmfeep->state = NVM_WRITING;
 
-    bool result = nvm_fee_write(nvmfeep, nvmfeep->arena_active, startaddr,
-            n, buffer);
+    bool result = nvm_fee_write(nvmfeep, startaddr, n, buffer);
     if (result != HAL_SUCCESS)
         return result;
 
@@ -1220,8 +3731,7 @@ bool nvmfeeErase(NVMFeeDriver* nvmfeep, uint32_t startaddr, uint32_t n)
     /* Erase operation in progress. */
     nvmfeep->state = NVM_ERASING;
 
-    bool result = nvm_fee_write_pattern(nvmfeep, nvmfeep->arena_active,
-            startaddr, n, 0xff);
+    bool result = nvm_fee_erase(nvmfeep, startaddr, n);
     if (result != HAL_SUCCESS)
         return result;
 
@@ -1250,6 +3760,9 @@ bool nvmfeeMassErase(NVMFeeDriver* nvmfeep)
 
     bool result;
 
+    if (nvmfeep->config->layout == NVM_FEE_LAYOUT_RING)
+        return nvm_fee_ring_format(nvmfeep, nvm_fee_ring_head(nvmfeep));
+
     result = nvm_fee_arena_erase(nvmfeep, 0);
     if (result != HAL_SUCCESS)
         return result;
@@ -1263,6 +3776,14 @@ bool nvmfeeMassErase(NVMFeeDriver* nvmfeep)
         return result;
 
     nvmfeep->arena_active = 0;
+    nvm_fee_index_clear(nvmfeep);
+#if NVM_FEE_USE_SHADOW
+    if (nvmfeep->shadow != NULL)
+        memset(nvmfeep->shadow, 0xff, nvmfeep->fee_size);
+#endif /* NVM_FEE_USE_SHADOW */
+#if NVM_FEE_USE_KV
+    nvm_fee_kv_clear(nvmfeep);
+#endif /* NVM_FEE_USE_KV */
 
     return HAL_SUCCESS;
 }
@@ -1297,6 +3818,39 @@ bool nvmfeeSync(NVMFeeDriver* nvmfeep)
     return HAL_SUCCESS;
 }
 
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmfeePoll(NVMFeeDriver* nvmfeep)
+{
+    osalDbgCheck(nvmfeep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmfeep->state >= NVM_READY, "invalid state");
+
+    if (nvmfeep->state == NVM_READY)
+        return HAL_SUCCESS;
+
+    bool result = nvmPoll(nvmfeep->config->nvmp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    if (nvmIsTransferring(nvmfeep->config->nvmp))
+        return HAL_SUCCESS;
+
+    /* No more operation in progress. */
+    nvmfeep->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
 /**
  * @brief   Returns media info.
  *
@@ -1316,7 +3870,7 @@ bool nvmfeeGetInfo(NVMFeeDriver* nvmfeep, NVMDeviceInfo* nvmdip)
     osalDbgAssert(nvmfeep->state >= NVM_READY, "invalid state");
 
     nvmdip->sector_size = NVM_FEE_SLOT_PAYLOAD_SIZE;
-    nvmdip->sector_num = nvmfeep->arena_num_slots;
+    nvmdip->sector_num = nvmfeep->fee_size / NVM_FEE_SLOT_PAYLOAD_SIZE;
     memcpy(nvmdip->identification, nvmfeep->llnvmdi.identification,
            sizeof(nvmdip->identification));
     /* Note: The virtual address room can be written byte wise */
@@ -1463,6 +4017,201 @@ bool nvmfeeMassWriteUnprotect(NVMFeeDriver* nvmfeep)
     return HAL_SUCCESS;
 }
 
+#if NVM_FEE_USE_GC_THREAD || defined(__DOXYGEN__)
+/**
+ * @brief   Returns garbage collection info.
+ * @pre     In order to use this function the option
+ *          @p NVM_FEE_USE_GC_THREAD must be enabled.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ * @param[out] infop        pointer to a @p NVMFeeGCInfo structure
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmfeeGetGCInfo(NVMFeeDriver* nvmfeep, NVMFeeGCInfo* infop)
+{
+    osalDbgCheck((nvmfeep != NULL) && (infop != NULL));
+    /* Verify device status. */
+    osalDbgAssert(nvmfeep->state >= NVM_READY, "invalid state");
+
+    *infop = nvmfeep->gc_info;
+    infop->usage = nvm_fee_log_usage(nvmfeep) * 100 /
+            nvm_fee_log_capacity(nvmfeep);
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_FEE_USE_GC_THREAD */
+
+#if NVM_FEE_USE_KV || defined(__DOXYGEN__)
+/**
+ * @brief   Reads the value of a key/value record.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ * @param[in] key           key of the record
+ * @param[out] buffer       pointer to data buffer
+ * @param[in] size          size of the data buffer, longer values are
+ *                          truncated
+ * @param[out] lengthp      pointer to the length of the value
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the key is not stored or the operation failed.
+ *
+ * @api
+ */
+bool nvmfeeKvGet(NVMFeeDriver* nvmfeep, nvmfeekey_t key,
+        uint8_t* buffer, uint32_t size, uint32_t* lengthp)
+{
+    osalDbgCheck((nvmfeep != NULL) && (lengthp != NULL));
+    /* Verify device status. */
+    osalDbgAssert(nvmfeep->state >= NVM_READY, "invalid state");
+    osalDbgAssert(nvmfeep->kv_num != 0, "no hash table");
+
+    if (nvmfeep->kv_num == 0)
+        return HAL_FAILED;
+
+    const nvmfeekv_t* kvp = nvm_fee_kv_find(nvmfeep, key);
+    if (kvp->slot == NVM_FEE_KV_NONE)
+        return HAL_FAILED;
+
+    /* Read operation in progress. */
+    nvmfeep->state = NVM_READING;
+
+    bool result = nvm_fee_kv_read(nvmfeep, kvp, 0,
+            kvp->length < size ? kvp->length : size, buffer);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    *lengthp = kvp->length;
+
+    /* Read operation finished. */
+    nvmfeep->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Stores the value of a key/value record.
+ * @details An unchanged value is not written again.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ * @param[in] key           key of the record
+ * @param[in] buffer        pointer to data buffer
+ * @param[in] length        length of the value, up to
+ *                          @p NVM_FEE_KV_VALUE_SIZE bytes
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the hash table is full or the operation failed.
+ *
+ * @api
+ */
+bool nvmfeeKvPut(NVMFeeDriver* nvmfeep, nvmfeekey_t key,
+        const uint8_t* buffer, uint32_t length)
+{
+    osalDbgCheck((nvmfeep != NULL) && (buffer != NULL || length == 0));
+    /* Verify device status. */
+    osalDbgAssert(nvmfeep->state >= NVM_READY, "invalid state");
+    osalDbgAssert(nvmfeep->kv_num != 0, "no hash table");
+    /* Verify value fits into a record. */
+    osalDbgAssert(length <= NVM_FEE_KV_VALUE_SIZE, "invalid parameters");
+
+    if (nvmfeep->kv_num == 0 || length > NVM_FEE_KV_VALUE_SIZE)
+        return HAL_FAILED;
+
+    /* Write operation in progress. */
+    nvmfeep->state = NVM_WRITING;
+
+    bool result = nvm_fee_kv_put(nvmfeep, key, buffer, length);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Deletes a key/value record.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ * @param[in] key           key of the record
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmfeeKvDelete(NVMFeeDriver* nvmfeep, nvmfeekey_t key)
+{
+    osalDbgCheck(nvmfeep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmfeep->state >= NVM_READY, "invalid state");
+    osalDbgAssert(nvmfeep->kv_num != 0, "no hash table");
+
+    if (nvmfeep->kv_num == 0)
+        return HAL_FAILED;
+
+    /* Nothing to delete. */
+    if (nvm_fee_kv_find(nvmfeep, key)->slot == NVM_FEE_KV_NONE)
+        return HAL_SUCCESS;
+
+    /* Erase operation in progress. */
+    nvmfeep->state = NVM_ERASING;
+
+    bool result = nvm_fee_kv_append(nvmfeep, NVM_FEE_ADDRESS_KV_DELETE |
+            ((uint32_t)key << NVM_FEE_ADDRESS_KEY_POS), NULL, 0);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Iterates over the stored keys.
+ * @details No record is read, keys are returned in hash table order.
+ * @note    Storing a new key or deleting one may move other keys, they are
+ *          then missed or returned twice.
+ *
+ * @param[in] nvmfeep       pointer to the @p NVMFeeDriver object
+ * @param[in,out] cursorp   pointer to the iteration cursor, 0 to start
+ * @param[out] keyp         pointer to the key
+ * @param[out] lengthp      pointer to the length of its value
+ *
+ * @return                  Whether a key was returned.
+ * @retval true             a key was returned.
+ * @retval false            there are no more keys.
+ *
+ * @api
+ */
+bool nvmfeeKvNext(NVMFeeDriver* nvmfeep, uint32_t* cursorp,
+        nvmfeekey_t* keyp, uint32_t* lengthp)
+{
+    osalDbgCheck((nvmfeep != NULL) && (cursorp != NULL) &&
+            (keyp != NULL) && (lengthp != NULL));
+    /* Verify device status. */
+    osalDbgAssert(nvmfeep->state >= NVM_READY, "invalid state");
+
+    while (*cursorp < nvmfeep->kv_num)
+    {
+        const nvmfeekv_t* kvp = &nvmfeep->config->kv[(*cursorp)++];
+
+        if (kvp->slot == NVM_FEE_KV_NONE)
+            continue;
+
+        *keyp = kvp->key;
+        *lengthp = kvp->length;
+
+        return true;
+    }
+
+    return false;
+}
+#endif /* NVM_FEE_USE_KV */
+
 #endif /* HAL_USE_NVM_FEE */
 
 /** @} */
@@ -26,6 +26,10 @@
 
 #include <string.h>
 
+#if NVM_FILE_USE_MMAP
+#include <sys/mman.h>
+#endif /* NVM_FILE_USE_MMAP */
+
 /*
  * @todo    - add write protection emulation
  *
@@ -61,12 +65,143 @@ static const struct NVMFileDriverVMT nvm_file_vmt =
     .mass_writeprotect = (bool (*)(void*))nvmfileMassWriteProtect,
     .writeunprotect = (bool (*)(void*, uint32_t, uint32_t))nvmfileWriteUnprotect,
     .mass_writeunprotect = (bool (*)(void*))nvmfileMassWriteUnprotect,
+    .poll = (bool (*)(void*))nvmfilePoll,
 };
 
+/**
+ * @brief   Block of erased bytes written to erase or grow the file.
+ */
+static uint8_t nvm_file_erased[NVM_FILE_ERASE_BLOCK_SIZE];
+
 /*===========================================================================*/
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
+static bool nvm_file_fill(NVMFileDriver* nvmfilep, uint32_t startaddr,
+        uint32_t n)
+{
+    osalDbgCheck(nvmfilep != NULL);
+
+#if HAS_FATFS
+    if (f_lseek(&nvmfilep->file, startaddr) != FR_OK)
+        return HAL_FAILED;
+#else /* HAS_FATFS */
+    if (fseek(nvmfilep->file, startaddr, SEEK_SET) != 0)
+        return HAL_FAILED;
+#endif /* HAS_FATFS */
+
+    while (n > 0)
+    {
+        const uint32_t chunk = (n < sizeof(nvm_file_erased)) ?
+                n : sizeof(nvm_file_erased);
+
+#if HAS_FATFS
+        UINT written;
+        if (f_write(&nvmfilep->file, nvm_file_erased, chunk, &written) !=
+                FR_OK || written != chunk)
+            return HAL_FAILED;
+#else /* HAS_FATFS */
+        if (fwrite(nvm_file_erased, 1, chunk, nvmfilep->file) != chunk)
+            return HAL_FAILED;
+#endif /* HAS_FATFS */
+
+        n -= chunk;
+    }
+
+    return HAL_SUCCESS;
+}
+
+#if NVM_FILE_USE_SNAPSHOT
+static void nvm_file_mark_dirty(NVMFileDriver* nvmfilep, uint32_t startaddr,
+        uint32_t n)
+{
+    osalDbgCheck(nvmfilep != NULL);
+
+    if (nvmfilep->config->snapshot == NULL || n == 0)
+        return;
+
+    const uint32_t first = startaddr / nvmfilep->config->sector_size;
+    const uint32_t last = (startaddr + n - 1) / nvmfilep->config->sector_size;
+
+    for (uint32_t i = first; i <= last; ++i)
+        nvmfilep->config->snapshot_dirty[i / 32] |= 1UL << (i % 32);
+}
+
+static bool nvm_file_is_dirty(NVMFileDriver* nvmfilep, uint32_t sector)
+{
+    osalDbgCheck(nvmfilep != NULL);
+
+    return (nvmfilep->config->snapshot_dirty[sector / 32] &
+            (1UL << (sector % 32))) != 0;
+}
+
+static bool nvm_file_copy_dirty(NVMFileDriver* nvmfilep, bool restore)
+{
+    osalDbgCheck(nvmfilep != NULL);
+
+    const uint32_t sector_size = nvmfilep->config->sector_size;
+    const uint32_t sector_num = nvmfilep->config->sector_num;
+    uint32_t* dirty = nvmfilep->config->snapshot_dirty;
+
+    for (uint32_t first = 0; first < sector_num; ++first)
+    {
+        /* Skip clean words at once. */
+        if (dirty[first / 32] == 0)
+        {
+            first |= 31;
+            continue;
+        }
+        if (!nvm_file_is_dirty(nvmfilep, first))
+            continue;
+
+        /* Copy runs of dirty sectors at once. */
+        uint32_t end = first + 1;
+        while (end < sector_num && nvm_file_is_dirty(nvmfilep, end))
+            ++end;
+
+        const uint32_t addr = first * sector_size;
+        const uint32_t n = (end - first) * sector_size;
+        uint8_t* snapshot = nvmfilep->config->snapshot + addr;
+
+#if NVM_FILE_USE_MMAP
+        if (nvmfilep->map != NULL)
+        {
+            if (restore)
+                memcpy(nvmfilep->map + addr, snapshot, n);
+            else
+                memcpy(snapshot, nvmfilep->map + addr, n);
+        }
+        else
+#endif /* NVM_FILE_USE_MMAP */
+        {
+#if HAS_FATFS
+            UINT transferred;
+            if (f_lseek(&nvmfilep->file, addr) != FR_OK)
+                return HAL_FAILED;
+            if ((restore ?
+                    f_write(&nvmfilep->file, snapshot, n, &transferred) :
+                    f_read(&nvmfilep->file, snapshot, n, &transferred)) !=
+                    FR_OK || transferred != n)
+                return HAL_FAILED;
+#else /* HAS_FATFS */
+            if (fseek(nvmfilep->file, addr, SEEK_SET) != 0)
+                return HAL_FAILED;
+            if ((restore ?
+                    fwrite(snapshot, 1, n, nvmfilep->file) :
+                    fread(snapshot, 1, n, nvmfilep->file)) != n)
+                return HAL_FAILED;
+#endif /* HAS_FATFS */
+        }
+
+        for (uint32_t i = first; i < end; ++i)
+            dirty[i / 32] &= ~(1UL << (i % 32));
+        first = end - 1;
+    }
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_FILE_USE_SNAPSHOT */
+
 /*===========================================================================*/
 /* Driver exported functions.                                                */
 /*===========================================================================*/
@@ -80,6 +215,7 @@ static const struct NVMFileDriverVMT nvm_file_vmt =
  */
 void nvmfileInit(void)
 {
+    memset(nvm_file_erased, 0xff, sizeof(nvm_file_erased));
 }
 
 /**
@@ -94,6 +230,14 @@ void nvmfileObjectInit(NVMFileDriver* nvmfilep)
     nvmfilep->vmt = &nvm_file_vmt;
     nvmfilep->state = NVM_STOP;
     nvmfilep->config = NULL;
+#if NVM_FILE_USE_SNAPSHOT
+    nvmfilep->snapshot_valid = false;
+#endif /* NVM_FILE_USE_SNAPSHOT */
+    /* Done here as well for drivers used without halInit(). */
+    memset(nvm_file_erased, 0xff, sizeof(nvm_file_erased));
+#if NVM_FILE_USE_MMAP
+    nvmfilep->map = NULL;
+#endif /* NVM_FILE_USE_MMAP */
 #if NVM_FILE_USE_MUTUAL_EXCLUSION
     osalMutexObjectInit(&nvmfilep->mutex);
 #endif /* NVM_FILE_USE_MUTUAL_EXCLUSION */
@@ -117,6 +261,12 @@ void nvmfileStart(NVMFileDriver* nvmfilep, const NVMFileConfig* config)
     if (nvmfilep->state == NVM_READY)
         nvmfileStop(nvmfilep);
 
+#if NVM_FILE_USE_SNAPSHOT
+    /* A snapshot of another file is useless. */
+    if (config != nvmfilep->config)
+        nvmfilep->snapshot_valid = false;
+#endif /* NVM_FILE_USE_SNAPSHOT */
+
     nvmfilep->config = config;
 
 #if HAS_FATFS
@@ -137,17 +287,11 @@ void nvmfileStart(NVMFileDriver* nvmfilep, const NVMFileConfig* config)
     size_t desired_size =
             nvmfilep->config->sector_size * nvmfilep->config->sector_num;
 
-    result = f_lseek(&nvmfilep->file, current_size);
-
-    if (result != FR_OK)
-        return;
-
     if (current_size < desired_size)
     {
-        static const uint8_t erased = 0xff;
-        for (size_t i = current_size; i < desired_size; ++i)
-            if (f_write(&nvmfilep->file, &erased, 1, NULL) != FR_OK)
-                return;
+        if (nvm_file_fill(nvmfilep, current_size,
+                desired_size - current_size) != HAL_SUCCESS)
+            return;
         if (f_sync(&nvmfilep->file) != FR_OK)
             return;
     }
@@ -175,15 +319,35 @@ void nvmfileStart(NVMFileDriver* nvmfilep, const NVMFileConfig* config)
 
     if (current_size < desired_size)
     {
-        static const uint8_t erased = 0xff;
-        for (size_t i = current_size; i < desired_size; ++i)
-            if (fwrite(&erased, 1, sizeof(erased), nvmfilep->file) != sizeof(erased))
-                return;
+        if (nvm_file_fill(nvmfilep, current_size,
+                desired_size - current_size) != HAL_SUCCESS)
+            return;
         if (fflush(nvmfilep->file) != 0)
             return;
     }
+
+#if NVM_FILE_USE_MMAP
+    if (nvmfilep->config->use_mmap)
+    {
+        void* map = mmap(NULL, desired_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fileno(nvmfilep->file), 0);
+
+        osalDbgAssert(map != MAP_FAILED, "mapping failed");
+
+        if (map == MAP_FAILED)
+            return;
+
+        nvmfilep->map = map;
+    }
+#endif /* NVM_FILE_USE_MMAP */
 #endif /* HAS_FATFS */
 
+#if NVM_FILE_USE_MODEL
+    if (config->model != NULL)
+        nvmmodelStart(&nvmfilep->model, config->model,
+                config->sector_size, config->sector_num);
+#endif /* NVM_FILE_USE_MODEL */
+
     nvmfilep->state = NVM_READY;
 }
 
@@ -204,6 +368,14 @@ void nvmfileStop(NVMFileDriver* nvmfilep)
 #if HAS_FATFS
     f_close(&nvmfilep->file);
 #else /* HAS_FATFS */
+#if NVM_FILE_USE_MMAP
+    if (nvmfilep->map != NULL)
+        munmap(nvmfilep->map,
+                nvmfilep->config->sector_size * nvmfilep->config->sector_num);
+
+    nvmfilep->map = NULL;
+#endif /* NVM_FILE_USE_MMAP */
+
     if (nvmfilep->file != NULL)
         fclose(nvmfilep->file);
 
@@ -237,12 +409,32 @@ bool nvmfileRead(NVMFileDriver* nvmfilep, uint32_t startaddr, uint32_t n,
     osalDbgAssert((startaddr + n <= nvmfilep->config->sector_size * nvmfilep->config->sector_num),
             "invalid parameters");
 
+#if NVM_FILE_USE_MMAP
+    if (nvmfilep->map != NULL)
+    {
+#if NVM_FILE_USE_MODEL
+        if (nvmfilep->config->model != NULL)
+            nvmmodelRead(&nvmfilep->model, n);
+#endif /* NVM_FILE_USE_MODEL */
+
+        /* Pending writes are visible through the mapping. */
+        memcpy(buffer, nvmfilep->map + startaddr, n);
+
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_FILE_USE_MMAP */
+
     if (nvmfileSync(nvmfilep) != HAL_SUCCESS)
         return HAL_FAILED;
 
     /* Read operation in progress. */
     nvmfilep->state = NVM_READING;
 
+#if NVM_FILE_USE_MODEL
+    if (nvmfilep->config->model != NULL)
+        nvmmodelRead(&nvmfilep->model, n);
+#endif /* NVM_FILE_USE_MODEL */
+
 #if HAS_FATFS
     if (f_lseek(&nvmfilep->file, startaddr) != FR_OK)
         return HAL_FAILED;
@@ -287,6 +479,26 @@ bool nvmfileWrite(NVMFileDriver* nvmfilep, uint32_t startaddr, uint32_t n,
     osalDbgAssert((startaddr + n <= nvmfilep->config->sector_size * nvmfilep->config->sector_num),
             "invalid parameters");
 
+#if NVM_FILE_USE_SNAPSHOT
+    nvm_file_mark_dirty(nvmfilep, startaddr, n);
+#endif /* NVM_FILE_USE_SNAPSHOT */
+
+#if NVM_FILE_USE_MMAP
+    if (nvmfilep->map != NULL)
+    {
+        /* Write operation in progress until synced. */
+        nvmfilep->state = NVM_WRITING;
+
+        memcpy(nvmfilep->map + startaddr, buffer, n);
+#if NVM_FILE_USE_MODEL
+        if (nvmfilep->config->model != NULL)
+            nvmmodelProgram(&nvmfilep->model, startaddr, n);
+#endif /* NVM_FILE_USE_MODEL */
+
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_FILE_USE_MMAP */
+
     if (nvmfileSync(nvmfilep) != HAL_SUCCESS)
         return HAL_FAILED;
 
@@ -307,6 +519,12 @@ bool nvmfileWrite(NVMFileDriver* nvmfilep, uint32_t startaddr, uint32_t n,
         return HAL_FAILED;
 #endif /* HAS_FATFS */
 
+#if NVM_FILE_USE_MODEL
+    /* Device stays busy until synced. */
+    if (nvmfilep->config->model != NULL)
+        nvmmodelProgram(&nvmfilep->model, startaddr, n);
+#endif /* NVM_FILE_USE_MODEL */
+
     return HAL_SUCCESS;
 }
 
@@ -340,34 +558,33 @@ bool nvmfileErase(NVMFileDriver* nvmfilep, uint32_t startaddr, uint32_t n)
 
     uint32_t first_sector_addr =
             startaddr - (startaddr % nvmfilep->config->sector_size);
-
-#if HAS_FATFS
-    if (f_lseek(&nvmfilep->file, first_sector_addr) != FR_OK)
-        return HAL_FAILED;
-
-    for (uint32_t addr = first_sector_addr;
-            addr < startaddr + n;
-            addr += nvmfilep->config->sector_size)
+    uint32_t end_addr = startaddr + n;
+    end_addr += (nvmfilep->config->sector_size -
+            end_addr % nvmfilep->config->sector_size) %
+            nvmfilep->config->sector_size;
+
+#if NVM_FILE_USE_MODEL
+    if (nvmfilep->config->model != NULL)
+        nvmmodelErase(&nvmfilep->model, startaddr, n);
+#endif /* NVM_FILE_USE_MODEL */
+#if NVM_FILE_USE_SNAPSHOT
+    nvm_file_mark_dirty(nvmfilep, first_sector_addr,
+            end_addr - first_sector_addr);
+#endif /* NVM_FILE_USE_SNAPSHOT */
+
+#if NVM_FILE_USE_MMAP
+    if (nvmfilep->map != NULL)
     {
-        static const uint8_t erased = 0xff;
-        for (size_t i = 0; i < nvmfilep->config->sector_size; ++i)
-            if (f_write(&nvmfilep->file, &erased, sizeof(erased), NULL) != FR_OK)
-                return HAL_FAILED;
-    }
-#else /* HAS_FATFS */
-    if (fseek(nvmfilep->file, first_sector_addr, SEEK_SET) != 0)
-        return HAL_FAILED;
+        memset(nvmfilep->map + first_sector_addr, 0xff,
+                end_addr - first_sector_addr);
 
-    for (uint32_t addr = first_sector_addr;
-            addr < startaddr + n;
-            addr += nvmfilep->config->sector_size)
-    {
-        static const uint8_t erased = 0xff;
-        for (size_t i = 0; i < nvmfilep->config->sector_size; ++i)
-            if (fwrite(&erased, 1, sizeof(erased), nvmfilep->file) != sizeof(erased))
-                return HAL_FAILED;
+        return HAL_SUCCESS;
     }
-#endif /* HAS_FATFS */
+#endif /* NVM_FILE_USE_MMAP */
+
+    if (nvm_file_fill(nvmfilep, first_sector_addr,
+            end_addr - first_sector_addr) != HAL_SUCCESS)
+        return HAL_FAILED;
 
     return HAL_SUCCESS;
 }
@@ -395,33 +612,30 @@ bool nvmfileMassErase(NVMFileDriver* nvmfilep)
     /* Erase operation in progress. */
     nvmfilep->state = NVM_ERASING;
 
-#if HAS_FATFS
-    for (uint32_t addr = 0;
-            addr < nvmfilep->config->sector_size * nvmfilep->config->sector_num;
-            addr += nvmfilep->config->sector_size)
+#if NVM_FILE_USE_MODEL
+    if (nvmfilep->config->model != NULL)
+        nvmmodelErase(&nvmfilep->model, 0,
+                nvmfilep->config->sector_size * nvmfilep->config->sector_num);
+#endif /* NVM_FILE_USE_MODEL */
+#if NVM_FILE_USE_SNAPSHOT
+    nvm_file_mark_dirty(nvmfilep, 0,
+            nvmfilep->config->sector_size * nvmfilep->config->sector_num);
+#endif /* NVM_FILE_USE_SNAPSHOT */
+
+#if NVM_FILE_USE_MMAP
+    if (nvmfilep->map != NULL)
     {
-        if (f_lseek(&nvmfilep->file, addr) != FR_OK)
-            return HAL_FAILED;
+        memset(nvmfilep->map, 0xff,
+                nvmfilep->config->sector_size * nvmfilep->config->sector_num);
 
-        static const uint8_t erased = 0xff;
-        for (size_t i = 0; i < nvmfilep->config->sector_size; ++i)
-            if (f_write(&nvmfilep->file, &erased, sizeof(erased), NULL) != FR_OK)
-                return HAL_FAILED;
+        return HAL_SUCCESS;
     }
-#else /* HAS_FATFS */
-    for (uint32_t addr = 0;
-            addr < nvmfilep->config->sector_size * nvmfilep->config->sector_num;
-            addr += nvmfilep->config->sector_size)
-    {
-        if (fseek(nvmfilep->file, addr, SEEK_SET) != 0)
-            return HAL_FAILED;
+#endif /* NVM_FILE_USE_MMAP */
 
-        static const uint8_t erased = 0xff;
-        for (size_t i = 0; i < nvmfilep->config->sector_size; ++i)
-            if (fwrite(&erased, 1, sizeof(erased), nvmfilep->file) != sizeof(erased))
-                return HAL_FAILED;
-    }
-#endif /* HAS_FATFS */
+    if (nvm_file_fill(nvmfilep, 0,
+            nvmfilep->config->sector_size * nvmfilep->config->sector_num) !=
+            HAL_SUCCESS)
+        return HAL_FAILED;
 
     return HAL_SUCCESS;
 }
@@ -450,10 +664,26 @@ bool nvmfileSync(NVMFileDriver* nvmfilep)
     if (f_sync(&nvmfilep->file) != FR_OK)
         return HAL_FAILED;
 #else /* HAS_FATFS */
+#if NVM_FILE_USE_MMAP
+    /* Hand the mapped pages over to the system, as fflush() does. */
+    if (nvmfilep->map != NULL)
+    {
+        if (msync(nvmfilep->map,
+                nvmfilep->config->sector_size * nvmfilep->config->sector_num,
+                MS_ASYNC) != 0)
+            return HAL_FAILED;
+    }
+    else
+#endif /* NVM_FILE_USE_MMAP */
     if (fflush(nvmfilep->file) != 0)
         return HAL_FAILED;
 #endif /* HAS_FATFS */
 
+#if NVM_FILE_USE_MODEL
+    if (nvmfilep->config->model != NULL)
+        nvmmodelSync(&nvmfilep->model);
+#endif /* NVM_FILE_USE_MODEL */
+
     /* No more operation in progress. */
     nvmfilep->state = NVM_READY;
 
@@ -621,6 +851,140 @@ bool nvmfileMassWriteUnprotect(NVMFileDriver* nvmfilep)
     return HAL_SUCCESS;
 }
 
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ * @note    Operations finish at once unless a timing model is configured.
+ *
+ * @param[in] nvmfilep      pointer to the @p NVMFileDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmfilePoll(NVMFileDriver* nvmfilep)
+{
+    osalDbgCheck(nvmfilep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmfilep->state >= NVM_READY, "invalid state");
+
+    if (nvmfilep->state == NVM_READY)
+        return HAL_SUCCESS;
+
+#if NVM_FILE_USE_MODEL
+    if (nvmfilep->config->model != NULL &&
+            nvmmodelPoll(&nvmfilep->model))
+        return HAL_SUCCESS;
+#endif /* NVM_FILE_USE_MODEL */
+
+    return nvmfileSync(nvmfilep);
+}
+
+#if NVM_FILE_USE_MODEL || defined(__DOXYGEN__)
+/**
+ * @brief   Returns timing and wear model info.
+ *
+ * @param[in] nvmfilep      pointer to the @p NVMFileDriver object
+ * @param[out] infop        pointer to a @p NVMModelInfo structure
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the driver runs without a model.
+ *
+ * @api
+ */
+bool nvmfileGetModelInfo(NVMFileDriver* nvmfilep, NVMModelInfo* infop)
+{
+    osalDbgCheck((nvmfilep != NULL) && (infop != NULL));
+    /* Verify device status. */
+    osalDbgAssert(nvmfilep->state >= NVM_READY, "invalid state");
+
+    if (nvmfilep->config->model == NULL)
+        return HAL_FAILED;
+
+    *infop = nvmfilep->model.info;
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_FILE_USE_MODEL */
+
+#if NVM_FILE_USE_SNAPSHOT || defined(__DOXYGEN__)
+/**
+ * @brief   Takes a snapshot of the file.
+ * @details The first snapshot copies the whole file, later ones only the
+ *          sectors written or erased since the last snapshot or restore.
+ * @pre     A snapshot buffer must have been configured.
+ *
+ * @param[in] nvmfilep      pointer to the @p NVMFileDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmfileSnapshot(NVMFileDriver* nvmfilep)
+{
+    osalDbgCheck(nvmfilep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmfilep->state >= NVM_READY, "invalid state");
+    osalDbgAssert(nvmfilep->config->snapshot != NULL, "no snapshot buffer");
+
+    if (nvmfileSync(nvmfilep) != HAL_SUCCESS)
+        return HAL_FAILED;
+
+    if (!nvmfilep->snapshot_valid)
+        nvm_file_mark_dirty(nvmfilep, 0,
+                nvmfilep->config->sector_size * nvmfilep->config->sector_num);
+
+    /* Snapshot is incomplete until all sectors have been copied. */
+    nvmfilep->snapshot_valid = false;
+
+    if (nvm_file_copy_dirty(nvmfilep, false) != HAL_SUCCESS)
+        return HAL_FAILED;
+
+    nvmfilep->snapshot_valid = true;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Restores the file to the last snapshot.
+ * @details Only the sectors written or erased since the last snapshot or
+ *          restore are being copied.
+ *
+ * @param[in] nvmfilep      pointer to the @p NVMFileDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       no snapshot has been taken or the operation
+ *                          failed.
+ *
+ * @api
+ */
+bool nvmfileRestore(NVMFileDriver* nvmfilep)
+{
+    osalDbgCheck(nvmfilep != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmfilep->state >= NVM_READY, "invalid state");
+
+    if (!nvmfilep->snapshot_valid)
+        return HAL_FAILED;
+
+    if (nvmfileSync(nvmfilep) != HAL_SUCCESS)
+        return HAL_FAILED;
+
+    /* Write operation in progress. */
+    nvmfilep->state = NVM_WRITING;
+
+    if (nvm_file_copy_dirty(nvmfilep, true) != HAL_SUCCESS)
+        return HAL_FAILED;
+
+    return nvmfileSync(nvmfilep);
+}
+#endif /* NVM_FILE_USE_SNAPSHOT */
+
 #endif /* HAL_USE_NVM_FILE */
 
 /** @} */
@@ -63,12 +63,60 @@ static const struct NVMMemoryDriverVMT nvm_memory_vmt =
     .mass_writeprotect = (bool (*)(void*))nvmmemoryMassWriteProtect,
     .writeunprotect = (bool (*)(void*, uint32_t, uint32_t))nvmmemoryWriteUnprotect,
     .mass_writeunprotect = (bool (*)(void*))nvmmemoryMassWriteUnprotect,
+    .poll = (bool (*)(void*))nvmmemoryPoll,
 };
 
 /*===========================================================================*/
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
+#if NVM_MEMORY_USE_SNAPSHOT
+static void nvm_memory_mark_dirty(NVMMemoryDriver* nvmmemoryp,
+        uint32_t startaddr, uint32_t n)
+{
+    osalDbgCheck(nvmmemoryp != NULL);
+
+    if (nvmmemoryp->config->snapshot == NULL || n == 0)
+        return;
+
+    const uint32_t first = startaddr / nvmmemoryp->config->sector_size;
+    const uint32_t last = (startaddr + n - 1) /
+            nvmmemoryp->config->sector_size;
+
+    for (uint32_t i = first; i <= last; ++i)
+        nvmmemoryp->config->snapshot_dirty[i / 32] |= 1UL << (i % 32);
+}
+
+static void nvm_memory_copy_dirty(NVMMemoryDriver* nvmmemoryp, bool restore)
+{
+    osalDbgCheck(nvmmemoryp != NULL);
+
+    const uint32_t sector_size = nvmmemoryp->config->sector_size;
+    uint32_t* dirty = nvmmemoryp->config->snapshot_dirty;
+
+    for (uint32_t i = 0; i < nvmmemoryp->config->sector_num; ++i)
+    {
+        /* Skip clean words at once. */
+        if (dirty[i / 32] == 0)
+        {
+            i |= 31;
+            continue;
+        }
+        if ((dirty[i / 32] & (1UL << (i % 32))) == 0)
+            continue;
+
+        uint8_t* image = nvmmemoryp->config->memoryp + i * sector_size;
+        uint8_t* snapshot = nvmmemoryp->config->snapshot + i * sector_size;
+        if (restore)
+            memcpy(image, snapshot, sector_size);
+        else
+            memcpy(snapshot, image, sector_size);
+
+        dirty[i / 32] &= ~(1UL << (i % 32));
+    }
+}
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
+
 /*===========================================================================*/
 /* Driver exported functions.                                                */
 /*===========================================================================*/
@@ -96,6 +144,9 @@ void nvmmemoryObjectInit(NVMMemoryDriver* nvmmemoryp)
     nvmmemoryp->vmt = &nvm_memory_vmt;
     nvmmemoryp->state = NVM_STOP;
     nvmmemoryp->config = NULL;
+#if NVM_MEMORY_USE_SNAPSHOT
+    nvmmemoryp->snapshot_valid = false;
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
 #if NVM_MEMORY_USE_MUTUAL_EXCLUSION
     osalMutexObjectInit(&nvmmemoryp->mutex);
 #endif /* NVM_MEMORY_USE_MUTUAL_EXCLUSION */
@@ -116,7 +167,18 @@ void nvmmemoryStart(NVMMemoryDriver* nvmmemoryp, const NVMMemoryConfig* config)
     osalDbgAssert((nvmmemoryp->state == NVM_STOP) || (nvmmemoryp->state == NVM_READY),
             "invalid state");
 
+#if NVM_MEMORY_USE_SNAPSHOT
+    /* A snapshot of another memory block is useless. */
+    if (config != nvmmemoryp->config)
+        nvmmemoryp->snapshot_valid = false;
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
+
     nvmmemoryp->config = config;
+#if NVM_MEMORY_USE_MODEL
+    if (config->model != NULL)
+        nvmmodelStart(&nvmmemoryp->model, config->model,
+                config->sector_size, config->sector_num);
+#endif /* NVM_MEMORY_USE_MODEL */
     nvmmemoryp->state = NVM_READY;
 }
 
@@ -167,6 +229,11 @@ bool nvmmemoryRead(NVMMemoryDriver* nvmmemoryp, uint32_t startaddr, uint32_t n,
     /* Read operation in progress. */
     nvmmemoryp->state = NVM_READING;
 
+#if NVM_MEMORY_USE_MODEL
+    if (nvmmemoryp->config->model != NULL)
+        nvmmodelRead(&nvmmemoryp->model, n);
+#endif /* NVM_MEMORY_USE_MODEL */
+
     memcpy(buffer, nvmmemoryp->config->memoryp + startaddr, n);
 
     /* Read operation finished. */
@@ -206,6 +273,19 @@ bool nvmmemoryWrite(NVMMemoryDriver* nvmmemoryp, uint32_t startaddr, uint32_t n,
     nvmmemoryp->state = NVM_WRITING;
 
     memcpy(nvmmemoryp->config->memoryp + startaddr, buffer, n);
+#if NVM_MEMORY_USE_SNAPSHOT
+    nvm_memory_mark_dirty(nvmmemoryp, startaddr, n);
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
+
+#if NVM_MEMORY_USE_MODEL
+    if (nvmmemoryp->config->model != NULL)
+    {
+        /* Device stays busy until synced. */
+        nvmmodelProgram(&nvmmemoryp->model, startaddr, n);
+
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_MEMORY_USE_MODEL */
 
     /* Write operation finished. */
     nvmmemoryp->state = NVM_READY;
@@ -242,6 +322,19 @@ bool nvmmemoryErase(NVMMemoryDriver* nvmmemoryp, uint32_t startaddr, uint32_t n)
     nvmmemoryp->state = NVM_ERASING;
 
     memset(nvmmemoryp->config->memoryp + startaddr, 0xff, n);
+#if NVM_MEMORY_USE_SNAPSHOT
+    nvm_memory_mark_dirty(nvmmemoryp, startaddr, n);
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
+
+#if NVM_MEMORY_USE_MODEL
+    if (nvmmemoryp->config->model != NULL)
+    {
+        /* Device stays busy until synced. */
+        nvmmodelErase(&nvmmemoryp->model, startaddr, n);
+
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_MEMORY_USE_MODEL */
 
     /* Erase operation finished. */
     nvmmemoryp->state = NVM_READY;
@@ -274,6 +367,22 @@ bool nvmmemoryMassErase(NVMMemoryDriver* nvmmemoryp)
 
     memset(nvmmemoryp->config->memoryp, 0xff,
             nvmmemoryp->config->sector_size * nvmmemoryp->config->sector_num);
+#if NVM_MEMORY_USE_SNAPSHOT
+    nvm_memory_mark_dirty(nvmmemoryp, 0,
+            nvmmemoryp->config->sector_size * nvmmemoryp->config->sector_num);
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
+
+#if NVM_MEMORY_USE_MODEL
+    if (nvmmemoryp->config->model != NULL)
+    {
+        /* Device stays busy until synced. */
+        nvmmodelErase(&nvmmemoryp->model, 0,
+                nvmmemoryp->config->sector_size *
+                nvmmemoryp->config->sector_num);
+
+        return HAL_SUCCESS;
+    }
+#endif /* NVM_MEMORY_USE_MODEL */
 
     /* Erase operation finished. */
     nvmmemoryp->state = NVM_READY;
@@ -301,6 +410,11 @@ bool nvmmemorySync(NVMMemoryDriver* nvmmemoryp)
     if (nvmmemoryp->state == NVM_READY)
         return HAL_SUCCESS;
 
+#if NVM_MEMORY_USE_MODEL
+    if (nvmmemoryp->config->model != NULL)
+        nvmmodelSync(&nvmmemoryp->model);
+#endif /* NVM_MEMORY_USE_MODEL */
+
     /* No more operation in progress. */
     nvmmemoryp->state = NVM_READY;
 
@@ -468,6 +582,137 @@ bool nvmmemoryMassWriteUnprotect(NVMMemoryDriver* nvmmemoryp)
     return HAL_SUCCESS;
 }
 
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ * @note    Operations finish at once unless a timing model is configured.
+ *
+ * @param[in] nvmmemoryp    pointer to the @p NVMMemoryDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmmemoryPoll(NVMMemoryDriver* nvmmemoryp)
+{
+    osalDbgCheck(nvmmemoryp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmmemoryp->state >= NVM_READY, "invalid state");
+
+    if (nvmmemoryp->state == NVM_READY)
+        return HAL_SUCCESS;
+
+#if NVM_MEMORY_USE_MODEL
+    if (nvmmemoryp->config->model != NULL &&
+            nvmmodelPoll(&nvmmemoryp->model))
+        return HAL_SUCCESS;
+#endif /* NVM_MEMORY_USE_MODEL */
+
+    /* No more operation in progress. */
+    nvmmemoryp->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+#if NVM_MEMORY_USE_MODEL || defined(__DOXYGEN__)
+/**
+ * @brief   Returns timing and wear model info.
+ *
+ * @param[in] nvmmemoryp    pointer to the @p NVMMemoryDriver object
+ * @param[out] infop        pointer to a @p NVMModelInfo structure
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the driver runs without a model.
+ *
+ * @api
+ */
+bool nvmmemoryGetModelInfo(NVMMemoryDriver* nvmmemoryp, NVMModelInfo* infop)
+{
+    osalDbgCheck((nvmmemoryp != NULL) && (infop != NULL));
+    /* Verify device status. */
+    osalDbgAssert(nvmmemoryp->state >= NVM_READY, "invalid state");
+
+    if (nvmmemoryp->config->model == NULL)
+        return HAL_FAILED;
+
+    *infop = nvmmemoryp->model.info;
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_MEMORY_USE_MODEL */
+
+#if NVM_MEMORY_USE_SNAPSHOT || defined(__DOXYGEN__)
+/**
+ * @brief   Takes a snapshot of the memory block.
+ * @details The first snapshot copies the whole memory block, later ones
+ *          only the sectors written or erased since the last snapshot or
+ *          restore.
+ * @pre     A snapshot buffer must have been configured.
+ *
+ * @param[in] nvmmemoryp    pointer to the @p NVMMemoryDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmmemorySnapshot(NVMMemoryDriver* nvmmemoryp)
+{
+    osalDbgCheck(nvmmemoryp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmmemoryp->state >= NVM_READY, "invalid state");
+    osalDbgAssert(nvmmemoryp->config->snapshot != NULL, "no snapshot buffer");
+
+    if (nvmmemorySync(nvmmemoryp) != HAL_SUCCESS)
+        return HAL_FAILED;
+
+    if (!nvmmemoryp->snapshot_valid)
+    {
+        nvm_memory_mark_dirty(nvmmemoryp, 0,
+                nvmmemoryp->config->sector_size *
+                nvmmemoryp->config->sector_num);
+        nvmmemoryp->snapshot_valid = true;
+    }
+
+    nvm_memory_copy_dirty(nvmmemoryp, false);
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Restores the memory block to the last snapshot.
+ * @details Only the sectors written or erased since the last snapshot or
+ *          restore are being copied.
+ *
+ * @param[in] nvmmemoryp    pointer to the @p NVMMemoryDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       no snapshot has been taken.
+ *
+ * @api
+ */
+bool nvmmemoryRestore(NVMMemoryDriver* nvmmemoryp)
+{
+    osalDbgCheck(nvmmemoryp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmmemoryp->state >= NVM_READY, "invalid state");
+
+    if (!nvmmemoryp->snapshot_valid)
+        return HAL_FAILED;
+
+    if (nvmmemorySync(nvmmemoryp) != HAL_SUCCESS)
+        return HAL_FAILED;
+
+    nvm_memory_copy_dirty(nvmmemoryp, true);
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_MEMORY_USE_SNAPSHOT */
+
 #endif /* HAL_USE_NVM_MEMORY */
 
 /** @} */
@@ -47,13 +47,19 @@
  *              - state synced:
  *                  Do nothing.
  *              - state dirty a:
- *                  Copy mirror b to mirror a erasing pages as required.
+ *                  Copy the dirty range of mirror b to mirror a erasing
+ *                  pages as required.
  *                  Set state to synced.
  *                  Execute sync of lower level driver.
  *              - state dirty b:
- *                  Copy mirror a to mirror b erasing pages as required.
+ *                  Copy the dirty range of mirror a to mirror b erasing
+ *                  pages as required.
  *                  Set state to synced.
  *                  Execute sync of lower level driver.
+ *          The dirty range is the range of sectors touched by the write or
+ *          erase in progress. It is recorded in the header entry right
+ *          before the dirty a state. Without a valid range entry the whole
+ *          mirror is copied.
  *          Sync:
  *              - state synced:
  *                  Execute sync of lower level driver.
@@ -69,6 +75,7 @@
  *                  Invalid state!
  *          Write / Erase:
  *              - state synced:
+ *                  Range of touched sectors is being recorded.
  *                  State is being set to dirty a.
  *                  Execute sync of lower level driver.
  *                  Write(s) and / or erase(s) are being executed on mirror a.
@@ -102,6 +109,11 @@
  *          updates are being written to unused entries until the array has
  *          been filled. At that point the header is being erased and the first
  *          entry is being used.
+ *          With more than one header sector, each sector holds an array of
+ *          its own, led by a sequence number. The sector holding the newest
+ *          sequence number is current, its last used entry is found by a
+ *          binary search. A full sector is continued by the next one in turn,
+ *          which is erased ahead of time by sync and write-behind.
  *          Also note that the chosen patterns assumes a little endian architecture.
  */
 static const uint64_t nvm_mirror_state_mark_table[] =
@@ -114,6 +126,21 @@ static const uint64_t nvm_mirror_state_mark_table[] =
 STATIC_ASSERT(NELEMS(nvm_mirror_state_mark_table) == STATE_COUNT);
 STATIC_ASSERT(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
 
+/*
+ * @brief   A range entry holds the first and the last sector of the dirty
+ *          range and a check value:
+ *          - bits 0..23: first sector
+ *          - bits 24..47: last sector
+ *          - bits 48..63: check value
+ *          It is written in a single operation right before the dirty a
+ *          state entry and never changed afterwards. Sector numbers are
+ *          relative to the mirror origin.
+ */
+#define NVM_MIRROR_RANGE_SECTOR_MASK    0xffffffUL
+#define NVM_MIRROR_RANGE_LAST_POS       24
+#define NVM_MIRROR_RANGE_CHECK_POS      48
+#define NVM_MIRROR_RANGE_CHECK_SEED     0x6d72UL
+
 /*===========================================================================*/
 /* Driver exported variables.                                                */
 /*===========================================================================*/
@@ -141,26 +168,121 @@ static const struct NVMMirrorDriverVMT nvm_mirror_vmt =
     .mass_writeprotect = (bool (*)(void*))nvmmirrorMassWriteProtect,
     .writeunprotect = (bool (*)(void*, uint32_t, uint32_t))nvmmirrorWriteUnprotect,
     .mass_writeunprotect = (bool (*)(void*))nvmmirrorMassWriteUnprotect,
+    .poll = (bool (*)(void*))nvmmirrorPoll,
+    .readv = (bool (*)(void*, uint32_t, const NVMIOVector*, uint32_t))nvmmirrorReadV,
+    .writev = (bool (*)(void*, uint32_t, const NVMIOConstVector*, uint32_t))nvmmirrorWriteV,
 };
 
 /*===========================================================================*/
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
-static bool nvm_mirror_state_init(NVMMirrorDriver* nvmmirrorp)
+static uint64_t nvm_mirror_range_check(uint32_t first, uint32_t last)
+{
+    uint32_t check = NVM_MIRROR_RANGE_CHECK_SEED;
+
+    check ^= first ^ (first >> 16) ^ (last << 5) ^ (last >> 11);
+    check ^= check >> 16;
+
+    return ~check & 0xffff;
+}
+
+static uint64_t nvm_mirror_range_mark(uint32_t first, uint32_t last)
+{
+    return (uint64_t)first |
+            ((uint64_t)last << NVM_MIRROR_RANGE_LAST_POS) |
+            (nvm_mirror_range_check(first, last) <<
+                    NVM_MIRROR_RANGE_CHECK_POS);
+}
+
+static bool nvm_mirror_range_decode(NVMMirrorDriver* nvmmirrorp,
+        uint64_t range_mark, uint32_t* firstp, uint32_t* lastp)
+{
+    const uint32_t first = range_mark & NVM_MIRROR_RANGE_SECTOR_MASK;
+    const uint32_t last = (range_mark >> NVM_MIRROR_RANGE_LAST_POS) &
+            NVM_MIRROR_RANGE_SECTOR_MASK;
+
+    if (range_mark >> NVM_MIRROR_RANGE_CHECK_POS !=
+            nvm_mirror_range_check(first, last))
+        return false;
+    if (first > last ||
+            last >= nvmmirrorp->mirror_size / nvmmirrorp->llnvmdi.sector_size)
+        return false;
+
+    *firstp = first;
+    *lastp = last;
+
+    return true;
+}
+
+static void nvm_mirror_range_set(NVMMirrorDriver* nvmmirrorp,
+        uint32_t startaddr, uint32_t n)
+{
+    const uint32_t sector_size = nvmmirrorp->llnvmdi.sector_size;
+
+    nvmmirrorp->dirty_first = startaddr / sector_size;
+    nvmmirrorp->dirty_last = (n > 0) ?
+            (startaddr + n - 1) / sector_size : nvmmirrorp->dirty_first;
+}
+
+static uint64_t nvm_mirror_seq_mark(uint32_t seq)
+{
+    return (uint64_t)seq | ((uint64_t)~seq << 32);
+}
+
+static bool nvm_mirror_seq_decode(NVMMirrorDriver* nvmmirrorp,
+        uint64_t seq_mark, uint32_t* seqp)
+{
+    uint32_t first, last;
+
+    if ((uint32_t)(seq_mark >> 32) != (uint32_t)~seq_mark)
+        return false;
+
+    /* Headers written without sequence numbers hold state marks and range
+       entries at the start of a sector, these never count as sequence
+       numbers. */
+    for (uint32_t i = 0; i < STATE_COUNT; ++i)
+    {
+        if (seq_mark == nvm_mirror_state_mark_table[i])
+            return false;
+    }
+    if (nvm_mirror_range_decode(nvmmirrorp, seq_mark, &first, &last))
+        return false;
+
+    *seqp = (uint32_t)seq_mark;
+
+    return true;
+}
+
+static uint32_t nvm_mirror_header_end(NVMMirrorDriver* nvmmirrorp)
 {
     osalDbgCheck((nvmmirrorp != NULL));
 
-    const uint32_t header_orig = 0;
-    const uint32_t header_size = nvmmirrorp->mirror_a_org;
+    /* Without a current sector the next entry starts a new one. */
+    if (nvmmirrorp->header_sector >= nvmmirrorp->config->sector_header_num)
+        return 0;
+
+    return (nvmmirrorp->header_sector + 1) * nvmmirrorp->llnvmdi.sector_size;
+}
+
+static bool nvm_mirror_state_scan(NVMMirrorDriver* nvmmirrorp,
+        uint32_t scan_orig, uint32_t scan_end)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
 
     NVMMirrorState new_state = STATE_INVALID;
     uint32_t new_state_addr = 0;
+    uint32_t new_free_addr = scan_orig;
 
     uint64_t state_mark;
+    uint64_t prev_mark = nvm_mirror_state_mark_table[STATE_INVALID];
+    uint32_t first, last;
+
+    /* Without a valid range entry the whole mirror is dirty. */
+    nvm_mirror_range_set(nvmmirrorp, 0, nvmmirrorp->mirror_size);
 
-    for (uint32_t i = header_orig;
-            i < header_orig + header_size;
+    for (uint32_t i = scan_orig;
+            i < scan_end;
             i += sizeof(state_mark))
     {
         bool result = nvmRead(nvmmirrorp->config->nvmp,
@@ -175,31 +297,295 @@ static bool nvm_mirror_state_init(NVMMirrorDriver* nvmmirrorp)
             new_state = STATE_SYNCED;
             new_state_addr = i;
         }
-        else if (state_mark == nvm_mirror_state_mark_table[STATE_DIRTY_A])
-        {
-            new_state = STATE_DIRTY_A;
-            new_state_addr = i;
-        }
-        else if (state_mark == nvm_mirror_state_mark_table[STATE_DIRTY_B])
+        else if (state_mark == nvm_mirror_state_mark_table[STATE_DIRTY_A] ||
+                state_mark == nvm_mirror_state_mark_table[STATE_DIRTY_B])
         {
-            new_state = STATE_DIRTY_B;
+            new_state = (state_mark ==
+                    nvm_mirror_state_mark_table[STATE_DIRTY_A]) ?
+                    STATE_DIRTY_A : STATE_DIRTY_B;
             new_state_addr = i;
+            /* A dirty state takes its range from the preceding entry. */
+            if (nvm_mirror_range_decode(nvmmirrorp, prev_mark, &first, &last))
+            {
+                nvmmirrorp->dirty_first = first;
+                nvmmirrorp->dirty_last = last;
+            }
+            else
+            {
+                nvm_mirror_range_set(nvmmirrorp, 0, nvmmirrorp->mirror_size);
+            }
         }
         else if (state_mark == nvm_mirror_state_mark_table[STATE_INVALID])
         {
             /* skip unused */
+            prev_mark = state_mark;
+            continue;
+        }
+        else if (nvm_mirror_range_decode(nvmmirrorp, state_mark,
+                &first, &last))
+        {
+            /* Range entries following a dirty state extend its range,
+               otherwise they belong to an operation which did not start
+               yet. */
+            if (new_state == STATE_DIRTY_A || new_state == STATE_DIRTY_B)
+            {
+                if (first < nvmmirrorp->dirty_first)
+                    nvmmirrorp->dirty_first = first;
+                if (last > nvmmirrorp->dirty_last)
+                    nvmmirrorp->dirty_last = last;
+            }
+        }
+        else if (new_state == STATE_DIRTY_A || new_state == STATE_DIRTY_B)
+        {
+            /* Interrupted range extension, keep the dirty state for the
+               whole mirror and start a new header sector on the next
+               entry. */
+            nvm_mirror_range_set(nvmmirrorp, 0, nvmmirrorp->mirror_size);
+            new_free_addr = nvmmirrorp->mirror_a_org;
+            break;
         }
         else
         {
             /* invalid, force header reinit */
             new_state = STATE_INVALID;
             new_state_addr = 0;
-            return HAL_SUCCESS;
+            break;
         }
+
+        prev_mark = state_mark;
+        new_free_addr = i + sizeof(state_mark);
     }
 
+    if (new_state == STATE_INVALID)
+        nvm_mirror_range_set(nvmmirrorp, 0, nvmmirrorp->mirror_size);
+
     nvmmirrorp->mirror_state = new_state;
     nvmmirrorp->mirror_state_addr = new_state_addr;
+    nvmmirrorp->mirror_free_addr = new_free_addr;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_mirror_state_init(NVMMirrorDriver* nvmmirrorp)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    const uint32_t header_orig = 0;
+    const uint32_t header_size = nvmmirrorp->mirror_a_org;
+    const uint32_t sector_size = nvmmirrorp->llnvmdi.sector_size;
+    const uint32_t sector_num = nvmmirrorp->config->sector_header_num;
+
+    uint64_t state_mark;
+    uint32_t seq;
+
+    nvmmirrorp->header_sector = sector_num;
+    nvmmirrorp->header_seq = 0;
+    nvmmirrorp->header_next_erased = false;
+
+    /* The header sector with the newest sequence number is current. */
+    for (uint32_t sector = 0; sector < sector_num; ++sector)
+    {
+        bool result = nvmRead(nvmmirrorp->config->nvmp,
+                header_orig + sector * sector_size,
+                sizeof(state_mark),
+                (uint8_t*)&state_mark);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        if (nvm_mirror_seq_decode(nvmmirrorp, state_mark, &seq) &&
+                (nvmmirrorp->header_sector == sector_num ||
+                 (int32_t)(seq - nvmmirrorp->header_seq) > 0))
+        {
+            nvmmirrorp->header_sector = sector;
+            nvmmirrorp->header_seq = seq;
+        }
+    }
+
+    /* Header written before sequence numbers were introduced, scan all
+       of it. The next entry starts a new header sector. */
+    if (nvmmirrorp->header_sector == sector_num)
+    {
+        bool result = nvm_mirror_state_scan(nvmmirrorp, header_orig,
+                header_orig + header_size);
+        if (result != HAL_SUCCESS)
+            return result;
+        nvmmirrorp->mirror_free_addr = header_orig + header_size;
+
+        return HAL_SUCCESS;
+    }
+
+    const uint32_t sector_orig = header_orig +
+            nvmmirrorp->header_sector * sector_size + sizeof(state_mark);
+    const uint32_t sector_end = header_orig +
+            (nvmmirrorp->header_sector + 1) * sector_size;
+
+    /* Entries are appended in order, search for the first unused one. */
+    uint32_t lo = 0;
+    uint32_t hi = (sector_end - sector_orig) / sizeof(state_mark);
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        bool result = nvmRead(nvmmirrorp->config->nvmp,
+                sector_orig + mid * sizeof(state_mark),
+                sizeof(state_mark),
+                (uint8_t*)&state_mark);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        if (state_mark == nvm_mirror_state_mark_table[STATE_INVALID])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    const uint32_t used_end = sector_orig + lo * sizeof(state_mark);
+
+    /* Go back to the last state entry, only range entries follow it. */
+    uint32_t scan_orig = used_end;
+    while (scan_orig > sector_orig)
+    {
+        scan_orig -= sizeof(state_mark);
+        bool result = nvmRead(nvmmirrorp->config->nvmp,
+                scan_orig,
+                sizeof(state_mark),
+                (uint8_t*)&state_mark);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        if (state_mark == nvm_mirror_state_mark_table[STATE_SYNCED] ||
+                state_mark == nvm_mirror_state_mark_table[STATE_DIRTY_A] ||
+                state_mark == nvm_mirror_state_mark_table[STATE_DIRTY_B])
+        {
+            /* Include the range entry in front of it. */
+            if (scan_orig > sector_orig)
+                scan_orig -= sizeof(state_mark);
+            break;
+        }
+    }
+
+    bool result = nvm_mirror_state_scan(nvmmirrorp, scan_orig, used_end);
+    if (result != HAL_SUCCESS)
+        return result;
+    if (nvmmirrorp->mirror_free_addr < used_end)
+        nvmmirrorp->mirror_free_addr = sector_end;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_mirror_header_prepare(NVMMirrorDriver* nvmmirrorp)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    const uint32_t sector_size = nvmmirrorp->llnvmdi.sector_size;
+    const uint32_t sector_num = nvmmirrorp->config->sector_header_num;
+
+    /* A single header sector is erased when it is full. Otherwise the next
+       one is prepared once the current one is half used. */
+    if (nvmmirrorp->header_next_erased || sector_num < 2 ||
+            nvmmirrorp->header_sector >= sector_num ||
+            nvmmirrorp->mirror_free_addr <
+            nvm_mirror_header_end(nvmmirrorp) - sector_size / 2)
+        return HAL_SUCCESS;
+
+    const uint32_t next_orig =
+            ((nvmmirrorp->header_sector + 1) % sector_num) * sector_size;
+
+    /* Skip the erase if the sector still is blank. */
+    uint64_t chunk_tmp;
+    uint8_t* chunk = (uint8_t*)&chunk_tmp;
+    uint32_t chunk_size = sizeof(chunk_tmp);
+    if (nvmmirrorp->config->copy_buffer != NULL)
+    {
+        chunk = nvmmirrorp->config->copy_buffer;
+        chunk_size = nvmmirrorp->config->copy_buffer_size;
+    }
+
+    bool blank = true;
+    for (uint32_t offset = 0; blank && offset < sector_size;
+            offset += chunk_size)
+    {
+        const uint32_t n = (sector_size - offset < chunk_size) ?
+                sector_size - offset : chunk_size;
+        bool result = nvmRead(nvmmirrorp->config->nvmp, next_orig + offset,
+                n, chunk);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            if (chunk[i] != 0xff)
+            {
+                blank = false;
+                break;
+            }
+        }
+    }
+
+    if (!blank)
+    {
+        bool result = nvmErase(nvmmirrorp->config->nvmp, next_orig,
+                sector_size);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    nvmmirrorp->header_next_erased = true;
+
+    return HAL_SUCCESS;
+}
+
+static bool nvm_mirror_header_advance(NVMMirrorDriver* nvmmirrorp)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    const uint32_t header_orig = 0;
+    const uint32_t sector_size = nvmmirrorp->llnvmdi.sector_size;
+    const uint32_t sector_num = nvmmirrorp->config->sector_header_num;
+
+    const uint32_t next = (nvmmirrorp->header_sector >= sector_num) ?
+            0 : (nvmmirrorp->header_sector + 1) % sector_num;
+    const uint32_t next_orig = header_orig + next * sector_size;
+
+    uint32_t seq = nvmmirrorp->header_seq + 1;
+    uint64_t seq_mark = nvm_mirror_seq_mark(seq);
+    while (!nvm_mirror_seq_decode(nvmmirrorp, seq_mark, &seq))
+        seq_mark = nvm_mirror_seq_mark(++seq);
+
+    /* Erase the next sector unless done in advance. */
+    if (!nvmmirrorp->header_next_erased || sector_num < 2 ||
+            nvmmirrorp->header_sector >= sector_num)
+    {
+        bool result = nvmErase(nvmmirrorp->config->nvmp, next_orig,
+                sector_size);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    /* Write sequence number. */
+    {
+        bool result = nvmWrite(nvmmirrorp->config->nvmp, next_orig,
+                sizeof(seq_mark), (uint8_t*)&seq_mark);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    nvmmirrorp->header_sector = next;
+    nvmmirrorp->header_seq = seq;
+    nvmmirrorp->header_next_erased = false;
+    nvmmirrorp->mirror_free_addr = next_orig + sizeof(seq_mark);
+
+    /* Carry a synced state over. */
+    if (nvmmirrorp->mirror_state == STATE_SYNCED)
+    {
+        uint64_t state_mark = nvm_mirror_state_mark_table[STATE_SYNCED];
+        bool result = nvmWrite(nvmmirrorp->config->nvmp,
+                nvmmirrorp->mirror_free_addr,
+                sizeof(state_mark), (uint8_t*)&state_mark);
+        if (result != HAL_SUCCESS)
+            return result;
+
+        nvmmirrorp->mirror_state_addr = nvmmirrorp->mirror_free_addr;
+        nvmmirrorp->mirror_free_addr += sizeof(state_mark);
+    }
 
     return HAL_SUCCESS;
 }
@@ -212,25 +598,43 @@ static bool nvm_mirror_state_update(NVMMirrorDriver* nvmmirrorp,
     if (new_state == nvmmirrorp->mirror_state)
         return HAL_SUCCESS;
 
-    const uint32_t header_orig = 0;
-    const uint32_t header_size = nvmmirrorp->mirror_a_org;
-
     uint32_t new_state_addr = nvmmirrorp->mirror_state_addr;
     uint64_t new_state_mark = nvm_mirror_state_mark_table[new_state];
 
-    /* Advance state entry pointer if last state was synced */
-    if (nvmmirrorp->mirror_state == STATE_SYNCED)
-        new_state_addr += sizeof(new_state_mark);
-
-    /* Erase header in case of wrap around or if its invalid. */
-    if (new_state_addr >= header_orig + header_size ||
+    /* A dirty a state starts a new entry preceded by its range, one more
+       entry is being kept free for a range extension. Other states
+       update the current entry. */
+    if (new_state == STATE_DIRTY_A ||
             nvmmirrorp->mirror_state == STATE_INVALID)
     {
-        new_state_addr = 0;
-        bool result = nvmErase(nvmmirrorp->config->nvmp, header_orig,
-                header_size);
-        if (result != HAL_SUCCESS)
-            return result;
+        const bool new_range = (new_state == STATE_DIRTY_A);
+
+        /* Continue in the next header sector if this one is full or if
+           the header is invalid. */
+        if (nvmmirrorp->mirror_free_addr + 3 * sizeof(new_state_mark) >
+                nvm_mirror_header_end(nvmmirrorp) ||
+                nvmmirrorp->mirror_state == STATE_INVALID)
+        {
+            bool result = nvm_mirror_header_advance(nvmmirrorp);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+
+        /* Write range entry. */
+        if (new_range)
+        {
+            uint64_t range_mark = nvm_mirror_range_mark(
+                    nvmmirrorp->dirty_first, nvmmirrorp->dirty_last);
+            bool result = nvmWrite(nvmmirrorp->config->nvmp,
+                    nvmmirrorp->mirror_free_addr,
+                    sizeof(range_mark), (uint8_t*)&range_mark);
+            if (result != HAL_SUCCESS)
+                return result;
+            nvmmirrorp->mirror_free_addr += sizeof(range_mark);
+        }
+
+        new_state_addr = nvmmirrorp->mirror_free_addr;
+        nvmmirrorp->mirror_free_addr += sizeof(new_state_mark);
     }
 
     /* Write updated state entry. */
@@ -254,45 +658,363 @@ static bool nvm_mirror_state_update(NVMMirrorDriver* nvmmirrorp,
     return HAL_SUCCESS;
 }
 
+#if NVM_MIRROR_USE_TRANSACTIONS
+static bool nvm_mirror_range_extend(NVMMirrorDriver* nvmmirrorp,
+        uint32_t startaddr, uint32_t n)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    const uint32_t dirty_first = nvmmirrorp->dirty_first;
+    const uint32_t dirty_last = nvmmirrorp->dirty_last;
+
+    nvm_mirror_range_set(nvmmirrorp, startaddr, n);
+    if (nvmmirrorp->dirty_first > dirty_first)
+        nvmmirrorp->dirty_first = dirty_first;
+    if (nvmmirrorp->dirty_last < dirty_last)
+        nvmmirrorp->dirty_last = dirty_last;
+
+    if (nvmmirrorp->dirty_first == dirty_first &&
+            nvmmirrorp->dirty_last == dirty_last)
+        return HAL_SUCCESS;
+
+    /* The last free entry extends the range to the whole mirror. */
+    uint64_t range_mark;
+    if (nvmmirrorp->mirror_free_addr + 2 * sizeof(range_mark) >
+            nvm_mirror_header_end(nvmmirrorp))
+        nvm_mirror_range_set(nvmmirrorp, 0, nvmmirrorp->mirror_size);
+    range_mark = nvm_mirror_range_mark(nvmmirrorp->dirty_first,
+            nvmmirrorp->dirty_last);
+
+    /* Write range entry. */
+    {
+        bool result = nvmWrite(nvmmirrorp->config->nvmp,
+                nvmmirrorp->mirror_free_addr,
+                sizeof(range_mark), (uint8_t*)&range_mark);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    /* Sync lower level driver. */
+    {
+        bool result = nvmSync(nvmmirrorp->config->nvmp);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
+    nvmmirrorp->mirror_free_addr += sizeof(range_mark);
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+
+static bool nvm_mirror_transfer(NVMMirrorDriver* nvmmirrorp,
+        uint32_t src_addr, uint32_t dst_addr, size_t n, bool dst_erased)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    uint64_t state_mark;
+    uint8_t* buffer = (uint8_t*)&state_mark;
+    uint32_t buffer_size = sizeof(state_mark);
+
+    /* Use copy buffer if available. */
+    if (nvmmirrorp->config->copy_buffer != NULL)
+    {
+        buffer = nvmmirrorp->config->copy_buffer;
+        buffer_size = nvmmirrorp->config->copy_buffer_size;
+    }
+
+    for (uint32_t offset = 0; offset < n; offset += buffer_size)
+    {
+        const uint32_t chunk = (n - offset < buffer_size) ?
+                n - offset : buffer_size;
+
+        /* Read chunk into buffer. */
+        {
+            bool result = nvmRead(nvmmirrorp->config->nvmp,
+                    src_addr + offset, chunk, buffer);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+
+        uint32_t begin = 0;
+        uint32_t end = chunk;
+
+        /* Erased bytes need not be programmed to an erased destination,
+           trim them in units of 8 bytes keeping writes aligned. */
+        if (dst_erased)
+        {
+            while (begin < end && buffer[begin] == 0xff)
+                begin++;
+            while (end > begin && buffer[end - 1] == 0xff)
+                end--;
+            if (begin == end)
+                continue;
+            begin &= ~(sizeof(state_mark) - 1);
+            end = (end + sizeof(state_mark) - 1) & ~(sizeof(state_mark) - 1);
+            if (end > chunk)
+                end = chunk;
+        }
+
+        /* Write chunk to destination. */
+        {
+            bool result = nvmWrite(nvmmirrorp->config->nvmp,
+                    dst_addr + offset + begin, end - begin, buffer + begin);
+            if (result != HAL_SUCCESS)
+                return result;
+        }
+    }
+
+    return HAL_SUCCESS;
+}
+
 static bool nvm_mirror_copy(NVMMirrorDriver* nvmmirrorp, uint32_t src_addr,
         uint32_t dst_addr, size_t n)
 {
     osalDbgCheck((nvmmirrorp != NULL));
 
-    uint64_t state_mark;
+    const uint32_t sector_size = nvmmirrorp->llnvmdi.sector_size;
 
-    for (uint32_t offset = 0; offset < n; offset += sizeof(state_mark))
+    for (uint32_t offset = 0; offset < n; offset += sector_size)
     {
-        /* Detect start of a new sector and erase destination accordingly. */
-        if ((offset % nvmmirrorp->llnvmdi.sector_size) == 0)
+        /* Erase destination sector. */
         {
             bool result = nvmErase(nvmmirrorp->config->nvmp,
-                    dst_addr + offset, nvmmirrorp->llnvmdi.sector_size);
+                    dst_addr + offset, sector_size);
             if (result != HAL_SUCCESS)
                 return result;
         }
 
-        /* Read mark into temporary buffer. */
+        /* Copy sector contents. */
         {
-            bool result = nvmRead(nvmmirrorp->config->nvmp,
-                    src_addr + offset, sizeof(state_mark),
-                    (uint8_t*)&state_mark);
+            bool result = nvm_mirror_transfer(nvmmirrorp, src_addr + offset,
+                    dst_addr + offset, sector_size, true);
             if (result != HAL_SUCCESS)
                 return result;
         }
+    }
+
+    return HAL_SUCCESS;
+}
+
+#if NVM_MIRROR_USE_TRANSACTIONS
+static void nvm_mirror_txn_log(NVMMirrorDriver* nvmmirrorp,
+        uint32_t startaddr, uint32_t n, bool erase)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    NVMMirrorLogEntry* log = nvmmirrorp->config->log;
+    const uint32_t end = startaddr + n;
 
-        /* Write mark to destination. */
+    if (nvmmirrorp->txn_overflow)
+        return;
+
+    if (erase)
+    {
+        /* Writes being erased again must not be replayed, the contents of
+           mirror a they are replayed from is erased already. */
+        for (uint32_t i = 0; i < nvmmirrorp->txn_ops; ++i)
         {
-            bool result = nvmWrite(nvmmirrorp->config->nvmp,
-                    dst_addr + offset, sizeof(state_mark),
-                    (uint8_t*)&state_mark);
+            NVMMirrorLogEntry* entryp = &log[i];
+            const uint32_t entry_end = entryp->startaddr + entryp->n;
+
+            if (entryp->erase || entry_end <= startaddr ||
+                    entryp->startaddr >= end)
+                continue;
+
+            if (entryp->startaddr < startaddr && entry_end > end)
+            {
+                /* Split write, copy all sectors touched instead. */
+                nvmmirrorp->txn_overflow = true;
+                return;
+            }
+            else if (entryp->startaddr < startaddr)
+            {
+                entryp->n = startaddr - entryp->startaddr;
+            }
+            else if (entry_end > end)
+            {
+                entryp->startaddr = end;
+                entryp->n = entry_end - end;
+            }
+            else
+            {
+                entryp->n = 0;
+            }
+        }
+    }
+    else if (nvmmirrorp->txn_ops > 0 &&
+            !log[nvmmirrorp->txn_ops - 1].erase &&
+            startaddr <= log[nvmmirrorp->txn_ops - 1].startaddr +
+                    log[nvmmirrorp->txn_ops - 1].n &&
+            end >= log[nvmmirrorp->txn_ops - 1].startaddr)
+    {
+        /* Merge overlapping or adjacent writes. */
+        NVMMirrorLogEntry* entryp = &log[nvmmirrorp->txn_ops - 1];
+        const uint32_t entry_end = entryp->startaddr + entryp->n;
+
+        if (startaddr < entryp->startaddr)
+            entryp->startaddr = startaddr;
+        entryp->n = ((end > entry_end) ? end : entry_end) - entryp->startaddr;
+        return;
+    }
+
+    if (nvmmirrorp->txn_ops >= nvmmirrorp->config->log_num)
+    {
+        nvmmirrorp->txn_overflow = true;
+        return;
+    }
+
+    log[nvmmirrorp->txn_ops].startaddr = startaddr;
+    log[nvmmirrorp->txn_ops].n = n;
+    log[nvmmirrorp->txn_ops].erase = erase;
+    nvmmirrorp->txn_ops++;
+}
+
+static bool nvm_mirror_txn_apply(NVMMirrorDriver* nvmmirrorp,
+        uint32_t startaddr, uint32_t n, const NVMIOConstVector* iov,
+        uint32_t iovcnt)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    bool result;
+    /* The first operation sets mirror a dirty, further operations extend
+       the dirty range. */
+    if (nvmmirrorp->mirror_state != STATE_DIRTY_A)
+    {
+        nvm_mirror_range_set(nvmmirrorp, startaddr, n);
+        result = nvm_mirror_state_update(nvmmirrorp, STATE_DIRTY_A);
+    }
+    else
+    {
+        result = nvm_mirror_range_extend(nvmmirrorp, startaddr, n);
+    }
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Apply operation to mirror a. */
+    if (iov != NULL)
+        result = nvmWriteV(nvmmirrorp->config->nvmp,
+                nvmmirrorp->mirror_a_org + startaddr, iov, iovcnt);
+    else
+        result = nvmErase(nvmmirrorp->config->nvmp,
+                nvmmirrorp->mirror_a_org + startaddr, n);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Log operation for mirror b. */
+    nvm_mirror_txn_log(nvmmirrorp, startaddr, n, iov == NULL);
+
+    return HAL_SUCCESS;
+}
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+
+#if NVM_MIRROR_USE_TRANSACTIONS || NVM_MIRROR_USE_WRITE_BEHIND
+static bool nvm_mirror_replay(NVMMirrorDriver* nvmmirrorp,
+        const NVMMirrorLogEntry* ops, uint32_t ops_num)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+    /* Verify mirror is in valid sync state. */
+    osalDbgAssert(nvmmirrorp->mirror_state == STATE_DIRTY_B,
+            "invalid mirror state");
+
+    bool result;
+    /* Apply operations to mirror b. */
+    if (ops == NULL)
+    {
+        const uint32_t dirty_offset =
+                nvmmirrorp->dirty_first * nvmmirrorp->llnvmdi.sector_size;
+        const uint32_t dirty_size =
+                (nvmmirrorp->dirty_last - nvmmirrorp->dirty_first + 1) *
+                nvmmirrorp->llnvmdi.sector_size;
+
+        result = nvm_mirror_copy(nvmmirrorp,
+                nvmmirrorp->mirror_a_org + dirty_offset,
+                nvmmirrorp->mirror_b_org + dirty_offset,
+                dirty_size);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < ops_num; ++i)
+        {
+            if (ops[i].erase)
+                result = nvmErase(nvmmirrorp->config->nvmp,
+                        nvmmirrorp->mirror_b_org + ops[i].startaddr,
+                        ops[i].n);
+            else
+                result = nvm_mirror_transfer(nvmmirrorp,
+                        nvmmirrorp->mirror_a_org + ops[i].startaddr,
+                        nvmmirrorp->mirror_b_org + ops[i].startaddr,
+                        ops[i].n, false);
             if (result != HAL_SUCCESS)
                 return result;
         }
     }
-
-    return HAL_SUCCESS;
+
+    /* Advance state to synced. */
+    return nvm_mirror_state_update(nvmmirrorp, STATE_SYNCED);
+}
+#endif /* NVM_MIRROR_USE_TRANSACTIONS || NVM_MIRROR_USE_WRITE_BEHIND */
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+static void nvm_mirror_wb_defer(NVMMirrorDriver* nvmmirrorp,
+        const NVMMirrorLogEntry* ops, uint32_t ops_num)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    nvmmirrorp->wb_ops = ops;
+    nvmmirrorp->wb_ops_num = ops_num;
+    nvmmirrorp->wb_pending = true;
+
+    osalSysLock();
+    nvmmirrorp->wb_kick = true;
+    if (nvmmirrorp->wb_wait != NULL)
+        chThdResumeS(&nvmmirrorp->wb_wait, MSG_OK);
+    osalSysUnlock();
+}
+
+static bool nvm_mirror_wb_drain(NVMMirrorDriver* nvmmirrorp)
+{
+    osalDbgCheck((nvmmirrorp != NULL));
+
+    if (nvmmirrorp->wb_pending == false)
+        return HAL_SUCCESS;
+
+    bool result = nvm_mirror_replay(nvmmirrorp, nvmmirrorp->wb_ops,
+            nvmmirrorp->wb_ops_num);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    nvmmirrorp->wb_pending = false;
+
+    return HAL_SUCCESS;
+}
+
+static void nvm_mirror_wb_thread(void* parameters)
+{
+    NVMMirrorDriver* nvmmirrorp = (NVMMirrorDriver*)parameters;
+
+    chRegSetThreadName("nvm_mirror_wb");
+
+    while (true)
+    {
+        /* Nothing to do, going to sleep. */
+        osalSysLock();
+        if (nvmmirrorp->wb_kick == false)
+            chThdSuspendS(&nvmmirrorp->wb_wait);
+        nvmmirrorp->wb_kick = false;
+        osalSysUnlock();
+
+        /* A failed replay is being retried by the next operation. */
+        nvmmirrorAcquireBus(nvmmirrorp);
+        if (nvmmirrorp->state != NVM_STOP &&
+                nvm_mirror_wb_drain(nvmmirrorp) == HAL_SUCCESS)
+            (void)nvm_mirror_header_prepare(nvmmirrorp);
+        nvmmirrorReleaseBus(nvmmirrorp);
+    }
 }
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
 
 /*===========================================================================*/
 /* Driver exported functions.                                                */
@@ -326,6 +1048,32 @@ void nvmmirrorObjectInit(NVMMirrorDriver* nvmmirrorp)
 #endif /* NVM_JEDEC_SPI_USE_MUTUAL_EXCLUSION */
     nvmmirrorp->mirror_state = STATE_INVALID;
     nvmmirrorp->mirror_state_addr = 0;
+    nvmmirrorp->mirror_free_addr = 0;
+    nvmmirrorp->dirty_first = 0;
+    nvmmirrorp->dirty_last = 0;
+#if NVM_MIRROR_USE_TRANSACTIONS
+    nvmmirrorp->txn = false;
+    nvmmirrorp->txn_overflow = false;
+    nvmmirrorp->txn_ops = 0;
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    nvmmirrorp->wb_ops = NULL;
+    nvmmirrorp->wb_ops_num = 0;
+    nvmmirrorp->wb_pending = false;
+    nvmmirrorp->wb_kick = false;
+    nvmmirrorp->wb_thread = NULL;
+    nvmmirrorp->wb_wait = NULL;
+
+    /* Filling the thread working area here because the function
+       @p chThdCreateI() does not do it.*/
+#if CH_DBG_FILL_THREADS
+    {
+        _thread_memfill((uint8_t*)THD_WORKING_AREA_BASE(nvmmirrorp->wb_wa),
+            (uint8_t*)THD_WORKING_AREA_END(nvmmirrorp->wb_wa),
+            CH_DBG_STACK_FILL_VALUE);
+    }
+#endif /* CH_DBG_FILL_THREADS */
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
 }
 
 /**
@@ -344,6 +1092,12 @@ void nvmmirrorStart(NVMMirrorDriver* nvmmirrorp, const NVMMirrorConfig* config)
             "invalid state");
 
     nvmmirrorp->config = config;
+#if NVM_MIRROR_USE_TRANSACTIONS
+    nvmmirrorp->txn = false;
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    nvmmirrorp->wb_pending = false;
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
 
     /* Calculate and cache often reused values. */
     nvmGetInfo(nvmmirrorp->config->nvmp, &nvmmirrorp->llnvmdi);
@@ -354,16 +1108,33 @@ void nvmmirrorStart(NVMMirrorDriver* nvmmirrorp, const NVMMirrorConfig* config)
             nvmmirrorp->llnvmdi.sector_size * nvmmirrorp->config->sector_header_num;
     nvmmirrorp->mirror_b_org =
             nvmmirrorp->mirror_a_org + nvmmirrorp->mirror_size;
+    /* Verify copy buffer keeps writes aligned. */
+    osalDbgAssert(config->copy_buffer == NULL ||
+            (config->copy_buffer_size > 0 &&
+             config->copy_buffer_size % sizeof(uint64_t) == 0),
+            "invalid copy buffer");
+    /* Verify sector numbers fit into range entries. */
+    osalDbgAssert(nvmmirrorp->mirror_size / nvmmirrorp->llnvmdi.sector_size <=
+            NVM_MIRROR_RANGE_SECTOR_MASK + 1, "mirror too large");
 
     nvm_mirror_state_init(nvmmirrorp);
 
     {
+        /* Dirty range as recovered from the header. */
+        const uint32_t dirty_offset =
+                nvmmirrorp->dirty_first * nvmmirrorp->llnvmdi.sector_size;
+        const uint32_t dirty_size =
+                (nvmmirrorp->dirty_last - nvmmirrorp->dirty_first + 1) *
+                nvmmirrorp->llnvmdi.sector_size;
+
         switch (nvmmirrorp->mirror_state)
         {
         case STATE_DIRTY_A:
             /* Copy mirror b to mirror a erasing pages as required. */
-            if (nvm_mirror_copy(nvmmirrorp, nvmmirrorp->mirror_b_org,
-                    nvmmirrorp->mirror_a_org, nvmmirrorp->mirror_size) != HAL_SUCCESS)
+            if (nvm_mirror_copy(nvmmirrorp,
+                    nvmmirrorp->mirror_b_org + dirty_offset,
+                    nvmmirrorp->mirror_a_org + dirty_offset,
+                    dirty_size) != HAL_SUCCESS)
                 return;
             /* Set state to synced. */
             if (nvm_mirror_state_update(nvmmirrorp, STATE_SYNCED) != HAL_SUCCESS)
@@ -376,8 +1147,10 @@ void nvmmirrorStart(NVMMirrorDriver* nvmmirrorp, const NVMMirrorConfig* config)
             /* Invalid state (all header invalid) assumes mirror b to be dirty. */
         case STATE_DIRTY_B:
             /* Copy mirror a to mirror b erasing pages as required. */
-            if (nvm_mirror_copy(nvmmirrorp, nvmmirrorp->mirror_a_org,
-                    nvmmirrorp->mirror_b_org, nvmmirrorp->mirror_size) != HAL_SUCCESS)
+            if (nvm_mirror_copy(nvmmirrorp,
+                    nvmmirrorp->mirror_a_org + dirty_offset,
+                    nvmmirrorp->mirror_b_org + dirty_offset,
+                    dirty_size) != HAL_SUCCESS)
                 return;
             /* Set state to synced. */
             if (nvm_mirror_state_update(nvmmirrorp, STATE_SYNCED) != HAL_SUCCESS)
@@ -393,10 +1166,31 @@ void nvmmirrorStart(NVMMirrorDriver* nvmmirrorp, const NVMMirrorConfig* config)
     }
 
     nvmmirrorp->state = NVM_READY;
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    osalSysLock();
+    /* Creates the write-behind thread. Note, it is created only once.*/
+    if (nvmmirrorp->wb_thread == NULL)
+    {
+        thread_descriptor_t wb_descriptor = {
+          "nvm_mirror_wb",
+          THD_WORKING_AREA_BASE(nvmmirrorp->wb_wa),
+          THD_WORKING_AREA_END(nvmmirrorp->wb_wa),
+          NVM_MIRROR_WB_THREAD_PRIO,
+          nvm_mirror_wb_thread,
+          (void*)nvmmirrorp
+        };
+        nvmmirrorp->wb_thread = chThdCreateI(&wb_descriptor);
+    }
+    chSchRescheduleS();
+    osalSysUnlock();
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
 }
 
 /**
  * @brief   Disables the NVM mirror.
+ * @note    A pending write-behind replay is finished first. If it fails the
+ *          header keeps the mirror dirty and the next start recovers it.
  *
  * @param[in] nvmmirrorp    pointer to the @p NVMMirrorDriver object
  *
@@ -408,10 +1202,25 @@ void nvmmirrorStop(NVMMirrorDriver* nvmmirrorp)
     /* Verify device status. */
     osalDbgAssert((nvmmirrorp->state == NVM_STOP) || (nvmmirrorp->state == NVM_READY),
             "invalid state");
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* The write-behind thread does not replay into a stopped driver. */
+    nvmmirrorAcquireBus(nvmmirrorp);
+    if (nvm_mirror_wb_drain(nvmmirrorp) != HAL_SUCCESS)
+    {
+        nvmmirrorp->state = NVM_STOP;
+        nvmmirrorReleaseBus(nvmmirrorp);
+        return;
+    }
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+
     /* Verify mirror is in valid sync state. */
     osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED, "invalid mirror state");
 
     nvmmirrorp->state = NVM_STOP;
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    nvmmirrorReleaseBus(nvmmirrorp);
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
 }
 
 /**
@@ -438,7 +1247,19 @@ bool nvmmirrorRead(NVMMirrorDriver* nvmmirrorp, uint32_t startaddr,
     osalDbgAssert(startaddr + n <= nvmmirrorp->mirror_size,
             "invalid parameters");
     /* Verify mirror is in valid sync state. */
+#if NVM_MIRROR_USE_TRANSACTIONS
+    osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED ||
+            (nvmmirrorp->txn && nvmmirrorp->mirror_state == STATE_DIRTY_A) ||
+            (NVM_MIRROR_USE_WRITE_BEHIND &&
+             nvmmirrorp->mirror_state == STATE_DIRTY_B),
+            "invalid mirror state");
+#elif NVM_MIRROR_USE_WRITE_BEHIND
+    osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED ||
+            nvmmirrorp->mirror_state == STATE_DIRTY_B,
+            "invalid mirror state");
+#else
     osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED, "invalid mirror state");
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
 
     /* Read operation in progress. */
     nvmmirrorp->state = NVM_READING;
@@ -473,46 +1294,10 @@ bool nvmmirrorWrite(NVMMirrorDriver* nvmmirrorp, uint32_t startaddr,
         uint32_t n, const uint8_t* buffer)
 {
     osalDbgCheck(nvmmirrorp != NULL);
-    /* Verify device status. */
-    osalDbgAssert(nvmmirrorp->state >= NVM_READY, "invalid state");
-    /* Verify range is within mirror size. */
-    osalDbgAssert(startaddr + n <= nvmmirrorp->mirror_size,
-            "invalid parameters");
-    /* Verify mirror is in valid sync state. */
-    osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED, "invalid mirror state");
-
-    /* Write operation in progress. */
-    nvmmirrorp->state = NVM_WRITING;
-
-    bool result;
-    /* Set state to mirror a dirty before changing contents. */
-    result = nvm_mirror_state_update(nvmmirrorp, STATE_DIRTY_A);
-    if (result != HAL_SUCCESS)
-        return result;
-
-    /* Apply write to mirror a. */
-    result = nvmWrite(nvmmirrorp->config->nvmp,
-            nvmmirrorp->mirror_a_org + startaddr, n, buffer);
-    if (result != HAL_SUCCESS)
-        return result;
 
-    /* Advance state to mirror b dirty. */
-    result = nvm_mirror_state_update(nvmmirrorp, STATE_DIRTY_B);
-    if (result != HAL_SUCCESS)
-        return result;
-
-    /* Apply write to mirror b. */
-    result = nvmWrite(nvmmirrorp->config->nvmp,
-            nvmmirrorp->mirror_b_org + startaddr, n, buffer);
-    if (result != HAL_SUCCESS)
-        return result;
+    const NVMIOConstVector iov = { buffer, n };
 
-    /* Advance state to synced. */
-    result = nvm_mirror_state_update(nvmmirrorp, STATE_SYNCED);
-    if (result != HAL_SUCCESS)
-        return result;
-
-    return HAL_SUCCESS;
+    return nvmmirrorWriteV(nvmmirrorp, startaddr, &iov, 1);
 }
 
 /**
@@ -536,12 +1321,35 @@ bool nvmmirrorErase(NVMMirrorDriver* nvmmirrorp, uint32_t startaddr, uint32_t n)
     /* Verify range is within mirror size. */
     osalDbgAssert(startaddr + n <= nvmmirrorp->mirror_size,
             "invalid parameters");
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* Complete pending operation on mirror b. */
+    {
+        bool result = nvm_mirror_wb_drain(nvmmirrorp);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+
+#if NVM_MIRROR_USE_TRANSACTIONS
+    if (nvmmirrorp->txn)
+    {
+        /* Erase operation in progress. */
+        nvmmirrorp->state = NVM_ERASING;
+
+        return nvm_mirror_txn_apply(nvmmirrorp, startaddr, n, NULL, 0);
+    }
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+
     /* Verify mirror is in valid sync state. */
     osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED, "invalid mirror state");
 
     /* Erase operation in progress. */
     nvmmirrorp->state = NVM_ERASING;
 
+    /* Record range of sectors being touched. */
+    nvm_mirror_range_set(nvmmirrorp, startaddr, n);
+
     bool result;
     /* Set state to mirror a dirty before changing contents. */
     result = nvm_mirror_state_update(nvmmirrorp, STATE_DIRTY_A);
@@ -559,6 +1367,16 @@ bool nvmmirrorErase(NVMMirrorDriver* nvmmirrorp, uint32_t startaddr, uint32_t n)
     if (result != HAL_SUCCESS)
         return result;
 
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* Leave erase of mirror b to the thread. */
+    nvmmirrorp->wb_op.startaddr = startaddr;
+    nvmmirrorp->wb_op.n = n;
+    nvmmirrorp->wb_op.erase = true;
+    nvm_mirror_wb_defer(nvmmirrorp, &nvmmirrorp->wb_op, 1);
+
+    return HAL_SUCCESS;
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+
     /* Apply erase to mirror b. */
     result = nvmErase(nvmmirrorp->config->nvmp,
             nvmmirrorp->mirror_b_org + startaddr, n);
@@ -589,8 +1407,31 @@ bool nvmmirrorMassErase(NVMMirrorDriver* nvmmirrorp)
     osalDbgCheck(nvmmirrorp != NULL);
     /* Verify device status. */
     osalDbgAssert(nvmmirrorp->state >= NVM_READY, "invalid state");
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* Complete pending operation on mirror b. */
+    {
+        bool result = nvm_mirror_wb_drain(nvmmirrorp);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+
+#if NVM_MIRROR_USE_TRANSACTIONS
+    if (nvmmirrorp->txn)
+    {
+        /* Erase operation in progress. */
+        nvmmirrorp->state = NVM_ERASING;
+
+        return nvm_mirror_txn_apply(nvmmirrorp, 0, nvmmirrorp->mirror_size,
+                NULL, 0);
+    }
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+
     /* Verify mirror is in valid sync state. */
     osalDbgAssert(nvmmirrorp->mirror_state != STATE_DIRTY_B, "invalid mirror state");
+    /* Record range of sectors being touched. */
+    nvm_mirror_range_set(nvmmirrorp, 0, nvmmirrorp->mirror_size);
     /* Set mirror state to dirty if necessary. */
     if (nvmmirrorp->mirror_state == STATE_SYNCED)
     {
@@ -649,12 +1490,29 @@ bool nvmmirrorSync(NVMMirrorDriver* nvmmirrorp)
     osalDbgCheck(nvmmirrorp != NULL);
     /* Verify device status. */
     osalDbgAssert(nvmmirrorp->state >= NVM_READY, "invalid state");
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* Wait for pending operation on mirror b. */
+    {
+        bool result = nvm_mirror_wb_drain(nvmmirrorp);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+
     /* Verify mirror is in valid sync state. */
     osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED, "invalid mirror state");
 
     if (nvmmirrorp->state == NVM_READY)
         return HAL_SUCCESS;
 
+    /* Erase the next header sector ahead of time. */
+    {
+        bool result = nvm_mirror_header_prepare(nvmmirrorp);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+
     bool result = nvmSync(nvmmirrorp->config->nvmp);
     if (result != HAL_SUCCESS)
         return result;
@@ -665,6 +1523,48 @@ bool nvmmirrorSync(NVMMirrorDriver* nvmmirrorp)
     return HAL_SUCCESS;
 }
 
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ * @note    A pending write-behind replay is not waited for, the mirror
+ *          stays busy until it is finished or @p nvmmirrorSync() is called.
+ *
+ * @param[in] nvmmirrorp    pointer to the @p NVMMirrorDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmmirrorPoll(NVMMirrorDriver* nvmmirrorp)
+{
+    osalDbgCheck(nvmmirrorp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmmirrorp->state >= NVM_READY, "invalid state");
+
+    if (nvmmirrorp->state == NVM_READY)
+        return HAL_SUCCESS;
+
+    bool result = nvmPoll(nvmmirrorp->config->nvmp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* Mirror b has not been updated yet. */
+    if (nvmmirrorp->wb_pending)
+        return HAL_SUCCESS;
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+
+    if (nvmmirrorp->mirror_state != STATE_SYNCED ||
+            nvmIsTransferring(nvmmirrorp->config->nvmp))
+        return HAL_SUCCESS;
+
+    /* No more operation in progress. */
+    nvmmirrorp->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
 /**
  * @brief   Returns media info.
  *
@@ -833,6 +1733,242 @@ bool nvmmirrorMassWriteUnprotect(NVMMirrorDriver* nvmmirrorp)
     return HAL_SUCCESS;
 }
 
+/**
+ * @brief   Reads a contiguous range into several buffers.
+ *
+ * @param[in] nvmmirrorp    pointer to the @p NVMMirrorDriver object
+ * @param[in] startaddr     address to start reading from
+ * @param[in] iov           array of buffers filled in order
+ * @param[in] iovcnt        number of elements of @p iov
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmmirrorReadV(NVMMirrorDriver* nvmmirrorp, uint32_t startaddr,
+        const NVMIOVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck(nvmmirrorp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmmirrorp->state >= NVM_READY, "invalid state");
+    /* Verify range is within mirror size. */
+    osalDbgAssert(startaddr + nvmiovSize(iov, iovcnt) <=
+            nvmmirrorp->mirror_size,
+            "invalid parameters");
+    /* Verify mirror is in valid sync state. */
+#if NVM_MIRROR_USE_TRANSACTIONS
+    osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED ||
+            (nvmmirrorp->txn && nvmmirrorp->mirror_state == STATE_DIRTY_A) ||
+            (NVM_MIRROR_USE_WRITE_BEHIND &&
+             nvmmirrorp->mirror_state == STATE_DIRTY_B),
+            "invalid mirror state");
+#elif NVM_MIRROR_USE_WRITE_BEHIND
+    osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED ||
+            nvmmirrorp->mirror_state == STATE_DIRTY_B,
+            "invalid mirror state");
+#else
+    osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED, "invalid mirror state");
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+
+    /* Read operation in progress. */
+    nvmmirrorp->state = NVM_READING;
+
+    bool result = nvmReadV(nvmmirrorp->config->nvmp,
+            nvmmirrorp->mirror_a_org + startaddr,
+            iov, iovcnt);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Read operation finished. */
+    nvmmirrorp->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Writes a contiguous range from several buffers.
+ * @details Mirror states are being updated once for the whole range.
+ *
+ * @param[in] nvmmirrorp    pointer to the @p NVMMirrorDriver object
+ * @param[in] startaddr     address to start writing to
+ * @param[in] iov           array of buffers written in order
+ * @param[in] iovcnt        number of elements of @p iov
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmmirrorWriteV(NVMMirrorDriver* nvmmirrorp, uint32_t startaddr,
+        const NVMIOConstVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck(nvmmirrorp != NULL);
+
+    const uint32_t n = nvmiovConstSize(iov, iovcnt);
+
+    /* Verify device status. */
+    osalDbgAssert(nvmmirrorp->state >= NVM_READY, "invalid state");
+    /* Verify range is within mirror size. */
+    osalDbgAssert(startaddr + n <= nvmmirrorp->mirror_size,
+            "invalid parameters");
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* Complete pending operation on mirror b. */
+    {
+        bool result = nvm_mirror_wb_drain(nvmmirrorp);
+        if (result != HAL_SUCCESS)
+            return result;
+    }
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+
+#if NVM_MIRROR_USE_TRANSACTIONS
+    if (nvmmirrorp->txn)
+    {
+        /* Write operation in progress. */
+        nvmmirrorp->state = NVM_WRITING;
+
+        return nvm_mirror_txn_apply(nvmmirrorp, startaddr, n, iov, iovcnt);
+    }
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+
+    /* Verify mirror is in valid sync state. */
+    osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED, "invalid mirror state");
+
+    /* Write operation in progress. */
+    nvmmirrorp->state = NVM_WRITING;
+
+    /* Record range of sectors being touched. */
+    nvm_mirror_range_set(nvmmirrorp, startaddr, n);
+
+    bool result;
+    /* Set state to mirror a dirty before changing contents. */
+    result = nvm_mirror_state_update(nvmmirrorp, STATE_DIRTY_A);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Apply write to mirror a. */
+    result = nvmWriteV(nvmmirrorp->config->nvmp,
+            nvmmirrorp->mirror_a_org + startaddr, iov, iovcnt);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Advance state to mirror b dirty. */
+    result = nvm_mirror_state_update(nvmmirrorp, STATE_DIRTY_B);
+    if (result != HAL_SUCCESS)
+        return result;
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* Leave write to mirror b to the thread. */
+    nvmmirrorp->wb_op.startaddr = startaddr;
+    nvmmirrorp->wb_op.n = n;
+    nvmmirrorp->wb_op.erase = false;
+    nvm_mirror_wb_defer(nvmmirrorp, &nvmmirrorp->wb_op, 1);
+
+    return HAL_SUCCESS;
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+
+    /* Apply write to mirror b. */
+    result = nvmWriteV(nvmmirrorp->config->nvmp,
+            nvmmirrorp->mirror_b_org + startaddr, iov, iovcnt);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Advance state to synced. */
+    result = nvm_mirror_state_update(nvmmirrorp, STATE_SYNCED);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    return HAL_SUCCESS;
+}
+
+#if NVM_MIRROR_USE_TRANSACTIONS || defined(__DOXYGEN__)
+/**
+ * @brief   Starts a transaction.
+ * @details Writes and erases up to @p nvmmirrorCommit() are being applied
+ *          to mirror a only and share a single dirty a, dirty b and synced
+ *          state cycle. A power loss before the commit rolls all of them
+ *          back, a power loss during the commit completes all of them.
+ * @note    The bus has to be held for the whole transaction.
+ * @pre     In order to use this function the option
+ *          @p NVM_MIRROR_USE_TRANSACTIONS must be enabled.
+ *
+ * @param[in] nvmmirrorp    pointer to the @p NVMMirrorDriver object
+ *
+ * @api
+ */
+void nvmmirrorBegin(NVMMirrorDriver* nvmmirrorp)
+{
+    osalDbgCheck(nvmmirrorp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmmirrorp->state >= NVM_READY, "invalid state");
+    /* Verify mirror is in valid sync state. */
+    osalDbgAssert(nvmmirrorp->mirror_state == STATE_SYNCED ||
+            (NVM_MIRROR_USE_WRITE_BEHIND &&
+             nvmmirrorp->mirror_state == STATE_DIRTY_B),
+            "invalid mirror state");
+    /* Verify no transaction is in progress. */
+    osalDbgAssert(!nvmmirrorp->txn, "transaction in progress");
+
+    nvmmirrorp->txn = true;
+    nvmmirrorp->txn_overflow = false;
+    nvmmirrorp->txn_ops = 0;
+}
+
+/**
+ * @brief   Commits a transaction.
+ * @details Replays the logged operations on mirror b. Without a log, or
+ *          if the log overflowed, all sectors touched are being copied
+ *          from mirror a instead. With write-behind mirroring this is left
+ *          to the write-behind thread.
+ * @pre     In order to use this function the option
+ *          @p NVM_MIRROR_USE_TRANSACTIONS must be enabled.
+ *
+ * @param[in] nvmmirrorp    pointer to the @p NVMMirrorDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmmirrorCommit(NVMMirrorDriver* nvmmirrorp)
+{
+    osalDbgCheck(nvmmirrorp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmmirrorp->state >= NVM_READY, "invalid state");
+    /* Verify a transaction is in progress. */
+    osalDbgAssert(nvmmirrorp->txn, "no transaction in progress");
+
+    nvmmirrorp->txn = false;
+
+    /* Nothing to do for an empty transaction. */
+    if (nvmmirrorp->mirror_state != STATE_DIRTY_A)
+        return HAL_SUCCESS;
+
+    bool result;
+    /* Advance state to mirror b dirty. */
+    result = nvm_mirror_state_update(nvmmirrorp, STATE_DIRTY_B);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    const NVMMirrorLogEntry* ops = nvmmirrorp->txn_overflow ?
+            NULL : nvmmirrorp->config->log;
+
+#if NVM_MIRROR_USE_WRITE_BEHIND
+    /* Leave operations on mirror b to the thread. */
+    nvm_mirror_wb_defer(nvmmirrorp, ops, nvmmirrorp->txn_ops);
+
+    return HAL_SUCCESS;
+#else
+    /* Apply operations to mirror b and advance state to synced. */
+    return nvm_mirror_replay(nvmmirrorp, ops, nvmmirrorp->txn_ops);
+#endif /* NVM_MIRROR_USE_WRITE_BEHIND */
+}
+#endif /* NVM_MIRROR_USE_TRANSACTIONS */
+
 #endif /* HAL_USE_NVM_MIRROR */
 
 /** @} */
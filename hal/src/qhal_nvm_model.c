@@ -0,0 +1,267 @@
+/*
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    qnvm_model.c
+ * @brief   NVM flash timing and wear model code.
+ *
+ * @addtogroup NVM_MODEL
+ * @{
+ */
+
+#include "qhal.h"
+
+#if (HAL_USE_NVM_MEMORY && NVM_MEMORY_USE_MODEL) ||                          \
+    (HAL_USE_NVM_FILE && NVM_FILE_USE_MODEL) || defined(__DOXYGEN__)
+
+#include <string.h>
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static void nvm_model_busy(NVMModel* modelp)
+{
+    osalDbgCheck(modelp != NULL);
+
+    /* Busy time passes from the first pending operation on. */
+    if (modelp->pending_ns == 0)
+        modelp->busy_since = osalOsGetSystemTimeX();
+}
+
+static void nvm_model_elapsed(NVMModel* modelp)
+{
+    osalDbgCheck(modelp != NULL);
+
+    const systime_t now = osalOsGetSystemTimeX();
+    uint64_t ticks = (uint64_t)(sysinterval_t)(now - modelp->busy_since);
+    uint64_t elapsed_ns = ticks * 1000000000UL / OSAL_ST_FREQUENCY;
+
+    if (elapsed_ns > modelp->pending_ns)
+        elapsed_ns = modelp->pending_ns;
+
+    modelp->info.time_ns += elapsed_ns;
+    modelp->pending_ns -= elapsed_ns;
+    modelp->busy_since = now;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Configures and activates the model.
+ *
+ * @param[out] modelp       pointer to the @p NVMModel object
+ * @param[in] config        pointer to the @p NVMModelConfig object
+ * @param[in] sector_size   sector size of the device
+ * @param[in] sector_num    number of sectors of the device
+ *
+ * @notapi
+ */
+void nvmmodelStart(NVMModel* modelp, const NVMModelConfig* config,
+        uint32_t sector_size, uint32_t sector_num)
+{
+    osalDbgCheck((modelp != NULL) && (config != NULL));
+
+    modelp->config = config;
+    modelp->sector_size = sector_size;
+    modelp->sector_num = sector_num;
+    modelp->pending_ns = 0;
+    memset(&modelp->info, 0, sizeof(modelp->info));
+
+    /* Counters kept across restarts. */
+    if (config->erase_counters != NULL)
+    {
+        for (uint32_t i = 0; i < sector_num; ++i)
+        {
+            if (config->erase_counters[i] > modelp->info.erase_max)
+                modelp->info.erase_max = config->erase_counters[i];
+        }
+    }
+}
+
+/**
+ * @brief   Accounts a read, waiting for the device first.
+ *
+ * @param[in] modelp        pointer to the @p NVMModel object
+ * @param[in] n             number of bytes read
+ *
+ * @notapi
+ */
+void nvmmodelRead(NVMModel* modelp, uint32_t n)
+{
+    osalDbgCheck(modelp != NULL);
+
+    nvmmodelSync(modelp);
+
+    modelp->info.bytes_read += n;
+}
+
+/**
+ * @brief   Accounts a program.
+ * @details The device stays busy until @p nvmmodelSync().
+ *
+ * @param[in] modelp        pointer to the @p NVMModel object
+ * @param[in] startaddr     address of the first byte programmed
+ * @param[in] n             number of bytes programmed
+ *
+ * @notapi
+ */
+void nvmmodelProgram(NVMModel* modelp, uint32_t startaddr, uint32_t n)
+{
+    osalDbgCheck(modelp != NULL);
+
+    if (n == 0)
+        return;
+
+    nvm_model_busy(modelp);
+
+    const uint32_t page_size = modelp->config->page_size;
+    const uint32_t pages = (page_size == 0) ? 1 :
+            (startaddr + n - 1) / page_size - startaddr / page_size + 1;
+
+    modelp->pending_ns += (uint64_t)n * modelp->config->program_time_ns +
+            (uint64_t)pages * modelp->config->page_time_ns;
+    modelp->info.bytes_programmed += n;
+    modelp->info.pages_programmed += pages;
+}
+
+/**
+ * @brief   Accounts an erase of all sectors touched by a range.
+ * @details The device stays busy until @p nvmmodelSync().
+ *
+ * @param[in] modelp        pointer to the @p NVMModel object
+ * @param[in] startaddr     address within the first sector erased
+ * @param[in] n             number of bytes erased
+ *
+ * @notapi
+ */
+void nvmmodelErase(NVMModel* modelp, uint32_t startaddr, uint32_t n)
+{
+    osalDbgCheck(modelp != NULL);
+
+    if (n == 0)
+        return;
+
+    nvm_model_busy(modelp);
+
+    const uint32_t first = startaddr / modelp->sector_size;
+    const uint32_t last = (startaddr + n - 1) / modelp->sector_size;
+
+    modelp->pending_ns +=
+            (uint64_t)(last - first + 1) * modelp->config->erase_time_ns;
+    modelp->info.sectors_erased += last - first + 1;
+
+    if (modelp->config->erase_counters != NULL)
+    {
+        for (uint32_t i = first; i <= last; ++i)
+        {
+            uint32_t counter = ++modelp->config->erase_counters[i];
+            if (counter > modelp->info.erase_max)
+                modelp->info.erase_max = counter;
+        }
+    }
+}
+
+/**
+ * @brief   Waits for the device to finish pending programs and erases.
+ * @details Sleeps for the busy time not elapsed yet in @p NVM_MODEL_BUSY
+ *          mode. Time shorter than a system tick is being carried over to
+ *          the next wait.
+ *
+ * @param[in] modelp        pointer to the @p NVMModel object
+ *
+ * @notapi
+ */
+void nvmmodelSync(NVMModel* modelp)
+{
+    osalDbgCheck(modelp != NULL);
+
+    if (modelp->pending_ns == 0)
+        return;
+
+    if (modelp->config->mode == NVM_MODEL_BUSY)
+    {
+        nvm_model_elapsed(modelp);
+
+        const uint64_t ticks =
+                modelp->pending_ns * OSAL_ST_FREQUENCY / 1000000000UL;
+
+        if (ticks == 0)
+            return;
+
+        osalThreadSleep((sysinterval_t)ticks);
+
+        const uint64_t slept_ns = ticks * 1000000000UL / OSAL_ST_FREQUENCY;
+        modelp->info.time_ns += slept_ns;
+        modelp->pending_ns -= slept_ns;
+        modelp->busy_since = osalOsGetSystemTimeX();
+
+        return;
+    }
+
+    modelp->info.time_ns += modelp->pending_ns;
+    modelp->pending_ns = 0;
+}
+
+/**
+ * @brief   Accounts the busy time elapsed without waiting.
+ * @details Pending programs and erases are finished at once in
+ *          @p NVM_MODEL_VIRTUAL mode, in @p NVM_MODEL_BUSY mode once the
+ *          system time passed their busy time.
+ *
+ * @param[in] modelp        pointer to the @p NVMModel object
+ *
+ * @return                  The device state.
+ * @retval false            no operation pending.
+ * @retval true             the device is still busy.
+ *
+ * @notapi
+ */
+bool nvmmodelPoll(NVMModel* modelp)
+{
+    osalDbgCheck(modelp != NULL);
+
+    if (modelp->pending_ns == 0)
+        return false;
+
+    if (modelp->config->mode == NVM_MODEL_BUSY)
+    {
+        nvm_model_elapsed(modelp);
+
+        /* Time shorter than a system tick counts as done. */
+        return modelp->pending_ns * OSAL_ST_FREQUENCY / 1000000000UL > 0;
+    }
+
+    nvmmodelSync(modelp);
+
+    return false;
+}
+
+#endif /* NVM_MEMORY_USE_MODEL || NVM_FILE_USE_MODEL */
+
+/** @} */
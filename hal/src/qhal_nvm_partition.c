@@ -59,6 +59,9 @@ static const struct NVMPartitionDriverVMT nvm_partition_vmt =
     .mass_writeprotect = (bool (*)(void*))nvmpartMassWriteProtect,
     .writeunprotect = (bool (*)(void*, uint32_t, uint32_t))nvmpartWriteUnprotect,
     .mass_writeunprotect = (bool (*)(void*))nvmpartMassWriteUnprotect,
+    .poll = (bool (*)(void*))nvmpartPoll,
+    .readv = (bool (*)(void*, uint32_t, const NVMIOVector*, uint32_t))nvmpartReadV,
+    .writev = (bool (*)(void*, uint32_t, const NVMIOConstVector*, uint32_t))nvmpartWriteV,
 };
 
 /*===========================================================================*/
@@ -465,6 +468,111 @@ bool nvmpartMassWriteUnprotect(NVMPartitionDriver* nvmpartp)
             nvmpartp->part_size);
 }
 
+/**
+ * @brief   Completes finished write / erase operations without waiting.
+ *
+ * @param[in] nvmpartp      pointer to the @p NVMPartitionDriver object
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmpartPoll(NVMPartitionDriver* nvmpartp)
+{
+    osalDbgCheck(nvmpartp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmpartp->state >= NVM_READY, "invalid state");
+
+    if (nvmpartp->state == NVM_READY)
+        return HAL_SUCCESS;
+
+    bool result = nvmPoll(nvmpartp->config->nvmp);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Underlying device may be busy for another partition as well. */
+    if (nvmIsTransferring(nvmpartp->config->nvmp))
+        return HAL_SUCCESS;
+
+    /* No more operation in progress. */
+    nvmpartp->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Reads a contiguous range into several buffers.
+ *
+ * @param[in] nvmpartp      pointer to the @p NVMPartitionDriver object
+ * @param[in] startaddr     address to start reading from
+ * @param[in] iov           array of buffers filled in order
+ * @param[in] iovcnt        number of elements of @p iov
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmpartReadV(NVMPartitionDriver* nvmpartp, uint32_t startaddr,
+        const NVMIOVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck(nvmpartp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmpartp->state >= NVM_READY, "invalid state");
+    /* Verify range is within partition size. */
+    osalDbgAssert((startaddr + nvmiovSize(iov, iovcnt) <= nvmpartp->part_size),
+            "invalid parameters");
+
+    /* Read operation in progress. */
+    nvmpartp->state = NVM_READING;
+
+    bool result = nvmReadV(nvmpartp->config->nvmp,
+            nvmpartp->part_org + startaddr,
+            iov, iovcnt);
+    if (result != HAL_SUCCESS)
+        return result;
+
+    /* Read operation finished. */
+    nvmpartp->state = NVM_READY;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief   Writes a contiguous range from several buffers.
+ *
+ * @param[in] nvmpartp      pointer to the @p NVMPartitionDriver object
+ * @param[in] startaddr     address to start writing to
+ * @param[in] iov           array of buffers written in order
+ * @param[in] iovcnt        number of elements of @p iov
+ *
+ * @return                  The operation status.
+ * @retval HAL_SUCCESS      the operation succeeded.
+ * @retval HAL_FAILED       the operation failed.
+ *
+ * @api
+ */
+bool nvmpartWriteV(NVMPartitionDriver* nvmpartp, uint32_t startaddr,
+        const NVMIOConstVector* iov, uint32_t iovcnt)
+{
+    osalDbgCheck(nvmpartp != NULL);
+    /* Verify device status. */
+    osalDbgAssert(nvmpartp->state >= NVM_READY, "invalid state");
+    /* Verify range is within partition size. */
+    osalDbgAssert((startaddr + nvmiovConstSize(iov, iovcnt) <= nvmpartp->part_size),
+            "invalid parameters");
+
+    /* Write operation in progress. */
+    nvmpartp->state = NVM_WRITING;
+
+    return nvmWriteV(nvmpartp->config->nvmp,
+            nvmpartp->part_org + startaddr,
+            iov, iovcnt);
+}
+
 #endif /* HAL_USE_NVM_PARTITION */
 
 /** @} */
@@ -18,10 +18,44 @@
 #include "qhal.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/**
+ * @brief   Size of the stack buffer used by the functions without a buffer
+ *          argument.
+ */
+#if !defined(NVM_TOOLS_BUFFER_SIZE) || defined(__DOXYGEN__)
+#define NVM_TOOLS_BUFFER_SIZE               64
+#endif
+
+/**
+ * @name    nvmcpybuf() flags
+ * @{
+ */
+/**
+ * @brief   Skips chunks already equal in the destination.
+ * @note    Halves the usable buffer, the destination is read into the
+ *          second half.
+ */
+#define NVM_CPY_SKIP_EQUAL                  0x01
+/**
+ * @brief   Skips programming chunks all 0xff, the destination is expected
+ *          to be erased.
+ */
+#define NVM_CPY_SKIP_ERASED                 0x02
+/** @} */
+
 int nvmcmp(BaseNVMDevice* devap, BaseNVMDevice* devbp, uint32_t n);
 bool nvmcpy(BaseNVMDevice* dstp, BaseNVMDevice* srcp, uint32_t n);
 bool nvmset(BaseNVMDevice* dstp, uint8_t pattern, uint32_t n);
+int nvmcmpbuf(BaseNVMDevice* devap, BaseNVMDevice* devbp, uint32_t n,
+        uint8_t* buffer, size_t size);
+bool nvmcpybuf(BaseNVMDevice* dstp, BaseNVMDevice* srcp, uint32_t n,
+        uint8_t* buffer, size_t size, uint8_t flags);
+bool nvmsetbuf(BaseNVMDevice* dstp, uint8_t pattern, uint32_t n,
+        uint8_t* buffer, size_t size);
+bool nvmcrc(BaseNVMDevice* devp, uint32_t startaddr, uint32_t n,
+        uint32_t* crcp, uint8_t* buffer, size_t size);
 
 #endif /* NVM_TOOLS_H_ */
@@ -29,10 +29,27 @@
 /* Driver constants.                                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   End of stream passed to @p nvmsObjectInit() to find the end of
+ *          written data on the device.
+ */
+#define NVM_STREAM_EOS_FIND                 ((size_t)-1)
+
 /*===========================================================================*/
 /* Driver pre-compile time settings.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   Size of the blocks checked for being erased while finding the
+ *          end of stream.
+ * @note    Erased blocks are expected to be an erased suffix of the device,
+ *          data must not contain a whole aligned block of 0xff bytes. The
+ *          page size of the device is a natural choice.
+ */
+#if !defined(NVM_STREAM_EOS_BLOCK_SIZE) || defined(__DOXYGEN__)
+#define NVM_STREAM_EOS_BLOCK_SIZE           256
+#endif
+
 /*===========================================================================*/
 /* Derived constants and error checks.                                       */
 /*===========================================================================*/
@@ -53,7 +70,17 @@
     /* Current end of stream.*/                                               \
     size_t eos;                                                               \
     /* Current read / write offset.*/                                         \
-    size_t offset;
+    size_t offset;                                                            \
+    /* Buffer or NULL if unbuffered.*/                                        \
+    uint8_t *buffer;                                                          \
+    /* Size of the buffer.*/                                                  \
+    size_t buffer_size;                                                       \
+    /* Stream offset of the buffered data.*/                                  \
+    size_t buffer_org;                                                        \
+    /* Number of bytes buffered.*/                                            \
+    size_t buffer_n;                                                          \
+    /* Number of buffered bytes already written to the device.*/              \
+    size_t buffer_flushed;
 
 /**
  * @brief   @p NVMStream virtual methods table.
@@ -87,6 +114,9 @@ typedef struct
 extern "C" {
 #endif
     void nvmsObjectInit(NVMStream *nvmsp, BaseNVMDevice *nvmdp, size_t eos);
+    msg_t nvmsSetBuffer(NVMStream *nvmsp, uint8_t *buffer, size_t size);
+    msg_t nvmsFlush(NVMStream *nvmsp);
+    msg_t nvmsClose(NVMStream *nvmsp);
 #ifdef __cplusplus
 }
 #endif
@@ -14,6 +14,111 @@
 
 #include "nvm_tools.h"
 
+#include <string.h>
+
+/**
+ * @brief   CRC-32 byte lookup table.
+ */
+static const uint32_t nvm_tools_crc_table[256] =
+{
+    0x00000000UL, 0x77073096UL, 0xee0e612cUL, 0x990951baUL,
+    0x076dc419UL, 0x706af48fUL, 0xe963a535UL, 0x9e6495a3UL,
+    0x0edb8832UL, 0x79dcb8a4UL, 0xe0d5e91eUL, 0x97d2d988UL,
+    0x09b64c2bUL, 0x7eb17cbdUL, 0xe7b82d07UL, 0x90bf1d91UL,
+    0x1db71064UL, 0x6ab020f2UL, 0xf3b97148UL, 0x84be41deUL,
+    0x1adad47dUL, 0x6ddde4ebUL, 0xf4d4b551UL, 0x83d385c7UL,
+    0x136c9856UL, 0x646ba8c0UL, 0xfd62f97aUL, 0x8a65c9ecUL,
+    0x14015c4fUL, 0x63066cd9UL, 0xfa0f3d63UL, 0x8d080df5UL,
+    0x3b6e20c8UL, 0x4c69105eUL, 0xd56041e4UL, 0xa2677172UL,
+    0x3c03e4d1UL, 0x4b04d447UL, 0xd20d85fdUL, 0xa50ab56bUL,
+    0x35b5a8faUL, 0x42b2986cUL, 0xdbbbc9d6UL, 0xacbcf940UL,
+    0x32d86ce3UL, 0x45df5c75UL, 0xdcd60dcfUL, 0xabd13d59UL,
+    0x26d930acUL, 0x51de003aUL, 0xc8d75180UL, 0xbfd06116UL,
+    0x21b4f4b5UL, 0x56b3c423UL, 0xcfba9599UL, 0xb8bda50fUL,
+    0x2802b89eUL, 0x5f058808UL, 0xc60cd9b2UL, 0xb10be924UL,
+    0x2f6f7c87UL, 0x58684c11UL, 0xc1611dabUL, 0xb6662d3dUL,
+    0x76dc4190UL, 0x01db7106UL, 0x98d220bcUL, 0xefd5102aUL,
+    0x71b18589UL, 0x06b6b51fUL, 0x9fbfe4a5UL, 0xe8b8d433UL,
+    0x7807c9a2UL, 0x0f00f934UL, 0x9609a88eUL, 0xe10e9818UL,
+    0x7f6a0dbbUL, 0x086d3d2dUL, 0x91646c97UL, 0xe6635c01UL,
+    0x6b6b51f4UL, 0x1c6c6162UL, 0x856530d8UL, 0xf262004eUL,
+    0x6c0695edUL, 0x1b01a57bUL, 0x8208f4c1UL, 0xf50fc457UL,
+    0x65b0d9c6UL, 0x12b7e950UL, 0x8bbeb8eaUL, 0xfcb9887cUL,
+    0x62dd1ddfUL, 0x15da2d49UL, 0x8cd37cf3UL, 0xfbd44c65UL,
+    0x4db26158UL, 0x3ab551ceUL, 0xa3bc0074UL, 0xd4bb30e2UL,
+    0x4adfa541UL, 0x3dd895d7UL, 0xa4d1c46dUL, 0xd3d6f4fbUL,
+    0x4369e96aUL, 0x346ed9fcUL, 0xad678846UL, 0xda60b8d0UL,
+    0x44042d73UL, 0x33031de5UL, 0xaa0a4c5fUL, 0xdd0d7cc9UL,
+    0x5005713cUL, 0x270241aaUL, 0xbe0b1010UL, 0xc90c2086UL,
+    0x5768b525UL, 0x206f85b3UL, 0xb966d409UL, 0xce61e49fUL,
+    0x5edef90eUL, 0x29d9c998UL, 0xb0d09822UL, 0xc7d7a8b4UL,
+    0x59b33d17UL, 0x2eb40d81UL, 0xb7bd5c3bUL, 0xc0ba6cadUL,
+    0xedb88320UL, 0x9abfb3b6UL, 0x03b6e20cUL, 0x74b1d29aUL,
+    0xead54739UL, 0x9dd277afUL, 0x04db2615UL, 0x73dc1683UL,
+    0xe3630b12UL, 0x94643b84UL, 0x0d6d6a3eUL, 0x7a6a5aa8UL,
+    0xe40ecf0bUL, 0x9309ff9dUL, 0x0a00ae27UL, 0x7d079eb1UL,
+    0xf00f9344UL, 0x8708a3d2UL, 0x1e01f268UL, 0x6906c2feUL,
+    0xf762575dUL, 0x806567cbUL, 0x196c3671UL, 0x6e6b06e7UL,
+    0xfed41b76UL, 0x89d32be0UL, 0x10da7a5aUL, 0x67dd4accUL,
+    0xf9b9df6fUL, 0x8ebeeff9UL, 0x17b7be43UL, 0x60b08ed5UL,
+    0xd6d6a3e8UL, 0xa1d1937eUL, 0x38d8c2c4UL, 0x4fdff252UL,
+    0xd1bb67f1UL, 0xa6bc5767UL, 0x3fb506ddUL, 0x48b2364bUL,
+    0xd80d2bdaUL, 0xaf0a1b4cUL, 0x36034af6UL, 0x41047a60UL,
+    0xdf60efc3UL, 0xa867df55UL, 0x316e8eefUL, 0x4669be79UL,
+    0xcb61b38cUL, 0xbc66831aUL, 0x256fd2a0UL, 0x5268e236UL,
+    0xcc0c7795UL, 0xbb0b4703UL, 0x220216b9UL, 0x5505262fUL,
+    0xc5ba3bbeUL, 0xb2bd0b28UL, 0x2bb45a92UL, 0x5cb36a04UL,
+    0xc2d7ffa7UL, 0xb5d0cf31UL, 0x2cd99e8bUL, 0x5bdeae1dUL,
+    0x9b64c2b0UL, 0xec63f226UL, 0x756aa39cUL, 0x026d930aUL,
+    0x9c0906a9UL, 0xeb0e363fUL, 0x72076785UL, 0x05005713UL,
+    0x95bf4a82UL, 0xe2b87a14UL, 0x7bb12baeUL, 0x0cb61b38UL,
+    0x92d28e9bUL, 0xe5d5be0dUL, 0x7cdcefb7UL, 0x0bdbdf21UL,
+    0x86d3d2d4UL, 0xf1d4e242UL, 0x68ddb3f8UL, 0x1fda836eUL,
+    0x81be16cdUL, 0xf6b9265bUL, 0x6fb077e1UL, 0x18b74777UL,
+    0x88085ae6UL, 0xff0f6a70UL, 0x66063bcaUL, 0x11010b5cUL,
+    0x8f659effUL, 0xf862ae69UL, 0x616bffd3UL, 0x166ccf45UL,
+    0xa00ae278UL, 0xd70dd2eeUL, 0x4e048354UL, 0x3903b3c2UL,
+    0xa7672661UL, 0xd06016f7UL, 0x4969474dUL, 0x3e6e77dbUL,
+    0xaed16a4aUL, 0xd9d65adcUL, 0x40df0b66UL, 0x37d83bf0UL,
+    0xa9bcae53UL, 0xdebb9ec5UL, 0x47b2cf7fUL, 0x30b5ffe9UL,
+    0xbdbdf21cUL, 0xcabac28aUL, 0x53b39330UL, 0x24b4a3a6UL,
+    0xbad03605UL, 0xcdd70693UL, 0x54de5729UL, 0x23d967bfUL,
+    0xb3667a2eUL, 0xc4614ab8UL, 0x5d681b02UL, 0x2a6f2b94UL,
+    0xb40bbe37UL, 0xc30c8ea1UL, 0x5a05df1bUL, 0x2d02ef8dUL,
+};
+
+static uint32_t nvm_tools_crc32(uint32_t crc, const uint8_t* data,
+        size_t size)
+{
+    crc = ~crc;
+
+    for (size_t i = 0; i < size; ++i)
+        crc = (crc >> 8) ^ nvm_tools_crc_table[(crc ^ data[i]) & 0xff];
+
+    return ~crc;
+}
+
+static bool nvm_tools_is_erased(const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        if (data[i] != 0xff)
+            return false;
+    return true;
+}
+
+static uint32_t nvm_tools_write_alignment(BaseNVMDevice* devp)
+{
+    NVMDeviceInfo di;
+
+    if (nvmGetInfo(devp, &di) != HAL_SUCCESS)
+        return 0;
+
+    if (di.write_alignment == 0)
+        return 1;
+
+    return di.write_alignment;
+}
+
 /**
  * @brief   Compares content of two BaseNVMDevice objects.
  *
@@ -30,27 +135,108 @@
  */
 int nvmcmp(BaseNVMDevice* devap, BaseNVMDevice* devbp, uint32_t n)
 {
-    for (uint32_t i = 0; i < n; ++i)
+    uint8_t temp[NVM_TOOLS_BUFFER_SIZE];
+
+    return nvmcmpbuf(devap, devbp, n, temp, sizeof(temp));
+}
+
+/**
+ * @brief   Copies data between BaseNVMDevice objects.
+ *
+ * @param[in] dstp      pointer to the first @p BaseNVMDevice object
+ * @param[in] srcp      pointer to the second @p BaseNVMDevice object
+ * @param[in] n         number of bytes to copy
+ *
+ * @return              The result of the operation.
+ * @retval true         The operation was successful.
+ * @retval false        An error occurred.
+ *
+ * @api
+ */
+bool nvmcpy(BaseNVMDevice* dstp, BaseNVMDevice* srcp, uint32_t n)
+{
+    uint8_t temp[NVM_TOOLS_BUFFER_SIZE];
+
+    return nvmcpybuf(dstp, srcp, n, temp, sizeof(temp), 0);
+}
+
+/**
+ * @brief   Sets data of a BaseNVMDevice object to a desired pattern.
+ *
+ * @param[in] dstp      pointer to a @p BaseNVMDevice object
+ * @param[in] pattern   pattern to set memory to
+ * @param[in] n         number of bytes to set
+ *
+ * @return              The result of the operation.
+ * @retval true         The operation was successful.
+ * @retval false        An error occurred.
+ *
+ * @api
+ */
+bool nvmset(BaseNVMDevice* dstp, uint8_t pattern, uint32_t n)
+{
+    uint8_t temp[NVM_TOOLS_BUFFER_SIZE];
+
+    return nvmsetbuf(dstp, pattern, n, temp, sizeof(temp));
+}
+
+/**
+ * @brief   Compares content of two BaseNVMDevice objects through a buffer.
+ * @details Each half of the buffer holds a chunk of one device.
+ *
+ * @param[in] devap     pointer to the first @p BaseNVMDevice object
+ * @param[in] devb      pointer to the second @p BaseNVMDevice object
+ * @param[in] n         number of bytes to compare
+ * @param[in] buffer    pointer to a work buffer
+ * @param[in] size      size of the work buffer, at least 2 bytes
+ *
+ * @return              The result of the comparison.
+ * @retval 0            The compared data is equal.
+ * @retval 1            The compared data is not equal.
+ * @retval -1           An error occurred.
+ *
+ * @api
+ */
+int nvmcmpbuf(BaseNVMDevice* devap, BaseNVMDevice* devbp, uint32_t n,
+        uint8_t* buffer, size_t size)
+{
+    osalDbgCheck((devap != NULL) && (devbp != NULL) && (buffer != NULL));
+
+    const size_t chunk_size = size / 2;
+    osalDbgAssert(chunk_size > 0, "buffer too small");
+
+    for (uint32_t i = 0; i < n; i += chunk_size)
     {
-        uint8_t bytea;
-        if (nvmRead(devap, i, 1, &bytea) != HAL_SUCCESS)
+        uint32_t chunk_n = chunk_size;
+        if (n - i < chunk_size)
+            chunk_n = n - i;
+
+        if (nvmRead(devap, i, chunk_n, buffer) != HAL_SUCCESS)
             return -1;
-        uint8_t byteb;
-        if (nvmRead(devbp, i, 1, &byteb) != HAL_SUCCESS)
+        if (nvmRead(devbp, i, chunk_n, buffer + chunk_size) != HAL_SUCCESS)
             return -1;
 
-        if (bytea != byteb)
+        if (memcmp(buffer, buffer + chunk_size, chunk_n) != 0)
             return 1;
     }
     return 0;
 }
 
 /**
- * @brief   Copies data between BaseNVMDevice objects.
+ * @brief   Copies data between BaseNVMDevice objects through a buffer.
+ * @details Data is being copied in chunks of the buffer size rounded down to
+ *          the write alignment of the destination. A last chunk not filling
+ *          the write alignment is padded with 0xff.
  *
  * @param[in] dstp      pointer to the first @p BaseNVMDevice object
  * @param[in] srcp      pointer to the second @p BaseNVMDevice object
  * @param[in] n         number of bytes to copy
+ * @param[in] buffer    pointer to a work buffer
+ * @param[in] size      size of the work buffer, at least the write alignment
+ *                      of the destination, twice with
+ *                      @p NVM_CPY_SKIP_EQUAL
+ * @param[in] flags     @p NVM_CPY_SKIP_EQUAL and / or
+ *                      @p NVM_CPY_SKIP_ERASED or 0
  *
  * @return              The result of the operation.
  * @retval true         The operation was successful.
@@ -58,42 +244,66 @@ int nvmcmp(BaseNVMDevice* devap, BaseNVMDevice* devbp, uint32_t n)
  *
  * @api
  */
-bool nvmcpy(BaseNVMDevice* dstp, BaseNVMDevice* srcp, uint32_t n)
+bool nvmcpybuf(BaseNVMDevice* dstp, BaseNVMDevice* srcp, uint32_t n,
+        uint8_t* buffer, size_t size, uint8_t flags)
 {
-    NVMDeviceInfo di;
+    osalDbgCheck((dstp != NULL) && (srcp != NULL) && (buffer != NULL));
 
-    if (nvmGetInfo(dstp, &di) != HAL_SUCCESS)
+    const uint32_t write_alignment = nvm_tools_write_alignment(dstp);
+    if (write_alignment == 0)
         return false;
 
-    osalDbgAssert(di.write_alignment <= 8, "unsupported write_alignment");
+    size_t chunk_size = size;
+    if (flags & NVM_CPY_SKIP_EQUAL)
+        chunk_size = size / 2;
+    chunk_size -= chunk_size % write_alignment;
+    osalDbgAssert(chunk_size > 0, "buffer too small");
 
-    if (di.write_alignment == 0)
-        di.write_alignment = 1;
-
-    for (uint32_t i = 0; i < n; i += di.write_alignment)
+    for (uint32_t i = 0; i < n; i += chunk_size)
     {
-        uint8_t temp[8] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
-
-        uint8_t chunk_n = di.write_alignment;
-        if (n - i < di.write_alignment)
+        uint32_t chunk_n = chunk_size;
+        if (n - i < chunk_size)
             chunk_n = n - i;
 
-        if (nvmRead(srcp, i, chunk_n, temp) != HAL_SUCCESS)
+        if (nvmRead(srcp, i, chunk_n, buffer) != HAL_SUCCESS)
             return false;
 
+        if ((flags & NVM_CPY_SKIP_ERASED) &&
+                nvm_tools_is_erased(buffer, chunk_n))
+            continue;
+
+        if (flags & NVM_CPY_SKIP_EQUAL)
+        {
+            if (nvmRead(dstp, i, chunk_n, buffer + chunk_size) != HAL_SUCCESS)
+                return false;
+
+            if (memcmp(buffer, buffer + chunk_size, chunk_n) == 0)
+                continue;
+        }
+
         /* Note: Possibly remaining bytes are filled with 0xff. */
-        if (nvmWrite(dstp, i, di.write_alignment, temp) != HAL_SUCCESS)
+        const uint32_t write_n = chunk_n +
+                (write_alignment - chunk_n % write_alignment) %
+                write_alignment;
+        memset(buffer + chunk_n, 0xff, write_n - chunk_n);
+
+        if (nvmWrite(dstp, i, write_n, buffer) != HAL_SUCCESS)
             return false;
     }
     return true;
 }
 
 /**
- * @brief   Sets data of a BaseNVMDevice object to a desired pattern.
+ * @brief   Sets data of a BaseNVMDevice object to a desired pattern through
+ *          a buffer.
+ * @details A last chunk not filling the write alignment is padded with the
+ *          pattern.
  *
  * @param[in] dstp      pointer to a @p BaseNVMDevice object
  * @param[in] pattern   pattern to set memory to
  * @param[in] n         number of bytes to set
+ * @param[in] buffer    pointer to a work buffer
+ * @param[in] size      size of the work buffer, at least the write alignment
  *
  * @return              The result of the operation.
  * @retval true         The operation was successful.
@@ -101,25 +311,74 @@ bool nvmcpy(BaseNVMDevice* dstp, BaseNVMDevice* srcp, uint32_t n)
  *
  * @api
  */
-bool nvmset(BaseNVMDevice* dstp, uint8_t pattern, uint32_t n)
+bool nvmsetbuf(BaseNVMDevice* dstp, uint8_t pattern, uint32_t n,
+        uint8_t* buffer, size_t size)
 {
-    NVMDeviceInfo di;
+    osalDbgCheck((dstp != NULL) && (buffer != NULL));
 
-    if (nvmGetInfo(dstp, &di) == HAL_SUCCESS)
+    const uint32_t write_alignment = nvm_tools_write_alignment(dstp);
+    if (write_alignment == 0)
         return false;
 
-    osalDbgAssert(di.write_alignment <= 8, "unsupported write_alignment");
+    const size_t chunk_size = size - size % write_alignment;
+    osalDbgAssert(chunk_size > 0, "buffer too small");
 
-    const uint8_t temp[8] =
+    memset(buffer, pattern, chunk_size);
+
+    for (uint32_t i = 0; i < n; i += chunk_size)
     {
-            pattern, pattern, pattern, pattern,
-            pattern, pattern, pattern, pattern
-    };
+        uint32_t chunk_n = chunk_size;
+        if (n - i < chunk_size)
+            chunk_n = n - i + (write_alignment - (n - i) % write_alignment) %
+                    write_alignment;
 
-    for (uint32_t i = 0; i < n; i += di.write_alignment)
+        if (nvmWrite(dstp, i, chunk_n, buffer) != HAL_SUCCESS)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief   Calculates the CRC-32 of a range of a BaseNVMDevice object.
+ * @details Standard CRC-32 as used by zlib and ethernet. Passing the result
+ *          of a range as initial value for the following range results in
+ *          the CRC-32 of both ranges.
+ *
+ * @param[in] devp      pointer to a @p BaseNVMDevice object
+ * @param[in] startaddr first address of the range
+ * @param[in] n         number of bytes of the range
+ * @param[in,out] crcp  pointer to the initial value, 0 for a new
+ *                      calculation, receives the result
+ * @param[in] buffer    pointer to a work buffer
+ * @param[in] size      size of the work buffer
+ *
+ * @return              The result of the operation.
+ * @retval true         The operation was successful.
+ * @retval false        An error occurred.
+ *
+ * @api
+ */
+bool nvmcrc(BaseNVMDevice* devp, uint32_t startaddr, uint32_t n,
+        uint32_t* crcp, uint8_t* buffer, size_t size)
+{
+    osalDbgCheck((devp != NULL) && (crcp != NULL) && (buffer != NULL));
+    osalDbgAssert(size > 0, "buffer too small");
+
+    uint32_t crc = *crcp;
+
+    for (uint32_t i = 0; i < n; i += size)
     {
-        if (nvmWrite(dstp, i, di.write_alignment, temp) != HAL_SUCCESS)
+        uint32_t chunk_n = size;
+        if (n - i < size)
+            chunk_n = n - i;
+
+        if (nvmRead(devp, startaddr + i, chunk_n, buffer) != HAL_SUCCESS)
             return false;
+
+        crc = nvm_tools_crc32(crc, buffer, chunk_n);
     }
+
+    *crcp = crc;
+
     return true;
 }
@@ -22,6 +22,8 @@
 
 #include "nvmstreams.h"
 
+#include <string.h>
+
 /*===========================================================================*/
 /* Driver local definitions.                                                 */
 /*===========================================================================*/
@@ -38,6 +40,201 @@
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
+static bool nvm_stream_erased(BaseNVMDevice *nvmdp, size_t startaddr,
+        size_t n)
+{
+    uint8_t buffer[16];
+
+    while (n > 0)
+    {
+        size_t chunk = n < sizeof(buffer) ? n : sizeof(buffer);
+
+        /* Unreadable data counts as written. */
+        if (nvmRead(nvmdp, startaddr, chunk, buffer) != HAL_SUCCESS)
+            return false;
+
+        for (size_t i = 0; i < chunk; ++i)
+        {
+            if (buffer[i] != 0xff)
+                return false;
+        }
+
+        startaddr += chunk;
+        n -= chunk;
+    }
+
+    return true;
+}
+
+static size_t nvm_stream_find_eos(NVMStream *nvmsp)
+{
+    const size_t block_size = NVM_STREAM_EOS_BLOCK_SIZE;
+    size_t first = 0;
+    size_t last = (nvmsp->size + block_size - 1) / block_size;
+
+    nvmAcquire(nvmsp->nvmdp);
+
+    /* Binary search for the first block of the erased suffix. */
+    while (first < last)
+    {
+        const size_t block = first + (last - first) / 2;
+        const size_t addr = block * block_size;
+        size_t n = nvmsp->size - addr;
+        if (n > block_size)
+            n = block_size;
+
+        if (nvm_stream_erased(nvmsp->nvmdp, addr, n))
+            last = block;
+        else
+            first = block + 1;
+    }
+
+    if (first == 0)
+    {
+        nvmRelease(nvmsp->nvmdp);
+        return 0;
+    }
+
+    /* Backward scan of the last written block for its last written byte. */
+    const size_t org = (first - 1) * block_size;
+    size_t eos = first * block_size;
+    if (eos > nvmsp->size)
+        eos = nvmsp->size;
+
+    while (eos > org)
+    {
+        uint8_t buffer[16];
+        size_t chunk = eos - org < sizeof(buffer) ?
+                eos - org : sizeof(buffer);
+
+        if (nvmRead(nvmsp->nvmdp, eos - chunk, chunk, buffer) != HAL_SUCCESS)
+            break;
+
+        while (chunk > 0 && buffer[chunk - 1] == 0xff)
+        {
+            --chunk;
+            --eos;
+        }
+
+        if (chunk > 0)
+            break;
+    }
+
+    nvmRelease(nvmsp->nvmdp);
+
+    return eos;
+}
+
+static bool nvm_stream_flush(NVMStream *nvmsp)
+{
+    if (nvmsp->buffer_flushed == nvmsp->buffer_n)
+        return HAL_SUCCESS;
+
+    nvmAcquire(nvmsp->nvmdp);
+    if (nvmWrite(nvmsp->nvmdp, nvmsp->buffer_org + nvmsp->buffer_flushed,
+            nvmsp->buffer_n - nvmsp->buffer_flushed,
+            nvmsp->buffer + nvmsp->buffer_flushed) != HAL_SUCCESS)
+    {
+        nvmRelease(nvmsp->nvmdp);
+        return HAL_FAILED;
+    }
+    nvmRelease(nvmsp->nvmdp);
+
+    nvmsp->buffer_flushed = nvmsp->buffer_n;
+
+    return HAL_SUCCESS;
+}
+
+static size_t nvm_stream_buffer_writes(NVMStream *nvmsp, const uint8_t *bp,
+        size_t n)
+{
+    size_t written = 0;
+
+    while (written < n)
+    {
+        /* Windows end at multiples of the buffer size, full windows are
+           written as one aligned program. */
+        const size_t capacity = nvmsp->buffer_size -
+                nvmsp->buffer_org % nvmsp->buffer_size;
+
+        /* Append to the buffered data if it ends at the end of stream. */
+        if (nvmsp->buffer_org + nvmsp->buffer_n != nvmsp->eos ||
+                nvmsp->buffer_n >= capacity)
+        {
+            if (nvm_stream_flush(nvmsp) != HAL_SUCCESS)
+                break;
+
+            nvmsp->buffer_org = nvmsp->eos;
+            nvmsp->buffer_n = 0;
+            nvmsp->buffer_flushed = 0;
+            continue;
+        }
+
+        size_t chunk = capacity - nvmsp->buffer_n;
+        if (chunk > n - written)
+            chunk = n - written;
+
+        memcpy(nvmsp->buffer + nvmsp->buffer_n, bp + written, chunk);
+        nvmsp->buffer_n += chunk;
+        nvmsp->eos += chunk;
+        written += chunk;
+
+        if (nvmsp->buffer_n == capacity &&
+                nvm_stream_flush(nvmsp) != HAL_SUCCESS)
+            break;
+    }
+
+    return written;
+}
+
+static size_t nvm_stream_buffer_reads(NVMStream *nvmsp, uint8_t *bp,
+        size_t n)
+{
+    size_t read = 0;
+
+    while (read < n)
+    {
+        /* Read ahead unless buffered. */
+        if (nvmsp->offset < nvmsp->buffer_org ||
+                nvmsp->offset >= nvmsp->buffer_org + nvmsp->buffer_n)
+        {
+            if (nvm_stream_flush(nvmsp) != HAL_SUCCESS)
+                break;
+
+            size_t chunk = nvmsp->buffer_size;
+            if (chunk > nvmsp->eos - nvmsp->offset)
+                chunk = nvmsp->eos - nvmsp->offset;
+
+            nvmsp->buffer_org = nvmsp->offset;
+            nvmsp->buffer_n = 0;
+            nvmsp->buffer_flushed = 0;
+
+            nvmAcquire(nvmsp->nvmdp);
+            if (nvmRead(nvmsp->nvmdp, nvmsp->offset, chunk,
+                    nvmsp->buffer) != HAL_SUCCESS)
+            {
+                nvmRelease(nvmsp->nvmdp);
+                break;
+            }
+            nvmRelease(nvmsp->nvmdp);
+
+            nvmsp->buffer_n = chunk;
+            nvmsp->buffer_flushed = chunk;
+        }
+
+        size_t chunk = nvmsp->buffer_org + nvmsp->buffer_n - nvmsp->offset;
+        if (chunk > n - read)
+            chunk = n - read;
+
+        memcpy(bp + read,
+                nvmsp->buffer + (nvmsp->offset - nvmsp->buffer_org), chunk);
+        nvmsp->offset += chunk;
+        read += chunk;
+    }
+
+    return read;
+}
+
 static size_t writes(void *ip, const uint8_t *bp, size_t n)
 {
     NVMStream *nvmsp = ip;
@@ -45,6 +242,9 @@ static size_t writes(void *ip, const uint8_t *bp, size_t n)
     if (nvmsp->size - nvmsp->eos < n)
         n = nvmsp->size - nvmsp->eos;
 
+    if (nvmsp->buffer != NULL)
+        return nvm_stream_buffer_writes(nvmsp, bp, n);
+
     nvmAcquire(nvmsp->nvmdp);
     if (nvmWrite(nvmsp->nvmdp, nvmsp->eos, n, bp) != HAL_SUCCESS)
     {
@@ -65,6 +265,9 @@ static size_t reads(void *ip, uint8_t *bp, size_t n)
     if (nvmsp->eos - nvmsp->offset < n)
         n = nvmsp->eos - nvmsp->offset;
 
+    if (nvmsp->buffer != NULL)
+        return nvm_stream_buffer_reads(nvmsp, bp, n);
+
     nvmAcquire(nvmsp->nvmdp);
     if (nvmRead(nvmsp->nvmdp, nvmsp->offset, n, bp) != HAL_SUCCESS)
     {
@@ -85,6 +288,14 @@ static msg_t put(void *ip, uint8_t b)
     if (nvmsp->size - nvmsp->eos <= 0)
         return MSG_RESET;
 
+    if (nvmsp->buffer != NULL)
+    {
+        if (nvm_stream_buffer_writes(nvmsp, &b, 1) != 1)
+            return MSG_RESET;
+
+        return MSG_OK;
+    }
+
     nvmAcquire(nvmsp->nvmdp);
     if (nvmWrite(nvmsp->nvmdp, nvmsp->eos, 1, &b) != HAL_SUCCESS)
     {
@@ -106,6 +317,14 @@ static msg_t get(void *ip)
     if (nvmsp->eos - nvmsp->offset <= 0)
         return MSG_RESET;
 
+    if (nvmsp->buffer != NULL)
+    {
+        if (nvm_stream_buffer_reads(nvmsp, &b, 1) != 1)
+            return MSG_RESET;
+
+        return b;
+    }
+
     nvmAcquire(nvmsp->nvmdp);
     if (nvmRead(nvmsp->nvmdp, nvmsp->offset, 1, &b) != HAL_SUCCESS)
     {
@@ -134,6 +353,12 @@ static const struct NVMStreamVMT vmt =
 
 /**
  * @brief   NVM stream object initialization.
+ * @details Passing @p NVM_STREAM_EOS_FIND as @p eos finds the end of data
+ *          written to the device with a binary search over blocks of
+ *          @p NVM_STREAM_EOS_BLOCK_SIZE bytes, resuming a stream in a
+ *          logarithmic number of reads.
+ * @note    Trailing 0xff bytes of the data are taken as erased, streams
+ *          being resumed should end their records with a different byte.
  *
  * @param[in] nvmsp     pointer to the @p NVMStream object to be initialized
  * @param[in] dev       pointer to the @p BaseNVMDevice for the stream
@@ -148,6 +373,11 @@ void nvmsObjectInit(NVMStream *nvmsp, BaseNVMDevice *nvmdp, size_t eos)
     nvmsp->nvmdp = nvmdp;
     nvmsp->eos = eos;
     nvmsp->offset = 0;
+    nvmsp->buffer = NULL;
+    nvmsp->buffer_size = 0;
+    nvmsp->buffer_org = 0;
+    nvmsp->buffer_n = 0;
+    nvmsp->buffer_flushed = 0;
 
     /* Set size. */
     {
@@ -164,6 +394,90 @@ void nvmsObjectInit(NVMStream *nvmsp, BaseNVMDevice *nvmdp, size_t eos)
 
     /* Verify device status. */
     osalDbgAssert(nvmsp->size > 0, "invalid size");
+
+    if (eos == NVM_STREAM_EOS_FIND)
+        nvmsp->eos = nvm_stream_find_eos(nvmsp);
+}
+
+/**
+ * @brief   Sets the buffer of a NVM stream.
+ * @details Writes are being combined in the buffer and written when the
+ *          stream reaches a multiple of the buffer size, on
+ *          @p nvmsFlush() or @p nvmsClose(). Reads are served from the same
+ *          buffer, reading ahead up to its size. A buffer size being a
+ *          multiple of the page size of the device results in page aligned
+ *          programs.
+ * @note    Data pending in a previous buffer is being written first.
+ *
+ * @param[in] nvmsp     pointer to the @p NVMStream object
+ * @param[in] buffer    pointer to the buffer or NULL for unbuffered access
+ * @param[in] size      size of the buffer
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       the operation succeeded.
+ * @retval MSG_RESET    writing pending data failed.
+ */
+msg_t nvmsSetBuffer(NVMStream *nvmsp, uint8_t *buffer, size_t size)
+{
+    osalDbgCheck((nvmsp != NULL) && ((buffer == NULL) || (size > 0)));
+
+    if (nvm_stream_flush(nvmsp) != HAL_SUCCESS)
+        return MSG_RESET;
+
+    nvmsp->buffer = buffer;
+    nvmsp->buffer_size = size;
+    nvmsp->buffer_org = 0;
+    nvmsp->buffer_n = 0;
+    nvmsp->buffer_flushed = 0;
+
+    return MSG_OK;
+}
+
+/**
+ * @brief   Writes data pending in the buffer of a NVM stream.
+ *
+ * @param[in] nvmsp     pointer to the @p NVMStream object
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       the operation succeeded.
+ * @retval MSG_RESET    the operation failed.
+ */
+msg_t nvmsFlush(NVMStream *nvmsp)
+{
+    osalDbgCheck(nvmsp != NULL);
+
+    if (nvm_stream_flush(nvmsp) != HAL_SUCCESS)
+        return MSG_RESET;
+
+    return MSG_OK;
+}
+
+/**
+ * @brief   Writes data pending in the buffer of a NVM stream and waits for
+ *          the device to complete, the stream is unbuffered afterwards.
+ *
+ * @param[in] nvmsp     pointer to the @p NVMStream object
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       the operation succeeded.
+ * @retval MSG_RESET    the operation failed.
+ */
+msg_t nvmsClose(NVMStream *nvmsp)
+{
+    osalDbgCheck(nvmsp != NULL);
+
+    if (nvmsSetBuffer(nvmsp, NULL, 0) != MSG_OK)
+        return MSG_RESET;
+
+    nvmAcquire(nvmsp->nvmdp);
+    if (nvmSync(nvmsp->nvmdp) != HAL_SUCCESS)
+    {
+        nvmRelease(nvmsp->nvmdp);
+        return MSG_RESET;
+    }
+    nvmRelease(nvmsp->nvmdp);
+
+    return MSG_OK;
 }
 
 /** @} */